@@ -0,0 +1,202 @@
+#include "Compression.h"
+#include <string.h>
+
+using MUtility::Byte;
+
+namespace
+{
+	constexpr int32_t	MIN_MATCH_LENGTH		= 4;
+	constexpr int32_t	LAST_LITERAL_COUNT		= 5;	// The LZ4 block format requires the last 5 bytes to be literals
+	constexpr int32_t	MATCH_FIND_LIMIT		= 12;	// and that the last match starts at least 12 bytes before the end
+	constexpr int32_t	MAX_OFFSET				= 65535;
+	constexpr int32_t	HASH_BIT_COUNT			= 12;
+	constexpr int32_t	HASH_TABLE_SIZE			= 1 << HASH_BIT_COUNT;
+	constexpr uint32_t	RUN_LENGTH_MASK			= 15;
+
+	uint32_t Read32(const Byte* source)
+	{
+		uint32_t value;
+		memcpy(&value, source, sizeof(uint32_t));
+		return value;
+	}
+
+	uint32_t Hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761U) >> (32 - HASH_BIT_COUNT);
+	}
+
+	int32_t GetLengthByteCount(int32_t length) // Bytes needed after the token for a length that doesn't fit in 4 bits
+	{
+		return length >= static_cast<int32_t>(RUN_LENGTH_MASK) ? (length - RUN_LENGTH_MASK) / 255 + 1 : 0;
+	}
+
+	void WriteLength(Byte*& destination, int32_t length)
+	{
+		for (length -= RUN_LENGTH_MASK; length >= 255; length -= 255)
+		{
+			*destination++ = 255;
+		}
+		*destination++ = static_cast<Byte>(length);
+	}
+
+	bool ReadLength(const Byte*& source, const Byte* sourceEnd, size_t limit, size_t& inOutLength)
+	{
+		Byte lengthByte;
+		do
+		{
+			if (source >= sourceEnd)
+				return false;
+
+			lengthByte = *source++;
+			inOutLength += lengthByte;
+			if (inOutLength > limit)
+				return false;
+		} while (lengthByte == 255);
+
+		return true;
+	}
+
+	bool WriteSequence(Byte*& destination, const Byte* destinationEnd, const Byte* literals, int32_t literalCount, int32_t offset, int32_t matchLength) // A matchLength below 0 writes the final literals only
+	{
+		int32_t requiredByteCount = 1 + GetLengthByteCount(literalCount) + literalCount + (matchLength >= 0 ? 2 + GetLengthByteCount(matchLength) : 0);
+		if (destinationEnd - destination < requiredByteCount)
+			return false;
+
+		Byte* token = destination++;
+		*token = static_cast<Byte>((literalCount < static_cast<int32_t>(RUN_LENGTH_MASK) ? literalCount : RUN_LENGTH_MASK) << 4);
+		if (literalCount >= static_cast<int32_t>(RUN_LENGTH_MASK))
+			WriteLength(destination, literalCount);
+
+		memcpy(destination, literals, literalCount);
+		destination += literalCount;
+
+		if (matchLength >= 0)
+		{
+			*destination++ = static_cast<Byte>(offset);
+			*destination++ = static_cast<Byte>(offset >> 8);
+
+			*token |= static_cast<Byte>(matchLength < static_cast<int32_t>(RUN_LENGTH_MASK) ? matchLength : RUN_LENGTH_MASK);
+			if (matchLength >= static_cast<int32_t>(RUN_LENGTH_MASK))
+				WriteLength(destination, matchLength);
+		}
+
+		return true;
+	}
+}
+
+int32_t Compression::GetMaxCompressedSize(int32_t sourceSize)
+{
+	return sourceSize + sourceSize / 255 + 16;
+}
+
+int32_t Compression::Compress(const Byte* source, int32_t sourceSize, Byte* destination, int32_t destinationCapacity)
+{
+	const Byte* sourceEnd		= source + sourceSize;
+	const Byte* matchEndLimit	= sourceEnd - LAST_LITERAL_COUNT;
+	const Byte* matchStartLimit	= sourceEnd - MATCH_FIND_LIMIT;
+	const Byte* destinationEnd	= destination + destinationCapacity;
+	Byte*		output			= destination;
+	const Byte* anchor			= source; // Start of the literals that haven't been written yet
+	const Byte* position		= source;
+
+	int32_t hashTable[HASH_TABLE_SIZE];
+	memset(hashTable, 0xFF, sizeof(hashTable)); // -1 marks empty slots
+
+	while (sourceSize > MATCH_FIND_LIMIT && position < matchStartLimit)
+	{
+		uint32_t sequence			= Read32(position);
+		uint32_t hash				= Hash(sequence);
+		int32_t candidateOffset		= hashTable[hash];
+		hashTable[hash]				= static_cast<int32_t>(position - source);
+
+		if (candidateOffset < 0 || (position - source) - candidateOffset > MAX_OFFSET || Read32(source + candidateOffset) != sequence)
+		{
+			++position;
+			continue;
+		}
+
+		const Byte* match = source + candidateOffset;
+		while (position > anchor && match > source && position[-1] == match[-1]) // Extend the match backwards into the pending literals
+		{
+			--position;
+			--match;
+		}
+
+		const Byte* matchEnd	= position + MIN_MATCH_LENGTH;
+		const Byte* reference	= match + MIN_MATCH_LENGTH;
+		while (matchEnd < matchEndLimit && *matchEnd == *reference)
+		{
+			++matchEnd;
+			++reference;
+		}
+
+		if (!WriteSequence(output, destinationEnd, anchor, static_cast<int32_t>(position - anchor), static_cast<int32_t>(position - match), static_cast<int32_t>(matchEnd - position) - MIN_MATCH_LENGTH))
+			return 0;
+
+		position	= matchEnd;
+		anchor		= matchEnd;
+		if (position < matchStartLimit)
+			hashTable[Hash(Read32(position - 2))] = static_cast<int32_t>(position - 2 - source);
+	}
+
+	if (!WriteSequence(output, destinationEnd, anchor, static_cast<int32_t>(sourceEnd - anchor), 0, -1))
+		return 0;
+
+	return static_cast<int32_t>(output - destination);
+}
+
+bool Compression::Decompress(const Byte* source, int32_t sourceSize, Byte* destination, int32_t decompressedSize)
+{
+	const Byte*	sourceEnd		= source + sourceSize;
+	Byte*		output			= destination;
+	Byte*		destinationEnd	= destination + decompressedSize;
+
+	while (source < sourceEnd)
+	{
+		uint32_t token = *source++;
+
+		size_t literalCount = token >> 4;
+		if (literalCount == RUN_LENGTH_MASK && !ReadLength(source, sourceEnd, static_cast<size_t>(decompressedSize), literalCount))
+			return false;
+
+		if (literalCount > static_cast<size_t>(sourceEnd - source) || literalCount > static_cast<size_t>(destinationEnd - output))
+			return false;
+
+		memcpy(output, source, literalCount);
+		output += literalCount;
+		source += literalCount;
+
+		if (source == sourceEnd) // The last sequence has no match
+			break;
+
+		if (sourceEnd - source < 2)
+			return false;
+
+		size_t offset = source[0] | (static_cast<size_t>(source[1]) << 8);
+		source += 2;
+		if (offset == 0 || offset > static_cast<size_t>(output - destination))
+			return false;
+
+		size_t matchLength = token & RUN_LENGTH_MASK;
+		if (matchLength == RUN_LENGTH_MASK && !ReadLength(source, sourceEnd, static_cast<size_t>(decompressedSize), matchLength))
+			return false;
+
+		matchLength += MIN_MATCH_LENGTH;
+		if (matchLength > static_cast<size_t>(destinationEnd - output))
+			return false;
+
+		const Byte* match = output - offset;
+		if (offset >= matchLength)
+			memcpy(output, match, matchLength);
+		else // Overlapping matches repeat the last offset bytes
+		{
+			for (size_t i = 0; i < matchLength; ++i)
+			{
+				output[i] = match[i];
+			}
+		}
+		output += matchLength;
+	}
+
+	return output == destinationEnd;
+}
\ No newline at end of file
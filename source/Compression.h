@@ -0,0 +1,11 @@
+#pragma once
+#include <MUtilityByte.h>
+#include <stdint.h>
+
+// In-tree LZ4 block compression. The output is a valid LZ4 block (Without the LZ4 frame format) and favours speed over ratio: a single hash probe per position and no lazy matching.
+namespace Compression
+{
+	int32_t	GetMaxCompressedSize(int32_t sourceSize);
+	int32_t	Compress(const MUtility::Byte* source, int32_t sourceSize, MUtility::Byte* destination, int32_t destinationCapacity); // Returns the compressed size or 0 if it didn't fit in destinationCapacity
+	bool	Decompress(const MUtility::Byte* source, int32_t sourceSize, MUtility::Byte* destination, int32_t decompressedSize); // Fails unless the block decompresses to exactly decompressedSize bytes. Safe to use on untrusted input
+}
\ No newline at end of file
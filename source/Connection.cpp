@@ -2,8 +2,12 @@
 #include "Interface/TubesTypes.h"
 #include "TubesErrors.h"
 #include "TubesUtility.h"
+#include "Interface/TubesSettings.h"
+#include "Interface/messaging/MessageAllocator.h"
+#include "Interface/messaging/SerializationCursor.h"
+#include "Compression.h"
 #include <MUtilityLog.h>
-#include <MUtilitySerialization.h>
+#include <algorithm>
 
 #if PLATFORM != PLATFORM_WINDOWS
 #include <unistd.h>
@@ -23,6 +27,9 @@
 
 #define LOG_CATEGORY_CONNECTION "TubesConnection"
 
+#define MAX_SEND_BATCH_SIZE 64 // Max number of buffers that are gathered into a single send call. Compact messages use two buffers; the compact header and the payload
+#define MAX_SCHEDULED_MESSAGE_COUNT (MAX_SEND_BATCH_SIZE / 2) // Enough scheduled messages to fill a send batch
+
 #if PLATFORM == PLATFORM_WINDOWS
 #define SHOULD_WAIT_FOR_TIMEOUT static_cast<bool>( GET_NETWORK_ERROR == WSAEWOULDBLOCK )
 #elif PLATFORM == PLATFORM_LINUX
@@ -33,7 +40,24 @@ using namespace Tubes;
 using namespace TubesUtility;
 using MUtility::Byte;
 
+static void SetSendBufferDescriptor(SendBufferDescriptor& descriptor, const Byte* data, int32_t byteCount)
+{
+#if PLATFORM == PLATFORM_WINDOWS
+	descriptor.buf = reinterpret_cast<CHAR*>(const_cast<Byte*>(data));
+	descriptor.len = static_cast<ULONG>(byteCount);
+#else
+	descriptor.iov_base = const_cast<Byte*>(data);
+	descriptor.iov_len	= static_cast<size_t>(byteCount);
+#endif
+}
+
 constexpr uint32_t DEFAULT_CONNECTION_TIMEOUT_SECONDS = 2;
+constexpr int32_t RECEIVE_MIN_FREE_BYTES = 4 * 1024; // Minimum free space offered to each recv call
+constexpr int64_t SEND_WINDOW_BYTE_SIZE = 64 * 1024; // Messages are scheduled until this many bytes wait to be sent, which bounds how long an urgent message waits behind messages that were scheduled before it
+constexpr int64_t COMPRESSION_MAX_BATCH_SIZE = 256 * 1024; // Larger runs of queued messages are split into several compressed batches
+constexpr int32_t LZ4_MAX_RATIO = 255; // Bounds the decompressed size a compressed frame can claim
+constexpr std::chrono::milliseconds DATAGRAM_HELLO_INTERVAL = std::chrono::milliseconds(100);
+constexpr uint32_t DATAGRAM_MAX_HELLO_COUNT = 50; // The peer is assumed to be unreachable through datagrams (E.g. blocked by a firewall) if none of the hellos arrive
 uint32_t Connection::ConnectionTimeout = DEFAULT_CONNECTION_TIMEOUT_SECONDS;
 
 // ---------- PUBLIC ----------
@@ -43,6 +67,9 @@ Connection::Connection(Socket connectionSocket, const std::string& destinationAd
 	m_Socket	= connectionSocket;
 	m_Address	= TubesUtility::IPv4StringToAddress(destinationAddress); // TODODB: Handle ipv6
 	m_Port		= destinationPort;
+	m_ConnectionType = ConnectionType::Outgoing;
+	m_HighWatermark	= Settings::SendQueueHighWatermark;
+	m_LowWatermark	= Settings::SendQueueLowWatermark;
 
 	memset(&m_Sockaddr, 0, sizeof(sockaddr_in));
 	m_Sockaddr.sin_family		= AF_INET;
@@ -55,70 +82,71 @@ Connection::Connection(Socket connectionSocket, const sockaddr_in& destination)
 	m_Socket	= connectionSocket;
 	m_Address	= ntohl(destination.sin_addr.s_addr);
 	m_Port		= ntohs(destination.sin_port);		// Local port if destination is a received connection
+	m_ConnectionType = ConnectionType::Incoming;
+	m_HighWatermark	= Settings::SendQueueHighWatermark;
+	m_LowWatermark	= Settings::SendQueueLowWatermark;
 
 	memset(&m_Sockaddr, 0, sizeof(sockaddr_in));
 	m_Sockaddr.sin_family		= AF_INET;
 	m_Sockaddr.sin_addr.s_addr	= destination.sin_addr.s_addr;
 	m_Sockaddr.sin_port			= destination.sin_port;
+
+	ReadLocalPort();
 }
 
 Connection::~Connection()
 {
-	while(!m_UnsentMessages.empty())
-	{
-		free(m_UnsentMessages.front().Message);
-		m_UnsentMessages.pop();
-	}
+	DetachDatagramChannel();
+	ClearUnsentMessages();
+	free(m_InflatedBatch.Data);
 }
 
-Tubes::ConnectionAttemptResult Connection::Connect()
+ConnectResult Connection::BeginConnect()
 {
-	// Set up timeout variables
-	timeval timeOut;
-	timeOut.tv_sec = ConnectionTimeout;
-	timeOut.tv_usec = 0;
-
-	fd_set set;
-	FD_ZERO(&set);
-	FD_SET(m_Socket, &set);
-
-	// Attempt to connect
 	MLOG_INFO("Attempting to connect to " + AddressToIPv4String(m_Address), LOG_CATEGORY_CONNECTION);
 
-	int result;
-	if ((result = connect(m_Socket, reinterpret_cast<sockaddr*>(&m_Sockaddr), sizeof(sockaddr_in))) == INVALID_SOCKET)
+	if (connect(m_Socket, reinterpret_cast<sockaddr*>(&m_Sockaddr), sizeof(sockaddr_in)) == 0)
 	{
-		if (!SHOULD_WAIT_FOR_TIMEOUT)
-			return ConnectionAttemptResult::FAILED_INTERNAL_ERROR;
+		ReadLocalPort();
+		return ConnectResult::Connected; // Connects to the local host may complete right away
 	}
-	result = select(static_cast<int>(m_Socket + 1), NULL, &set, NULL, &timeOut);
 
-	// Check result of the connection
-	if (result == 0)
+	if (SHOULD_WAIT_FOR_TIMEOUT)
+		return ConnectResult::InProgress;
+
+	LogAPIErrorMessage("Connection attempt to " + AddressToIPv4String(m_Address) + " failed", LOG_CATEGORY_CONNECTION);
+	return ConnectResult::Failed;
+}
+
+ConnectResult Connection::FinishConnect()
+{
+	int error = 0;
+	socklen_t errorSize = sizeof(error);
+	if (getsockopt(m_Socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &errorSize) != 0)
 	{
-		return ConnectionAttemptResult::FAILED_TIMEOUT;
+		LogAPIErrorMessage("Failed to get the result of the connection attempt to " + AddressToIPv4String(m_Address), LOG_CATEGORY_CONNECTION);
+		return ConnectResult::Failed;
 	}
-	else if (result < 0)
+
+	if (error != 0)
 	{
-		LogAPIErrorMessage("Connection attempt to " + AddressToIPv4String(m_Address) + " failed", LOG_CATEGORY_CONNECTION);
-		return ConnectionAttemptResult::FAILED_INTERNAL_ERROR;
+		MLOG_INFO("Connection attempt to " << AddressToIPv4String(m_Address) << " failed - Error (" << error << ") " << TubesUtility::GetErrorName(error), LOG_CATEGORY_CONNECTION);
+		return ConnectResult::Failed;
 	}
 
-	return ConnectionAttemptResult::SUCCESS_OUTGOING;
+	ReadLocalPort();
+	return ConnectResult::Connected;
 }
 
 void Connection::Disconnect()
 {
-	while (!m_UnsentMessages.empty())
-	{
-		free(m_UnsentMessages.front().Message);
-		m_UnsentMessages.pop();
-	}
+	DetachDatagramChannel();
+	ClearUnsentMessages();
 
 	TubesUtility::ShutdownAndCloseSocket(m_Socket);
 }
 
-SendResult Connection::SerializeAndSendMessage(const Message& message, MessageReplicator& replicator)
+SendResult Connection::SerializeAndSendMessage(const Message& message, MessageReplicator& replicator, MessagePriority priority)
 {
 	if (m_Socket == INVALID_SOCKET)
 	{
@@ -132,41 +160,428 @@ SendResult Connection::SerializeAndSendMessage(const Message& message, MessageRe
 	if (serializedMessage == nullptr)
 	{
 		MLOG_WARNING("Failed to serialize message of type" << message.Type + ". The message will not be sent", LOG_CATEGORY_CONNECTION);
-		free(serializedMessage);
+		MessageAllocator::Free(serializedMessage);
 		return SendResult::Error;
 	}
 
-	SendResult result = SendQueuedMessages();
-	switch (result)
+	SerializedMessage* sharedMessage = SerializedMessage::Create(serializedMessage, messageSize);
+	SendResult result = SendSerializedMessage(sharedMessage, priority);
+	sharedMessage->Release();
+
+	return result;
+}
+
+SendResult Connection::SendSerializedMessage(SerializedMessage* message, MessagePriority priority)
+{
+	if (m_Socket == INVALID_SOCKET)
+	{
+		MLOG_ERROR("Attempted to send message through invalid socket. (Destination =  " + AddressToIPv4String(m_Address) + " )", LOG_CATEGORY_CONNECTION);
+		return SendResult::Error;
+	}
+
+	SendResult failureResult;
+	if (m_HighWatermark > 0 && !MakeRoomInSendQueue(message->GetWireSize(m_SendCompact), priority, failureResult))
+		return failureResult;
+
+	// Queue the message behind any unsent data of the same priority and let one gathering send flush as much as possible
+	message->AddReference();
+	m_Scheduler.Push(UnsentMessage(message, m_SendCompact, m_SendCompressed), priority);
+	if (Settings::UseMessageCoalescing && priority != MessagePriority::CRITICAL && GetQueuedByteCount() < Settings::CoalescingFlushThreshold)
+	{
+		m_HoldingMessages = true;
+		return m_Backpressured ? SendResult::Backpressure : SendResult::Queued;
+	}
+
+	SendResult result = Flush();
+	return (result == SendResult::Queued && m_Backpressured) ? SendResult::Backpressure : result;
+}
+
+SendResult Connection::SendDeltaMessage(SerializedMessage* message, DeltaKey key)
+{
+	if (!m_SendDeltas)
+		return SendSerializedMessage(message);
+
+	SerializedMessage* deltaFrame = m_DeltaEncoder.Encode(message, key);
+	if (deltaFrame == nullptr)
+		return SendSerializedMessage(message);
+
+	SendResult result = SendSerializedMessage(deltaFrame);
+	deltaFrame->Release();
+	return result;
+}
+
+ReceiveResult Connection::Receive( const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, Message*& outMessage )
+{
+	const Byte* serializedMessage = nullptr;
+	int32_t wireSize = 0;
+	ReceiveResult result = ReceiveFrame(false, serializedMessage, wireSize);
+	if (result != ReceiveResult::Fullmessage)
+		return result;
+
+	// The full message is in the buffer; deserialize it in place
+	ReplicatorID replicatorID;
+	memcpy(&replicatorID, serializedMessage + sizeof(MessageSize), sizeof(ReplicatorID)); // sizeof(MessageSize) is for skipping the size variable embedded at the beginning of the message
+
+	auto idAndReplicator = replicators.find(replicatorID);
+	if (idAndReplicator == replicators.end()) // The requested replicator doesn't exist
+	{
+		MLOG_ERROR("Attempted to use replicator with id " << replicatorID + " but no such replicator exists", LOG_CATEGORY_CONNECTION);
+		m_ReceiveBuffer.Consume(wireSize);
+		return ReceiveResult::Error;
+	}
+
+	outMessage = idAndReplicator->second->DeserializeMessage(serializedMessage);
+	m_ReceiveBuffer.Consume(wireSize);
+
+	return ReceiveResult::Fullmessage;
+}
+
+ReceiveResult Connection::ReceiveView(MessageView& outView)
+{
+	const Byte* serializedMessage = nullptr;
+	int32_t wireSize = 0;
+	ReceiveResult result = ReceiveFrame(true, serializedMessage, wireSize);
+	if (result != ReceiveResult::Fullmessage)
+		return result;
+
+	// Hand out a view of the message where it lies and keep the bytes in place until the views are released
+	m_ReceiveBuffer.Pin();
+
+	MessageSize messageSize;
+	memcpy(&messageSize, serializedMessage, sizeof(MessageSize));
+
+	outView.Data		= serializedMessage;
+	outView.Size		= messageSize;
+	outView.Payload		= serializedMessage + MESSAGE_HEADER_SIZE;
+	outView.PayloadSize	= messageSize - MESSAGE_HEADER_SIZE;
+	memcpy(&outView.Replicator_ID, serializedMessage + sizeof(MessageSize), sizeof(ReplicatorID));
+	memcpy(&outView.Type, serializedMessage + sizeof(MessageSize) + sizeof(ReplicatorID), sizeof(MESSAGE_TYPE_ENUM_UNDELYING_TYPE));
+
+	m_ReceiveBuffer.Consume(wireSize);
+	return ReceiveResult::Fullmessage;
+}
+
+void Connection::ReleaseViews()
+{
+	m_ReceiveBuffer.Unpin();
+	m_InflatedBatch.Kept = false;
+}
+
+void Connection::HandOverViewedData(std::vector<Byte*>& outData)
+{
+	m_ReceiveBuffer.HandOverPinnedData(outData);
+}
+
+void Connection::OfferCapabilities()
+{
+	uint8_t localCapabilities = GetLocalCapabilities();
+	if (localCapabilities != 0)
+		SendCapabilities(localCapabilities, 0);
+}
+
+void Connection::AttachDatagramChannel(DatagramChannel* channel, ConnectionID ID)
+{
+	m_Datagrams.Channel	= channel;
+	m_Datagrams.ID		= ID;
+	if (m_ConnectionType != ConnectionType::Incoming)
+		return;
+
+	m_Datagrams.Token = channel->CreateToken(ID);
+	SendControlFrame(ConnectionControlType::DatagramToken, reinterpret_cast<const Byte*>(&m_Datagrams.Token), sizeof(m_Datagrams.Token));
+}
+
+SendResult Connection::SendDatagram(SerializedMessage* message, bool sequenced)
+{
+	if (!m_Datagrams.Reachable || message->GetSize() > MAX_DATAGRAM_FRAME_SIZE)
+		return SendSerializedMessage(message);
+
+	uint32_t sequence = 0;
+	if (sequenced)
 	{
-		case SendResult::Sent: // No more unsent messages are left
+		sequence = m_Datagrams.NextSequence++;
+		if (m_Datagrams.NextSequence == 0)
+			m_Datagrams.NextSequence = 1;
+	}
+
+	bool sent = m_Datagrams.Channel->Send(m_Datagrams.SendSocket, m_Datagrams.PeerAddress, m_Datagrams.Token, sequence, message->GetData(), message->GetSize());
+	return sent ? SendResult::Sent : SendResult::Dropped;
+}
+
+bool Connection::AcceptDatagram(const ReceivedDatagram& datagram)
+{
+	if (m_Datagrams.Token == 0 || datagram.Token != m_Datagrams.Token)
+		return false;
+
+	// The token is sent in plain text, so anyone who has seen it could claim to be the peer. Only the host at the other end of the stream is trusted
+	if (datagram.Source.sin_addr.s_addr != m_Sockaddr.sin_addr.s_addr)
+		return false;
+
+	if (m_ConnectionType == ConnectionType::Incoming)
+	{
+		// Follow the peer if its port changes (E.g. when a NAT mapping is renewed)
+		bool wasReachable = m_Datagrams.Reachable;
+		m_Datagrams.SendSocket	= datagram.ReceivingSocket;
+		m_Datagrams.PeerAddress	= datagram.Source;
+		m_Datagrams.Reachable	= true;
+		if (!wasReachable)
+			SendControlFrame(ConnectionControlType::DatagramConfirmed, nullptr, 0);
+	}
+
+	if (datagram.FrameSize == 0) // Hello
+		return false;
+
+	if (datagram.Sequence != 0)
+	{
+		// Wrap around safe comparison; the sequence numbers of a connection never get 2^31 apart
+		if (m_Datagrams.LastReceivedSequence != 0 && static_cast<int32_t>(datagram.Sequence - m_Datagrams.LastReceivedSequence) <= 0)
+			return false;
+		m_Datagrams.LastReceivedSequence = datagram.Sequence;
+	}
+
+	return true;
+}
+
+SendResult Connection::SendQueuedMessages()
+{
+	if (m_Datagrams.AwaitingConfirmation && std::chrono::steady_clock::now() >= m_Datagrams.NextHelloTime)
+		SendDatagramHello();
+
+	if (m_HoldingMessages)
+		return SendResult::Queued;
+
+	SendResult result = SendUnsentMessages();
+	if (result == SendResult::Queued && m_SendCompressed)
+	{
+		// The send window has been filled by now, so only the messages left behind in the scheduler are compressed. They go out with a later send
+		for (int32_t i = 0; i < MESSAGE_PRIORITY_COUNT; ++i)
 		{
-			result = SendSerializedMessage(serializedMessage, messageSize);
-			if (result == SendResult::Queued)
-				m_UnsentMessages.push(MessageAndSize(serializedMessage, messageSize));
-		} break;
+			MessagePriority priority = static_cast<MessagePriority>(i);
+			CompressUnsentMessages(m_Scheduler.GetLane(priority), m_Scheduler.GetLaneRewriteStart(priority));
+		}
+	}
+	return result;
+}
+
+SendResult Connection::Flush()
+{
+	m_HoldingMessages = false;
+	return SendQueuedMessages();
+}
+
+bool Connection::SetBlockingMode(bool shouldBlock)
+{
+	int result;
+#if PLATFORM == PLATFORM_WINDOWS
+	unsigned long nonBlocking = static_cast<unsigned long>(!shouldBlock);
+	result = ioctlsocket(m_Socket, FIONBIO, &nonBlocking);
+#else
+	int flags = fcntl(static_cast<int>(m_Socket), F_GETFL, 0);
+	result = flags < 0 ? flags : fcntl(static_cast<int>(m_Socket), F_SETFL, shouldBlock ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+#endif
+	if (result != 0)
+	{
+		LogAPIErrorMessage("Failed to set socket to non blocking mode", LOG_CATEGORY_CONNECTION);
+	}
 
-		case SendResult::Queued:
+	return result == 0;
+}
+
+bool Connection::SetNoDelay(bool noDelayOn)
+{
+	bool returnValue = true;
+
+	int flag = static_cast<int>(noDelayOn); // Linux rejects option values smaller than an int
+	int result = setsockopt(m_Socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&flag), sizeof(flag));
+	if (result < 0)
+	{
+		LogAPIErrorMessage("Failed to set TCP_NODELAY for socket with destination " + AddressToIPv4String(m_Address) + " (Error: " << result + ")", LOG_CATEGORY_CONNECTION);
+		returnValue = false;
+	}
+	return returnValue;
+}
+
+// ---------- PRIVATE ----------
+
+int64_t Connection::SendBuffers(SendBufferDescriptor* descriptors, int32_t descriptorCount)
+{
+#if PLATFORM == PLATFORM_WINDOWS
+	DWORD bytesSent = 0;
+	if (WSASend(m_Socket, descriptors, static_cast<DWORD>(descriptorCount), &bytesSent, 0, nullptr, nullptr) == SOCKET_ERROR)
+		return -1;
+
+	return static_cast<int64_t>(bytesSent);
+#else
+	msghdr messageHeader;
+	memset(&messageHeader, 0, sizeof(msghdr));
+	messageHeader.msg_iov		= descriptors;
+	messageHeader.msg_iovlen	= descriptorCount;
+
+	return sendmsg(m_Socket, &messageHeader, SEND_FLAGS); // sendmsg instead of writev since writev can't take MSG_NOSIGNAL
+#endif
+}
+
+SendResult Connection::SendUnsentMessages()
+{
+	SendBufferDescriptor descriptors[MAX_SEND_BATCH_SIZE];
+	while (true)
+	{
+		ScheduleMessages(false);
+		if (m_UnsentMessages.empty())
+			break;
+
+		// Gather as many unsent messages as possible into a single send. The first message may already have been partially sent
+		int32_t descriptorCount = 0;
+		int64_t gatheredByteCount = 0;
+		for (auto unsent = m_UnsentMessages.begin(); unsent != m_UnsentMessages.end() && descriptorCount + 2 <= MAX_SEND_BATCH_SIZE; ++unsent)
 		{
-			m_UnsentMessages.push(MessageAndSize(serializedMessage, messageSize));
+			const SerializedMessage* message = unsent->Payload;
+			int32_t offset = (unsent == m_UnsentMessages.begin()) ? m_UnsentHeadOffset : 0;
+			gatheredByteCount += message->GetWireSize(unsent->Compact) - offset;
+
+			if (!unsent->Compact)
+			{
+				SetSendBufferDescriptor(descriptors[descriptorCount++], message->GetData() + offset, message->GetSize() - offset);
+				continue;
+			}
+
+			// The compact header replaces the standard header in front of the shared payload
+			if (offset < message->GetCompactHeaderSize())
+			{
+				SetSendBufferDescriptor(descriptors[descriptorCount++], message->GetCompactHeader() + offset, message->GetCompactHeaderSize() - offset);
+				offset = 0;
+			}
+			else
+				offset -= message->GetCompactHeaderSize();
+
+			if (offset < message->GetPayloadSize())
+				SetSendBufferDescriptor(descriptors[descriptorCount++], message->GetPayload() + offset, message->GetPayloadSize() - offset);
+		}
+
+		int64_t bytesSent = SendBuffers(descriptors, descriptorCount);
+		if (bytesSent < 0)
+		{
+			int error = GET_NETWORK_ERROR;
+			if (error == TUBES_ECONNECTIONABORTED || error == EPIPE || error == TUBES_ECONNRESET)
+			{
+				// TODODB: Do a recv() here so we know if the disconnect is gracefull or not
+				return SendResult::Disconnect;
+			}
+			else if (error == TUBES_EWOULDBLOCK) // IF EWOULDBLOCK is set, the send buffer is full
+			{
+				UpdateBackpressure();
+				return SendResult::Queued;
+			}
+			else
+			{
+				LogAPIErrorMessage("Sending of " << descriptorCount << " messages with a total length of " << gatheredByteCount << " to destination " << AddressToIPv4String(m_Address) << " failed", LOG_CATEGORY_CONNECTION);
+				return SendResult::Error;
+			}
+		}
+
+		// Release the messages that were fully sent and remember how far into the next one the kernel accepted data
+		int64_t remainingSentBytes = bytesSent + m_UnsentHeadOffset;
+		while (!m_UnsentMessages.empty() && remainingSentBytes >= m_UnsentMessages.front().Payload->GetWireSize(m_UnsentMessages.front().Compact))
+		{
+			remainingSentBytes	-= m_UnsentMessages.front().Payload->GetWireSize(m_UnsentMessages.front().Compact);
+			m_UnsentByteCount	-= m_UnsentMessages.front().Payload->GetWireSize(m_UnsentMessages.front().Compact);
+			m_UnsentMessages.front().Payload->Release();
+			m_UnsentMessages.pop_front();
+		}
+		m_UnsentHeadOffset = static_cast<int32_t>(remainingSentBytes);
+
+		if (bytesSent < gatheredByteCount) // The kernel send buffer is full
+		{
+			UpdateBackpressure();
 			return SendResult::Queued;
-		} break;
+		}
+	}
 
+	UpdateBackpressure();
+	return m_Scheduler.IsEmpty() ? SendResult::Sent : SendResult::Queued; // Messages may be held back by the bandwidth budget
+}
+
+void Connection::ClearUnsentMessages()
+{
+	while (!m_UnsentMessages.empty())
+	{
+		m_UnsentMessages.front().Payload->Release();
+		m_UnsentMessages.pop_front();
+	}
+	m_Scheduler.Clear();
+	m_UnsentByteCount	= 0;
+	m_UnsentHeadOffset	= 0;
+	m_HoldingMessages	= false;
+	m_Backpressured		= false;
+}
 
-		case SendResult::Disconnect:
-		case SendResult::Error:
+bool Connection::MakeRoomInSendQueue(int64_t byteCount, MessagePriority priority, SendResult& outFailureResult)
+{
+	if (GetQueuedByteCount() + byteCount <= m_HighWatermark)
+		return true;
+
+	Flush(); // The socket may have drained since the last update
+	if (GetQueuedByteCount() + byteCount <= m_HighWatermark || priority == MessagePriority::CRITICAL) // Critical messages, including the connections own control frames, are never held back
+		return true;
+
+	m_Backpressured = true;
+	switch (Settings::SendQueuePolicy)
+	{
+		case SlowConsumerPolicy::DROP_OLDEST:
 		{
-			free(serializedMessage);
+			m_Scheduler.DropOldest(GetQueuedByteCount() + byteCount - m_HighWatermark);
+			if (GetQueuedByteCount() + byteCount <= m_HighWatermark)
+				return true;
+
+			outFailureResult = SendResult::Dropped; // What is left is critical or already being sent
 		} break;
 
-	default:
-		break;
+		case SlowConsumerPolicy::DISCONNECT:
+		{
+			MLOG_WARNING("The send queue to " << AddressToIPv4String(m_Address) << " would hold " << GetQueuedByteCount() + byteCount << " bytes which exceeds the high watermark of " << m_HighWatermark << " bytes; the connection will be closed", LOG_CATEGORY_CONNECTION);
+			outFailureResult = SendResult::SlowConsumer;
+		} break;
+
+		case SlowConsumerPolicy::DROP_NEWEST:
+		default:
+			outFailureResult = SendResult::Dropped;
+			break;
 	}
 
-	return result;
+	return false;
 }
 
-ReceiveResult Connection::Receive( const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, Message*& outMessage )
+void Connection::UpdateBackpressure()
+{
+	if (m_HighWatermark == 0)
+		m_Backpressured = false;
+	else if (GetQueuedByteCount() >= m_HighWatermark)
+		m_Backpressured = true;
+	else if (GetQueuedByteCount() <= m_LowWatermark)
+		m_Backpressured = false;
+}
+
+void Connection::ScheduleMessages(bool ignoreWindow)
+{
+	if (ignoreWindow)
+	{
+		size_t firstScheduled = m_UnsentMessages.size();
+		m_Scheduler.PopAll(m_UnsentMessages);
+		for (size_t i = firstScheduled; i < m_UnsentMessages.size(); ++i)
+		{
+			m_UnsentByteCount += m_UnsentMessages[i].Payload->GetWireSize(m_UnsentMessages[i].Compact);
+		}
+		return;
+	}
+
+	UnsentMessage message;
+	while (m_UnsentMessages.size() < MAX_SCHEDULED_MESSAGE_COUNT && m_UnsentByteCount < SEND_WINDOW_BYTE_SIZE && m_Scheduler.Pop(message))
+	{
+		m_UnsentByteCount += message.Payload->GetWireSize(message.Compact);
+		m_UnsentMessages.push_back(message);
+	}
+}
+
+ReceiveResult Connection::ReceiveFrame(bool keepFrame, const Byte*& outFrame, int32_t& outWireSize)
 {
 	if (m_Socket == INVALID_SOCKET)
 	{
@@ -174,65 +589,244 @@ ReceiveResult Connection::Receive( const std::unordered_map<ReplicatorID, Messag
 		return ReceiveResult::Error;
 	}
 
-	int32_t byteCountReceived;
-	if (m_ReceiveBuffer.ExpectedHeaderBytes > 0) // If we are waiting for header data
+	while (true) // Control frames are handled here and never reach the caller
 	{
-		byteCountReceived = recv(m_Socket, reinterpret_cast<char*>(m_ReceiveBuffer.Walker), m_ReceiveBuffer.ExpectedHeaderBytes, RECEIVE_FLAGS); // Attempt to receive header
+		m_ReadingInflatedFrame = m_InflatedBatch.ReadOffset < m_InflatedBatch.Size;
+		ReceiveResult result = m_ReadingInflatedFrame ? TakeInflatedFrame(keepFrame, outFrame, outWireSize) : ReadFrame(outFrame, outWireSize);
+		if (result != ReceiveResult::Fullmessage)
+			return result;
 
-		if (byteCountReceived == 0)
+		ReplicatorID replicatorID;
+		memcpy(&replicatorID, outFrame + sizeof(MessageSize), sizeof(ReplicatorID));
+		if (replicatorID != CONNECTION_CONTROL_REPLICATOR_ID)
+			return ReceiveResult::Fullmessage;
+
+		// Handled before the next frame is parsed since it may change the frame format
+		if (HandleControlFrame(outFrame, keepFrame, outFrame))
+			return ReceiveResult::Fullmessage;
+
+		m_ReceiveBuffer.Consume(outWireSize);
+	}
+}
+
+ReceiveResult Connection::ReadFrame(const Byte*& outFrame, int32_t& outWireSize)
+{
+	if (!ContainsFullFrame(outWireSize))
+	{
+		if (m_ReceiveBuffer.SocketDrained) // The last recv emptied the kernel buffer; skip the recv that would only report EWOULDBLOCK
 		{
-			MLOG_INFO("A Connection with destination " + TubesUtility::AddressToIPv4String(m_Address) + " has disconnected gracefully", LOG_CATEGORY_CONNECTION);
-			return ReceiveResult::GracefulDisconnect;
+			m_ReceiveBuffer.SocketDrained = false;
+			return m_ReceiveBuffer.GetBufferedByteCount() > 0 ? ReceiveResult::PartialMessage : ReceiveResult::Empty;
 		}
-		else if (byteCountReceived == -1) // No data was ready to be received or there was an error
-		{
-			ReceiveResult result = ReceiveResult::Empty;
-			int error = GET_NETWORK_ERROR;
-			if (error != TUBES_EWOULDBLOCK) // If EWOULDBLOCK is set, the receive buffer is empty
-			{
-				if (error == TUBES_ECONNECTIONABORTED || error == TUBES_ECONNRESET)
-				{
-					result = ReceiveResult::ForcefulDisconnect;
-					MLOG_INFO("A Connection with destination " + TubesUtility::AddressToIPv4String(m_Address) + " has disconnected forcefully", LOG_CATEGORY_CONNECTION);
-				}
-				else
-				{
-					result = ReceiveResult::Error;
-					LogAPIErrorMessage("An unhandled error occured while receiving header data", LOG_CATEGORY_CONNECTION);
-				}
-			}
+
+		ReceiveResult result = FillReceiveBuffer();
+		if (result != ReceiveResult::PartialMessage)
 			return result;
+
+		if (!ContainsFullFrame(outWireSize))
+		{
+			m_ReceiveBuffer.SocketDrained = false; // Let the next call fetch the rest of the message
+			return ReceiveResult::PartialMessage;
+		}
+	}
+
+	bool validFrame;
+	if (m_ReceiveCompact)
+		validFrame = ExpandCompactFrame(outWireSize, outFrame);
+	else
+	{
+		outFrame	= m_ReceiveBuffer.Data + m_ReceiveBuffer.ReadOffset;
+		validFrame	= outWireSize >= MESSAGE_HEADER_SIZE;
+	}
+
+	if (!validFrame)
+	{
+		MLOG_ERROR("Received a malformed message header (Size = " << outWireSize << ") from " << AddressToIPv4String(m_Address) << "; the buffered data will be dropped", LOG_CATEGORY_CONNECTION);
+		m_ReceiveBuffer.Reset();
+		return ReceiveResult::Error;
+	}
+
+	return ReceiveResult::Fullmessage;
+}
+
+ReceiveResult Connection::TakeInflatedFrame(bool keepFrame, const Byte*& outFrame, int32_t& outWireSize)
+{
+	int32_t remainingByteCount = m_InflatedBatch.Size - m_InflatedBatch.ReadOffset;
+	MessageSize messageSize = 0;
+	if (remainingByteCount >= static_cast<int32_t>(sizeof(MessageSize)))
+		memcpy(&messageSize, m_InflatedBatch.Data + m_InflatedBatch.ReadOffset, sizeof(MessageSize));
+
+	if (messageSize < MESSAGE_HEADER_SIZE || messageSize > remainingByteCount)
+	{
+		MLOG_ERROR("Received a compressed batch with a malformed message header (Size = " << messageSize << ") from " << AddressToIPv4String(m_Address) << "; the rest of the batch will be dropped", LOG_CATEGORY_CONNECTION);
+		m_InflatedBatch.ReadOffset = m_InflatedBatch.Size;
+		return ReceiveResult::Error;
+	}
+
+	outFrame					= m_InflatedBatch.Data + m_InflatedBatch.ReadOffset;
+	outWireSize					= 0; // The batch was consumed from the receive buffer as a whole
+	m_InflatedBatch.ReadOffset	+= messageSize;
+	m_InflatedBatch.Kept		|= keepFrame;
+	return ReceiveResult::Fullmessage;
+}
+
+bool Connection::Inflate(ReadCursor& reader)
+{
+	uint64_t decompressedSize;
+	reader.ReadVarUint(decompressedSize);
+	int32_t compressedSize = static_cast<int32_t>(reader.GetRemainingByteCount());
+	if (reader.HasFailed() || decompressedSize > static_cast<uint64_t>(compressedSize) * LZ4_MAX_RATIO || decompressedSize > INT32_MAX)
+		return false;
+
+	if (m_InflatedBatch.Kept) // Views point into the current batch so hand it over to the receive buffer which frees it once the views are released
+	{
+		m_ReceiveBuffer.RetiredData.push_back(m_InflatedBatch.Data);
+		m_InflatedBatch.Data		= nullptr;
+		m_InflatedBatch.Capacity	= 0;
+		m_InflatedBatch.Kept		= false;
+	}
+
+	if (m_InflatedBatch.Capacity < static_cast<int32_t>(decompressedSize))
+	{
+		free(m_InflatedBatch.Data);
+		m_InflatedBatch.Data		= static_cast<Byte*>(malloc(static_cast<size_t>(decompressedSize)));
+		if (m_InflatedBatch.Data == nullptr)
+		{
+			m_InflatedBatch.Capacity = 0;
+			MLOG_ERROR("Failed to allocate " << decompressedSize << " bytes for a compressed batch", LOG_CATEGORY_CONNECTION);
+			return false;
+		}
+		m_InflatedBatch.Capacity = static_cast<int32_t>(decompressedSize);
+	}
+
+	m_InflatedBatch.ReadOffset	= 0;
+	m_InflatedBatch.Size		= 0;
+	if (!Compression::Decompress(reader.Claim(compressedSize), compressedSize, m_InflatedBatch.Data, static_cast<int32_t>(decompressedSize)))
+		return false;
+
+	m_InflatedBatch.Size = static_cast<int32_t>(decompressedSize);
+	return true;
+}
+
+void Connection::CompressUnsentMessages(std::deque<UnsentMessage>& queue, size_t& firstUnscanned)
+{
+	// Only messages that are still waiting to be scheduled are compressed, which happens when they are produced faster than the socket accepts them.
+	// Everything before firstUnscanned has already been compressed or found not worth compressing, so each call only looks at the messages queued since the last one
+	size_t index = std::min(firstUnscanned, queue.size());
+	while (index < queue.size())
+	{
+		if (!queue[index].Compressible)
+		{
+			++index;
+			continue;
 		}
 
-		if (byteCountReceived == m_ReceiveBuffer.ExpectedHeaderBytes) // We received the full header
+		size_t runEnd = index;
+		int64_t runByteCount = 0;
+		while (runEnd < queue.size() && queue[runEnd].Compressible && runByteCount < COMPRESSION_MAX_BATCH_SIZE)
 		{
-			// Get the size of the packet (Embedded as first part) and create a buffer of that size
-			m_ReceiveBuffer.PayloadData = static_cast<Byte*>(malloc(m_ReceiveBuffer.ExpectedPayloadBytes));
+			runByteCount += queue[runEnd].Payload->GetSize();
+			++runEnd;
+		}
 
-			m_ReceiveBuffer.Walker = m_ReceiveBuffer.PayloadData; // Walker now points to the new buffer since that is where we will want to write on the next recv
+		if (runByteCount < Settings::CompressionThreshold)
+		{
+			if (runEnd == queue.size()) // Wait for more messages to join the run
+				break;
 
-			// Write down the size at the beginning so the serialization is done properly
-			MUtility::Serialization::CopyAndIncrementDestination(m_ReceiveBuffer.Walker, &m_ReceiveBuffer.ExpectedPayloadBytes, sizeof(MessageSize));
-			m_ReceiveBuffer.ExpectedPayloadBytes -= sizeof(MessageSize); // We have already received the size variable
+			index = runEnd; // The run can't grow past the message that ended it
+			continue;
+		}
 
-			m_ReceiveBuffer.ExpectedHeaderBytes = 0; // Reset the expected header bytes variable so it indicates that payload data is being received now
+		SerializedMessage* batch = CompressMessages(queue, index, runEnd, runByteCount);
+		if (batch == nullptr) // Incompressible; send the messages as they are
+		{
+			for (size_t i = index; i < runEnd; ++i)
+			{
+				queue[i].Compressible = false;
+			}
+			index = runEnd;
+			continue;
 		}
-		else // Only a part of the header was received. Account for this and handle it in an upcoming call of this function
+
+		bool compact = queue[index].Compact;
+		int64_t replacedByteCount = 0;
+		for (size_t i = index; i < runEnd; ++i)
 		{
-			m_ReceiveBuffer.ExpectedHeaderBytes -= byteCountReceived;
-			m_ReceiveBuffer.Walker += byteCountReceived;
-			return ReceiveResult::PartialMessage;
+			replacedByteCount += queue[i].Payload->GetWireSize(queue[i].Compact);
+			queue[i].Payload->Release();
 		}
+		m_Scheduler.AdjustQueuedByteCount(batch->GetWireSize(compact) - replacedByteCount);
+		queue.erase(queue.begin() + index, queue.begin() + runEnd);
+		queue.insert(queue.begin() + index, UnsentMessage(batch, compact, false));
+		++index;
 	}
+	firstUnscanned = index;
+}
 
-	byteCountReceived = recv(m_Socket, reinterpret_cast<char*>(m_ReceiveBuffer.Walker), m_ReceiveBuffer.ExpectedPayloadBytes, RECEIVE_FLAGS); // Attempt to receive payload
+SerializedMessage* Connection::CompressMessages(const std::deque<UnsentMessage>& queue, size_t first, size_t end, int64_t byteCount)
+{
+	// Compress a single message straight from its buffer and gather several into the scratch buffer
+	const Byte* source = queue[first].Payload->GetData();
+	if (end - first > 1)
+	{
+		m_CompressionScratch.resize(static_cast<size_t>(byteCount));
+		Byte* destination = m_CompressionScratch.data();
+		for (size_t i = first; i < end; ++i)
+		{
+			memcpy(destination, queue[i].Payload->GetData(), queue[i].Payload->GetSize());
+			destination += queue[i].Payload->GetSize();
+		}
+		source = m_CompressionScratch.data();
+	}
+
+	Byte encodedSize[CompactEncoding::MAX_VARINT_BYTE_SIZE];
+	int32_t encodedSizeByteCount	= CompactEncoding::EncodeVarint(static_cast<uint64_t>(byteCount), encodedSize);
+	int32_t headerSize				= MESSAGE_HEADER_SIZE + encodedSizeByteCount;
+	int32_t maxFrameSize			= static_cast<int32_t>(byteCount) - 1; // Anything larger isn't worth it
+	if (maxFrameSize <= headerSize)
+		return nullptr;
+
+	Byte* frame = static_cast<Byte*>(MessageAllocator::Allocate(maxFrameSize));
+	int32_t compressedSize = Compression::Compress(source, static_cast<int32_t>(byteCount), frame + headerSize, maxFrameSize - headerSize);
+	if (compressedSize == 0)
+	{
+		MessageAllocator::Free(frame);
+		return nullptr;
+	}
+
+	MessageSize frameSize = headerSize + compressedSize;
+	WriteCursor writer;
+	writer.BeginFixed(frame, headerSize);
+	writer.Write(frameSize);
+	writer.Write(static_cast<ReplicatorID>(CONNECTION_CONTROL_REPLICATOR_ID));
+	writer.Write(static_cast<MESSAGE_TYPE_ENUM_UNDELYING_TYPE>(ConnectionControlType::Compressed));
+	writer.WriteMemory(encodedSize, encodedSizeByteCount);
 
+	return SerializedMessage::Create(frame, frameSize);
+}
+
+ReceiveResult Connection::FillReceiveBuffer()
+{
+	// Make room for the rest of the current message, or at least a full chunk, so that one recv can fetch everything the kernel has
+	int32_t requiredByteCount = RECEIVE_MIN_FREE_BYTES;
+	int32_t frameSize;
+	if (!ContainsFullFrame(frameSize) && frameSize > 0)
+		requiredByteCount = std::max(requiredByteCount, frameSize - m_ReceiveBuffer.GetBufferedByteCount());
+	if (!m_ReceiveBuffer.Reserve(requiredByteCount))
+	{
+		MLOG_ERROR("Failed to grow the receive buffer of the connection with destination " << AddressToIPv4String(m_Address) << " to fit " << requiredByteCount << " more bytes", LOG_CATEGORY_CONNECTION);
+		return ReceiveResult::Error;
+	}
+
+	int32_t freeByteCount = m_ReceiveBuffer.GetFreeByteCount();
+	int32_t byteCountReceived = recv(m_Socket, reinterpret_cast<char*>(m_ReceiveBuffer.Data + m_ReceiveBuffer.WriteOffset), freeByteCount, RECEIVE_FLAGS);
 	if (byteCountReceived == 0)
 	{
 		MLOG_INFO("A Connection with destination " + TubesUtility::AddressToIPv4String(m_Address) + " has disconnected gracefully", LOG_CATEGORY_CONNECTION);
 		return ReceiveResult::GracefulDisconnect;
 	}
-	else if (byteCountReceived == -1) // No data was ready to be received or there was an error // TODODB: This code is almost duplicated. See if it can be removed
+	else if (byteCountReceived < 0) // No data was ready to be received or there was an error
 	{
 		ReceiveResult result = ReceiveResult::Empty;
 		int error = GET_NETWORK_ERROR;
@@ -241,134 +835,324 @@ ReceiveResult Connection::Receive( const std::unordered_map<ReplicatorID, Messag
 			if (error == TUBES_ECONNECTIONABORTED || error == TUBES_ECONNRESET)
 			{
 				result = ReceiveResult::ForcefulDisconnect;
-				MLOG_INFO("Connection to " + TubesUtility::AddressToIPv4String(m_Address) + " was aborted", LOG_CATEGORY_CONNECTION);
+				MLOG_INFO("A Connection with destination " + TubesUtility::AddressToIPv4String(m_Address) + " has disconnected forcefully", LOG_CATEGORY_CONNECTION);
 			}
 			else
 			{
 				result = ReceiveResult::Error;
-				LogAPIErrorMessage("An unhandled error occured while receiving payload data", LOG_CATEGORY_CONNECTION);
+				LogAPIErrorMessage("An unhandled error occured while receiving data", LOG_CATEGORY_CONNECTION);
 			}
 		}
 		return result;
 	}
 
-	// If all data was received. Clean up, prepare for next call and return the buffer as a packet (Will need to be cast to the correct type on the outside using the Type field)
-	if (byteCountReceived == m_ReceiveBuffer.ExpectedPayloadBytes)
-	{
-		// Read the replicator id
-		ReplicatorID replicatorID;
-		memcpy(&replicatorID, m_ReceiveBuffer.PayloadData + sizeof(MessageSize), sizeof(ReplicatorID)); // sizeof(MessageSize) is for skipping the size variable embedded at the beginning of the buffer
+	m_ReceiveBuffer.WriteOffset		+= byteCountReceived;
+	m_ReceiveBuffer.SocketDrained	= byteCountReceived < freeByteCount;
+	return ReceiveResult::PartialMessage;
+}
 
-		if (replicators.find(replicatorID) == replicators.end()) // The requested replicator doesn't exist
-		{
-			MLOG_ERROR("Attempted to use replicator with id " << replicatorID + " but no such replicator exists", LOG_CATEGORY_CONNECTION);
-			free(m_ReceiveBuffer.PayloadData);
-			return ReceiveResult::Error;
-		}
+bool Connection::ContainsFullFrame(int32_t& outFrameSize) const
+{
+	outFrameSize = 0; // Unknown until the size has been received
+	if (m_ReceiveCompact)
+		return m_ReceiveBuffer.ContainsFullCompactMessage(outFrameSize);
 
-		outMessage = replicators.at(replicatorID)->DeserializeMessage(m_ReceiveBuffer.PayloadData);
-		free(m_ReceiveBuffer.PayloadData);
-		m_ReceiveBuffer.Reset();
+	MessageSize messageSize = 0;
+	bool result = m_ReceiveBuffer.ContainsFullMessage(messageSize);
+	outFrameSize = messageSize;
+	return result;
+}
 
-		return ReceiveResult::Fullmessage;
-	}
-	else // Only part of the payload was received. Account for this and attempt to receive the rest in an upcoming call of this function
+bool Connection::ExpandCompactFrame(int32_t frameSize, const Byte*& outFrame)
+{
+	if (frameSize < 0)
+		return false;
+
+	const Byte* frame = m_ReceiveBuffer.Data + m_ReceiveBuffer.ReadOffset;
+	ReadCursor reader;
+	reader.Begin(frame, frame + frameSize);
+
+	uint64_t bodySize;
+	ReplicatorID replicatorID;
+	uint64_t type;
+	reader.ReadVarUint(bodySize);
+	reader.Read(replicatorID);
+	reader.ReadVarUint(type);
+	if (reader.HasFailed())
+		return false;
+
+	int32_t headerSize	= static_cast<int32_t>(reader.GetPosition() - frame);
+	int32_t payloadSize	= frameSize - headerSize;
+	if (payloadSize > INT32_MAX - MESSAGE_HEADER_SIZE)
+		return false;
+
+	MessageSize messageSize = MESSAGE_HEADER_SIZE + payloadSize;
+	Byte* expandedFrame;
+	if (m_ReceiveBuffer.Pinned) // The bytes before the payload may belong to a message view so expand into a copy that lives until the views are released
 	{
-		m_ReceiveBuffer.ExpectedPayloadBytes -= byteCountReceived;
-		m_ReceiveBuffer.Walker += byteCountReceived;
-		return ReceiveResult::PartialMessage;
+		expandedFrame = static_cast<Byte*>(malloc(messageSize));
+		if (expandedFrame == nullptr)
+		{
+			MLOG_ERROR("Failed to allocate " << messageSize << " bytes for a compact message from " << AddressToIPv4String(m_Address), LOG_CATEGORY_CONNECTION);
+			return false;
+		}
+
+		memcpy(expandedFrame + MESSAGE_HEADER_SIZE, frame + headerSize, payloadSize);
+		m_ReceiveBuffer.RetiredData.push_back(expandedFrame);
 	}
+	else // Everything before the payload has been consumed and the buffer headroom guarantees that a full header fits in front of it
+		expandedFrame = m_ReceiveBuffer.Data + m_ReceiveBuffer.ReadOffset + headerSize - MESSAGE_HEADER_SIZE;
+
+	memcpy(expandedFrame, &messageSize, sizeof(MessageSize));
+	memcpy(expandedFrame + sizeof(MessageSize), &replicatorID, sizeof(ReplicatorID));
+	memcpy(expandedFrame + sizeof(MessageSize) + sizeof(ReplicatorID), &type, sizeof(MESSAGE_TYPE_ENUM_UNDELYING_TYPE));
+
+	outFrame = expandedFrame;
+	return true;
 }
 
-SendResult Connection::SendQueuedMessages()
+bool Connection::HandleControlFrame(const Byte* frame, bool keepFrame, const Byte*& outMessageFrame)
 {
-	SendResult sendResult = SendResult::Sent;
-	bool breakLoop = false;
-	while (!m_UnsentMessages.empty() && !breakLoop)
+	MessageSize messageSize;
+	memcpy(&messageSize, frame, sizeof(MessageSize));
+
+	ReadCursor reader;
+	reader.Begin(frame, frame + messageSize);
+	reader.Skip(sizeof(MessageSize) + sizeof(ReplicatorID));
+
+	MESSAGE_TYPE_ENUM_UNDELYING_TYPE type;
+	reader.Read(type);
+	switch (static_cast<ConnectionControlType>(type))
 	{
-		sendResult = SendSerializedMessage(m_UnsentMessages.front().Message, m_UnsentMessages.front().MessageSize);
-		switch (sendResult)
+		case ConnectionControlType::Capabilities:
 		{
-			case SendResult::Queued:
-			case SendResult::Disconnect:
-			case SendResult::Error:
+			uint8_t offeredCapabilities;
+			uint8_t activeCapabilities;
+			reader.Read(offeredCapabilities);
+			reader.Read(activeCapabilities);
+			if (reader.HasFailed())
 			{
-				breakLoop = true;
-			} break;
+				MLOG_WARNING("Received a truncated capabilities frame from " << AddressToIPv4String(m_Address) << "; it will be ignored", LOG_CATEGORY_CONNECTION);
+				return false;
+			}
+
+			m_ReceiveCompact = (activeCapabilities & ConnectionCapabilities::COMPACT_FRAMES) != 0; // The peer uses its active capabilities for everything it sends after this frame
 
-			case SendResult::Sent:
+			uint8_t agreedCapabilities = offeredCapabilities & GetLocalCapabilities();
+			if (!m_CapabilitiesActivated && agreedCapabilities != 0)
 			{
-				m_UnsentMessages.pop();
-			} break;
+				SendCapabilities(GetLocalCapabilities(), agreedCapabilities);
+				m_SendCompact			= (agreedCapabilities & ConnectionCapabilities::COMPACT_FRAMES) != 0; // Only messages queued after the capabilities frame use the new format
+				m_SendDeltas			= (agreedCapabilities & ConnectionCapabilities::DELTA_FRAMES) != 0;
+				m_SendCompressed		= (agreedCapabilities & ConnectionCapabilities::COMPRESSED_FRAMES) != 0;
+				m_CapabilitiesActivated	= true;
+			}
+		} break;
 
-			default:
-				break;
-		}
+		case ConnectionControlType::Delta:
+			return HandleDeltaFrame(reader, keepFrame, outMessageFrame);
+
+		case ConnectionControlType::Compressed:
+		{
+			if (m_ReadingInflatedFrame)
+			{
+				MLOG_ERROR("Received a compressed batch nested inside another from " << AddressToIPv4String(m_Address) << "; it will be dropped", LOG_CATEGORY_CONNECTION);
+				return false;
+			}
+
+			if (!Inflate(reader))
+				MLOG_ERROR("Failed to inflate a compressed batch from " << AddressToIPv4String(m_Address) << "; it will be dropped", LOG_CATEGORY_CONNECTION);
+		} break;
+
+		case ConnectionControlType::DeltaNack:
+		{
+			uint64_t key;
+			uint64_t failedSequence;
+			reader.ReadVarUint(key);
+			reader.ReadVarUint(failedSequence);
+			if (reader.HasFailed())
+			{
+				MLOG_WARNING("Received a truncated delta NACK from " << AddressToIPv4String(m_Address) << "; it will be ignored", LOG_CATEGORY_CONNECTION);
+				return false;
+			}
+
+			m_DeltaEncoder.HandleNack(static_cast<DeltaKey>(key), failedSequence);
+		} break;
+
+		case ConnectionControlType::DatagramToken:
+		{
+			uint64_t token;
+			reader.Read(token);
+			if (reader.HasFailed() || token == 0)
+			{
+				MLOG_WARNING("Received an invalid datagram token from " << AddressToIPv4String(m_Address) << "; it will be ignored", LOG_CATEGORY_CONNECTION);
+				return false;
+			}
+
+			if (m_Datagrams.Channel == nullptr || m_ConnectionType != ConnectionType::Outgoing || m_Datagrams.Token != 0) // Unreliable messages are then sent over the stream
+				return false;
+
+			m_Datagrams.SendSocket = m_Datagrams.Channel->GetSocket(TUBES_PORT_ANY);
+			if (m_Datagrams.SendSocket == INVALID_SOCKET)
+				return false;
+
+			// The accepting side receives datagrams on the port that it accepted the connection on
+			m_Datagrams.Token					= token;
+			m_Datagrams.PeerAddress				= m_Sockaddr;
+			m_Datagrams.Reachable				= true;
+			m_Datagrams.AwaitingConfirmation	= true;
+			m_Datagrams.Channel->RegisterToken(token, m_Datagrams.ID);
+			SendDatagramHello();
+		} break;
+
+		case ConnectionControlType::DatagramConfirmed:
+		{
+			m_Datagrams.AwaitingConfirmation = false;
+		} break;
+
+		default:
+			MLOG_WARNING("Received a control frame of unknown type " << type << " from " << AddressToIPv4String(m_Address) << "; it will be ignored", LOG_CATEGORY_CONNECTION);
+			break;
 	}
 
-	return sendResult;
+	return false;
 }
 
-bool Connection::SetBlockingMode(bool shouldBlock)
+bool Connection::HandleDeltaFrame(ReadCursor& reader, bool keepFrame, const Byte*& outMessageFrame)
 {
-	int result;
-#if PLATFORM == PLATFORM_WINDOWS
-	unsigned long nonBlocking = static_cast<unsigned long>(!shouldBlock);
-	result = ioctlsocket(m_Socket, FIONBIO, &nonBlocking);
-#else
-	shouldBlock ? result = fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 1) | O_NONBLOCK) : result = fcntl(socket, F_SETFL, fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
-#endif
-	if (result != 0)
+	const Byte* image = nullptr;
+	DeltaKey key;
+	uint64_t sequence;
+	switch (m_DeltaDecoder.Decode(reader, image, key, sequence))
 	{
-		LogAPIErrorMessage("Failed to set socket to non blocking mode", LOG_CATEGORY_CONNECTION);
+		case DeltaDecoder::Result::Decoded:
+		{
+			MessageSize imageSize;
+			memcpy(&imageSize, image, sizeof(MessageSize));
+			if (keepFrame) // The image is replaced by the next frame with the same key
+			{
+				Byte* keptImage = static_cast<Byte*>(malloc(imageSize));
+				if (keptImage == nullptr)
+				{
+					MLOG_ERROR("Failed to allocate " << imageSize << " bytes for a delta compressed message from " << AddressToIPv4String(m_Address) << "; it will be dropped", LOG_CATEGORY_CONNECTION);
+					return false;
+				}
+
+				memcpy(keptImage, image, imageSize);
+				m_ReceiveBuffer.RetiredData.push_back(keptImage);
+				image = keptImage;
+			}
+
+			outMessageFrame = image;
+		} return true;
+
+		case DeltaDecoder::Result::MissingBaseline:
+		{
+			// Ask for a full image. The message itself is lost, which is acceptable for state that is sent repeatedly
+			MessageSize nackSize = MESSAGE_HEADER_SIZE + 2 * CompactEncoding::MAX_VARINT_BYTE_SIZE;
+			WriteCursor writer;
+			writer.BeginGrowable(nackSize);
+			writer.Write(static_cast<MessageSize>(0)); // Patched below
+			writer.Write(static_cast<ReplicatorID>(CONNECTION_CONTROL_REPLICATOR_ID));
+			writer.Write(static_cast<MESSAGE_TYPE_ENUM_UNDELYING_TYPE>(ConnectionControlType::DeltaNack));
+			writer.WriteVarUint(key);
+			writer.WriteVarUint(sequence);
+			nackSize = writer.GetWrittenByteCount();
+			writer.WriteAt(0, &nackSize, sizeof(MessageSize));
+
+			Byte* nackFrame = writer.Release();
+			if (nackFrame != nullptr)
+			{
+				SerializedMessage* nack = SerializedMessage::Create(nackFrame, nackSize);
+				SendSerializedMessage(nack, MessagePriority::CRITICAL);
+				nack->Release();
+			}
+		} break;
+
+		case DeltaDecoder::Result::Malformed:
+		default:
+			MLOG_ERROR("Received a malformed delta frame from " << AddressToIPv4String(m_Address) << "; it will be dropped", LOG_CATEGORY_CONNECTION);
+			break;
 	}
 
-	return result == 0;
+	return false;
 }
 
-bool Connection::SetNoDelay(bool noDelayOn)
+void Connection::SendCapabilities(uint8_t offeredCapabilities, uint8_t activeCapabilities)
 {
-	bool returnValue = true;
+	// Control frames are sent with the format that is active before the frame so that the peer can parse them.
+	// Messages queued before a format change must reach the wire before it, so they are all scheduled ahead of the frame
+	if (activeCapabilities != 0)
+		ScheduleMessages(true);
 
-	char flag = static_cast<char>(noDelayOn);
-	int result = setsockopt(m_Socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
-	if (result < 0)
-	{
-		LogAPIErrorMessage("Failed to set TCP_NODELAY for socket with destination " + AddressToIPv4String(m_Address) + " (Error: " << result + ")", LOG_CATEGORY_CONNECTION);
-		returnValue = false;
-	}
-	return returnValue;
+	Byte capabilities[2] = { offeredCapabilities, activeCapabilities };
+	SendControlFrame(ConnectionControlType::Capabilities, capabilities, sizeof(capabilities));
 }
 
-// ---------- PRIVATE ----------
+void Connection::SendControlFrame(ConnectionControlType type, const Byte* payload, int32_t payloadSize)
+{
+	MessageSize messageSize = MESSAGE_HEADER_SIZE + payloadSize;
+	Byte* frame = static_cast<Byte*>(MessageAllocator::Allocate(messageSize));
+
+	WriteCursor writer;
+	writer.BeginFixed(frame, messageSize);
+	writer.Write(messageSize);
+	writer.Write(static_cast<ReplicatorID>(CONNECTION_CONTROL_REPLICATOR_ID));
+	writer.Write(static_cast<MESSAGE_TYPE_ENUM_UNDELYING_TYPE>(type));
+	if (payloadSize > 0)
+		writer.WriteMemory(payload, payloadSize);
+
+	SerializedMessage* message = SerializedMessage::Create(frame, messageSize);
+	SendSerializedMessage(message, MessagePriority::CRITICAL);
+	message->Release();
+}
 
-SendResult Connection::SendSerializedMessage(Byte* serializedMessage, MessageSize messageSize)
+void Connection::SendDatagramHello()
 {
-	SendResult result;
-	int32_t bytesSent = send(m_Socket, reinterpret_cast<const char*>(serializedMessage), messageSize, SEND_FLAGS);
-	if (bytesSent == messageSize)
+	if (m_Datagrams.HellosSent == DATAGRAM_MAX_HELLO_COUNT)
 	{
-		free(serializedMessage);
-		result = SendResult::Sent;
+		MLOG_WARNING("No datagrams sent to " << AddressToIPv4String(m_Address) << " arrived; unreliable messages sent by the peer will arrive over the stream", LOG_CATEGORY_CONNECTION);
+		m_Datagrams.AwaitingConfirmation = false;
+		return;
 	}
-	else
+
+	m_Datagrams.Channel->Send(m_Datagrams.SendSocket, m_Datagrams.PeerAddress, m_Datagrams.Token, 0, nullptr, 0);
+	++m_Datagrams.HellosSent;
+	m_Datagrams.NextHelloTime = std::chrono::steady_clock::now() + DATAGRAM_HELLO_INTERVAL;
+}
+
+void Connection::DetachDatagramChannel()
+{
+	if (m_Datagrams.Channel != nullptr && m_Datagrams.Token != 0)
+		m_Datagrams.Channel->UnregisterToken(m_Datagrams.Token);
+
+	m_Datagrams.Token					= 0;
+	m_Datagrams.Reachable				= false;
+	m_Datagrams.AwaitingConfirmation	= false;
+}
+
+uint8_t Connection::GetLocalCapabilities() const
+{
+	uint8_t capabilities = 0;
+	if (Settings::UseCompactWireFormat)
+		capabilities |= ConnectionCapabilities::COMPACT_FRAMES;
+	if (Settings::UseDeltaCompression)
+		capabilities |= ConnectionCapabilities::DELTA_FRAMES;
+	if (Settings::UseCompression)
+		capabilities |= ConnectionCapabilities::COMPRESSED_FRAMES;
+
+	return capabilities;
+}
+
+void Connection::ReadLocalPort()
+{
+	sockaddr_in localAddress;
+	socklen_t localAddressSize = sizeof(localAddress);
+	if (getsockname(m_Socket, reinterpret_cast<sockaddr*>(&localAddress), &localAddressSize) != 0)
 	{
-		int error = GET_NETWORK_ERROR;
-		if (error == TUBES_ECONNECTIONABORTED || error == EPIPE || error == TUBES_ECONNRESET)
-		{
-			// TODODB: Do a recv() here so we know if the disconnect is gracefull or not
-			result = SendResult::Disconnect;
-		}
-		else if (error == TUBES_EWOULDBLOCK) // IF EWOULDBLOCK is set, the send buffer is full
-		{
-			result = SendResult::Queued;
-		}
-		else
-		{
-			result = SendResult::Error;
-			LogAPIErrorMessage("Sending of packet with length " << messageSize << " and destination " << AddressToIPv4String(m_Address) << " failed", LOG_CATEGORY_CONNECTION);
-		}
+		LogAPIErrorMessage("Failed to get the local port of the connection to " + AddressToIPv4String(m_Address), LOG_CATEGORY_CONNECTION);
+		return;
 	}
 
-	return result;
+	m_LocalPort = ntohs(localAddress.sin_port);
 }
\ No newline at end of file
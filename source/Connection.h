@@ -1,16 +1,29 @@
 #pragma once
 #include "Interface/TubesTypes.h"
 #include "InternalTubesTypes.h"
+#include "DatagramChannel.h"
+#include "DeltaCompression.h"
+#include "Interface/messaging/MessageView.h"
+#include "SendScheduler.h"
+#include "SerializedMessage.h"
 #include "TubesMessageReplicator.h"
-#include <queue>
+#include <chrono>
+#include <deque>
 #include <unordered_map>
 #if PLATFORM == PLATFORM_WINDOWS
 #include <WinSock2.h>
 #else
 #include <sys/socket.h>
+#include <sys/uio.h> // for iovec
 #include <netinet/in.h> // for sockaddr_in
 #endif
 
+#if PLATFORM == PLATFORM_WINDOWS
+typedef WSABUF	SendBufferDescriptor;
+#else
+typedef iovec	SendBufferDescriptor;
+#endif
+
 enum class ConnectionType
 {
 	Outgoing,
@@ -23,10 +36,20 @@ enum class SendResult
 {
 	Sent,
 	Queued,
+	Backpressure,	// Queued, but the send queue is above its high watermark and hasn't drained below the low watermark yet
+	Dropped,		// The message never reached the network. The send queue was full, or an unreliable datagram was lost to the simulated loss or a failed sendto
+	SlowConsumer,	// The send queue was full and the connection should be disconnected
 	Disconnect,
 	Error,
 };
 
+enum class ConnectResult
+{
+	Connected,
+	InProgress,
+	Failed,
+};
+
 enum class ReceiveResult
 {
 	Fullmessage,
@@ -44,41 +67,120 @@ public:
 	Connection(Socket connectionSocket, const sockaddr_in& destination);
 	~Connection();
 
-	Tubes::ConnectionAttemptResult	Connect();
-	void							Disconnect();
+	ConnectResult	BeginConnect(); // Starts a non-blocking connect. The socket becomes writable once the attempt has completed
+	ConnectResult	FinishConnect(); // Checks the outcome of an attempt started by BeginConnect
+	void			Disconnect();
 
-	SendResult		SerializeAndSendMessage(const Message& message, MessageReplicator& replicator);
+	SendResult		SerializeAndSendMessage(const Message& message, MessageReplicator& replicator, Tubes::MessagePriority priority = Tubes::MessagePriority::NORMAL);
+	SendResult		SendSerializedMessage(SerializedMessage* message, Tubes::MessagePriority priority = Tubes::MessagePriority::NORMAL); // Adds a reference to the message which is released once it has been fully sent
+	SendResult		SendDeltaMessage(SerializedMessage* message, Tubes::DeltaKey key); // Sends the message delta compressed against the last message sent with the same key if the peer supports it
 	ReceiveResult	Receive(const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, Message*& outMessage);
+	ReceiveResult	ReceiveView(MessageView& outView); // The view stays valid until ReleaseViews is called
+	void			ReleaseViews();
+	void			HandOverViewedData(std::vector<MUtility::Byte*>& outData); // Moves the buffers that views point into to outData so that the views outlive the connection. outData is freed once the views are released
+	void			OfferCapabilities(); // Called by the accepting side once the connection has been verified. The connecting side answers if it supports any of the offered capabilities
+	void			AttachDatagramChannel(DatagramChannel* channel, Tubes::ConnectionID ID); // Called once the connection has been verified. The accepting side hands out the token that binds the peer's datagrams to this connection
+	SendResult		SendDatagram(SerializedMessage* message, bool sequenced); // Sent over the stream instead while the peer can't be reached through datagrams or if the message doesn't fit in one
+	bool			AcceptDatagram(const ReceivedDatagram& datagram); // Returns false if the datagram carries no message for the application or is older than a sequenced datagram already received
 
-	SendResult SendQueuedMessages();
+	SendResult SendQueuedMessages(); // Continues sending what has been flushed. Messages held by Settings::UseMessageCoalescing stay until Flush is called
+	SendResult Flush();
 
 	bool operator == (const Connection& other) const { return this->m_Address == other.m_Address && this->m_Socket == other.m_Socket; }
 	bool operator != (const Connection& other) const { return this->m_Address != other.m_Address || this->m_Socket != other.m_Socket; }
 
+	Socket	GetSocket() const { return m_Socket; }
 	Address	GetAddress() const { return m_Address; }
 	Port	GetPort() const { return m_Port; }
+	Port	GetLocalPort() const { return m_LocalPort; } // 0 until the connection has been established
+
+	bool	HasUnsentMessages() const { return !m_UnsentMessages.empty() || !m_Scheduler.IsEmpty(); }
+	int64_t	GetQueuedByteCount() const { return m_Scheduler.GetQueuedByteCount() + m_UnsentByteCount - m_UnsentHeadOffset; }
+	bool	IsBackpressured() const { return m_Backpressured; }
+	void	SetSendQueueWatermarks(uint32_t highWatermark, uint32_t lowWatermark) { m_HighWatermark = highWatermark; m_LowWatermark = lowWatermark; }
+	bool	HasReceivedData() const { return m_ReceiveBuffer.GetBufferedByteCount() > 0; }
+	bool	IsAwaitingDatagramConfirmation() const { return m_Datagrams.AwaitingConfirmation; }
 
 	bool	SetBlockingMode(bool shouldBlock);
 	bool	SetNoDelay(bool noDelayOn);
 
-	static uint32_t ConnectionTimeout;
+	static uint32_t ConnectionTimeout; // Seconds that a connection attempt may take
 
 private:
-	struct MessageAndSize
+	struct DatagramEndpoint
 	{
-		MessageAndSize(MUtility::Byte* message, MessageSize messageSize) : Message(message), MessageSize(messageSize) {}
+		DatagramChannel*						Channel					= nullptr;
+		Tubes::ConnectionID						ID						= TUBES_INVALID_CONNECTION_ID;
+		uint64_t								Token					= 0; // 0 until the accepting side has handed out a token
+		Socket									SendSocket				= INVALID_SOCKET;
+		sockaddr_in								PeerAddress;
+		bool									Reachable				= false; // The address of the peer is known
+		bool									AwaitingConfirmation	= false; // The connecting side sends hellos until the accepting side confirms that it has received one
+		uint32_t								HellosSent				= 0;
+		std::chrono::steady_clock::time_point	NextHelloTime;
+		uint32_t								NextSequence			= 1; // 0 is reserved for datagrams that aren't sequenced
+		uint32_t								LastReceivedSequence	= 0;
+	};
 
-		MUtility::Byte* Message;
-		MessageSize MessageSize;
+	struct InflatedBatch // Decompressed frames that are handed out one at a time before anything more is read from the receive buffer
+	{
+		MUtility::Byte*	Data		= nullptr; // malloc'ed so that it can be retired into the receive buffer while views point into it
+		int32_t			Capacity	= 0;
+		int32_t			Size		= 0;
+		int32_t			ReadOffset	= 0;
+		bool			Kept		= false; // Frames were handed out as views
 	};
 
-	SendResult SendSerializedMessage(MUtility::Byte* serializedMessage, MessageSize messageSize);
+	int64_t			SendBuffers(SendBufferDescriptor* descriptors, int32_t descriptorCount);
+	SendResult		SendUnsentMessages();
+	void			ClearUnsentMessages();
+	bool			MakeRoomInSendQueue(int64_t byteCount, Tubes::MessagePriority priority, SendResult& outFailureResult); // Applies Settings::SendQueuePolicy if the message doesn't fit below the high watermark
+	void			UpdateBackpressure();
+	void			ScheduleMessages(bool ignoreWindow); // Moves messages from the scheduler to the back of m_UnsentMessages. ignoreWindow moves everything, regardless of the send window and bandwidth budget
+	ReceiveResult	ReceiveFrame(bool keepFrame, const MUtility::Byte*& outFrame, int32_t& outWireSize); // Buffers until a full message is available at the read offset. outFrame always has a standard header while outWireSize is the number of buffered bytes the frame occupies. keepFrame makes outFrame stay valid until ReleaseViews is called
+	ReceiveResult	ReadFrame(const MUtility::Byte*& outFrame, int32_t& outWireSize);
+	ReceiveResult	TakeInflatedFrame(bool keepFrame, const MUtility::Byte*& outFrame, int32_t& outWireSize);
+	bool			Inflate(ReadCursor& reader);
+	void			CompressUnsentMessages(std::deque<UnsentMessage>& queue, size_t& firstUnscanned);
+	SerializedMessage*	CompressMessages(const std::deque<UnsentMessage>& queue, size_t first, size_t end, int64_t byteCount); // Returns nullptr if compression didn't make the messages smaller
+	ReceiveResult	FillReceiveBuffer();
+	bool			ContainsFullFrame(int32_t& outFrameSize) const;
+	bool			ExpandCompactFrame(int32_t frameSize, const MUtility::Byte*& outFrame);
+	bool			HandleControlFrame(const MUtility::Byte* frame, bool keepFrame, const MUtility::Byte*& outMessageFrame); // Returns true if the control frame carried a message for the caller
+	bool			HandleDeltaFrame(ReadCursor& reader, bool keepFrame, const MUtility::Byte*& outMessageFrame);
+	void			SendCapabilities(uint8_t offeredCapabilities, uint8_t activeCapabilities);
+	void			SendControlFrame(ConnectionControlType type, const MUtility::Byte* payload, int32_t payloadSize);
+	void			SendDatagramHello();
+	void			DetachDatagramChannel();
+	uint8_t			GetLocalCapabilities() const;
+	void			ReadLocalPort();
 
 	Socket						m_Socket;
+	ReceiveBuffer				m_ReceiveBuffer;
+	SendScheduler				m_Scheduler; // Messages waiting for their turn
+	std::deque<UnsentMessage>	m_UnsentMessages; // Scheduled messages in the order they are written to the socket. Kept short so that urgent messages don't wait behind a long backlog
+	int64_t						m_UnsentByteCount = 0; // Wire size of the scheduled messages
+	int32_t						m_UnsentHeadOffset = 0; // How many bytes of the first unsent message that have already been sent
+	uint32_t					m_HighWatermark;
+	uint32_t					m_LowWatermark;
+	bool						m_Backpressured = false;
+	bool						m_HoldingMessages = false; // Messages are being coalesced and nothing is written until the next flush
+	bool						m_SendCompact = false;
+	bool						m_ReceiveCompact = false;
+	bool						m_CapabilitiesActivated = false;
+	bool						m_SendDeltas = false;
+	bool						m_SendCompressed = false;
+	bool						m_ReadingInflatedFrame = false;
+	InflatedBatch				m_InflatedBatch;
+	std::vector<MUtility::Byte>	m_CompressionScratch;
+	DeltaEncoder				m_DeltaEncoder;
+	DeltaDecoder				m_DeltaDecoder;
+	DatagramEndpoint			m_Datagrams;
+
+	// Cold. Kept last so that the state used when sending and receiving shares as few cache lines as possible
 	Address						m_Address;
 	Port						m_Port;
+	Port						m_LocalPort = 0; // Connections from one peer address and port to different local ports are different connections
 	ConnectionType				m_ConnectionType = ConnectionType::Invalid;
 	struct sockaddr_in			m_Sockaddr;
-	ReceiveBuffer				m_ReceiveBuffer;
-	std::queue<MessageAndSize>	m_UnsentMessages;
 };
\ No newline at end of file
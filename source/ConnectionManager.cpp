@@ -2,15 +2,19 @@
 #include "Interface/Messaging/MessagingTypes.h"
 #include "Interface/TubesSettings.h"
 #include "Interface/TubesTypes.h"
+#include "Interface/messaging/MessageAllocator.h"
 #include "Connection.h"
 #include "Listener.h"
 #include "TubesErrors.h"
+#include "SerializedMessage.h"
+#include "TubesMessageBase.h"
 #include "TubesMessageReplicator.h"
 #include "TubesMessages.h"
 #include "TubesUtility.h"
 #include <MUtilityLog.h>
-#include <MUtilityThreading.h>
+#include <algorithm>
 #include <cassert>
+#include <stdlib.h>
 #include <thread>
 
 #if PLATFORM != PLATFORM_WINDOWS
@@ -22,239 +26,463 @@
 
 using namespace Tubes;
 using namespace TubesUtility;
+using MUtility::Byte;
+
+static SendResult SendWithDeliveryMode(Connection* connection, SerializedMessage* message, DeliveryMode deliveryMode, MessagePriority priority)
+{
+	return deliveryMode == DeliveryMode::RELIABLE_ORDERED ? connection->SendSerializedMessage(message, priority) : connection->SendDatagram(message, deliveryMode == DeliveryMode::UNRELIABLE_SEQUENCED);
+}
+
+static uint64_t PackEndpoint(const Connection* connection)
+{
+	return (static_cast<uint64_t>(connection->GetAddress()) << 32) | (static_cast<uint64_t>(connection->GetPort()) << 16) | connection->GetLocalPort();
+}
 
 // ---------- PUBLIC ----------
 
-ConnectionManager::ConnectionManager()
+ConnectionManager::ConnectionManager(uint32_t shardCount)
 {
-	m_RunConnectionThread = true;
-	m_ConnectionThread = std::thread(&ConnectionManager::ProcessConnectionRequests, this);
+	m_ShardCount	= shardCount > 0 ? shardCount : 1;
+	m_Shards		= new ConnectionShard[m_ShardCount];
+	uint32_t shardIndexBits = 0;
+	while ((1u << shardIndexBits) < m_ShardCount)
+	{
+		++shardIndexBits;
+	}
+	m_ShardIndexMask = (1u << shardIndexBits) - 1;
+	for (uint32_t i = 0; i < m_ShardCount; ++i)
+	{
+		m_Shards[i].Connections.SetSlotLayout(i, shardIndexBits); // The low bits of the slot index of an ID tell which shard the connection belongs to
+	}
+
+	if (Settings::UseDatagramChannel)
+		m_DatagramChannel.Open(TUBES_PORT_ANY);
 }
 
 ConnectionManager::~ConnectionManager()
 {
-	// Stop the connection thread
-	m_RunConnectionThread = false;
-	m_ConnectionAttemptLockCondition.notify_one();
-	MUtilityThreading::JoinThread(m_ConnectionThread);
-
-	m_RequestedConnections.Clear();
+	for (auto& idAndAttempt : m_ConnectionAttempts)
+	{
+		Socket attemptSocket = idAndAttempt.second.PendingConnection->GetSocket();
+		m_ConnectionAttemptPoller.Remove(attemptSocket);
+		CloseSocket(attemptSocket);
+		delete idAndAttempt.second.PendingConnection;
+	}
+	m_ConnectionAttempts.clear();
 
 	DisconnectAll();
+	ReleaseViews();
+	m_DatagramChannel.CloseAll();
+	delete[] m_Shards;
 }
 
-void ConnectionManager::VerifyNewConnections(TubesMessageReplicator& replicator)
+void ConnectionManager::AcceptConnections()
 {
-	std::vector<std::pair<Connection*, ConnectionState>> newConnections;
-	for (const auto& portAndListener : m_ListenerMap)
+	for (uint32_t i = 0; i < m_ShardCount; ++i)
 	{
-		portAndListener.second->FetchAcceptedConnections(newConnections);
+		AcceptConnections(i);
 	}
+}
 
-	if (!Settings::AllowDuplicateConnections)
+void ConnectionManager::AcceptConnections(uint32_t shardIndex)
+{
+	ConnectionShard& shard = m_Shards[shardIndex];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	for (int i = 0; i < shard.Listeners.size(); ++i)
+	{
+		shard.Listeners[i]->Accept(shardIndex);
+	}
+}
+
+void ConnectionManager::UpdateConnectionAttempts()
+{
+	if (!m_ConnectionAttempts.empty())
 	{
-		// Make sure that the new connection doesn't already exist
-		for (int i = 0; i < newConnections.size(); ++i)
+		m_CompletedConnectionAttemptIDs.clear();
+		m_ConnectionAttemptPoller.Poll(m_CompletedConnectionAttemptIDs);
+		for (int i = 0; i < m_CompletedConnectionAttemptIDs.size(); ++i)
 		{
-			bool duplicate = false;
-			Connection*& newConnection = newConnections[i].first;
-			for (int j = 0; j < m_UnverifiedConnections.size(); ++j)
-			{
-				const Connection* existingConnection = m_UnverifiedConnections[j].first;
-				if (newConnection->GetAddress() == existingConnection->GetAddress() && newConnection->GetPort() == existingConnection->GetPort())
-				{
-					duplicate = true;
-					break;
-				}
-			}
+			auto idAndAttempt = m_ConnectionAttempts.find(m_CompletedConnectionAttemptIDs[i]);
+			if (idAndAttempt == m_ConnectionAttempts.end())
+				continue;
 
-			if (!duplicate)
-			{
-				for (const auto& idAndConnection : m_Connections)
-				{
-					const Connection* existingConnection = idAndConnection.second;
-					if (newConnection->GetAddress() == existingConnection->GetAddress() && newConnection->GetPort() == existingConnection->GetPort())
-					{
-						duplicate = true;
-						break;
-					}
-				}
-			}
+			Connection* connection = idAndAttempt->second.PendingConnection;
+			m_ConnectionAttemptPoller.Remove(connection->GetSocket());
+			m_ConnectionAttempts.erase(idAndAttempt);
+			FinishConnectionAttempt(connection, connection->FinishConnect() == ConnectResult::Connected ? ConnectionAttemptResult::SUCCESS_OUTGOING : ConnectionAttemptResult::FAILED_INTERNAL_ERROR);
+		}
 
-			if (duplicate)
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		for (auto idAndAttempt = m_ConnectionAttempts.begin(); idAndAttempt != m_ConnectionAttempts.end();)
+		{
+			if (now >= idAndAttempt->second.Deadline)
 			{
-				MLOG_WARNING("An incoming connection with destination " << TubesUtility::AddressToIPv4String(newConnection->GetAddress()) << " was diesconnected since an identical connection already existed", LOG_CATEGORY_CONNECTION_MANAGER);
-				newConnection->Disconnect();
-				delete newConnection;
-				newConnection = nullptr;
+				Connection* connection = idAndAttempt->second.PendingConnection;
+				m_ConnectionAttemptPoller.Remove(connection->GetSocket());
+				idAndAttempt = m_ConnectionAttempts.erase(idAndAttempt);
+				FinishConnectionAttempt(connection, ConnectionAttemptResult::FAILED_TIMEOUT);
 			}
 			else
-				m_UnverifiedConnections.push_back(newConnections[i]);
+				++idAndAttempt;
 		}
 	}
 
-	for ( int i = 0; i < m_UnverifiedConnections.size(); ++i )
+	for (int i = 0; i < m_FailedConnectionAttempts.size(); ++i)
 	{
-		std::unordered_map<ReplicatorID, MessageReplicator*> replicatorMap; // TODODB: Create overload of Receive() that takes only a single replicator
-		replicatorMap.emplace(replicator.GetID(), &replicator);
+		TriggerConnectionCallbacks(m_FailedConnectionAttempts[i]);
+	}
+	m_FailedConnectionAttempts.clear();
+}
 
-		Connection*& connection = m_UnverifiedConnections[i].first;
+void ConnectionManager::VerifyNewConnections(TubesMessageReplicator& replicator)
+{
+	m_NewConnections.clear();
+	for (const auto& portAndListener : m_ListenerMap)
+	{
+		portAndListener.second->FetchAcceptedConnections(m_NewConnections);
+	}
 
-		SendResult sendResult = connection->SendQueuedMessages();
-		if (sendResult == SendResult::Disconnect)
+	for (int i = 0; i < m_NewConnections.size(); ++i)
+	{
+		Connection* newConnection = m_NewConnections[i].first;
+		if (!AddConnectionEndpoint(newConnection, !Settings::AllowDuplicateConnections)) // Make sure that the new connection doesn't already exist
 		{
-			connection->Disconnect();
-			delete connection;
-			m_UnverifiedConnections.erase(m_UnverifiedConnections.begin() + i);
-			--i;
+			MLOG_WARNING("An incoming connection with destination " << TubesUtility::AddressToIPv4String(newConnection->GetAddress()) << " was diesconnected since an identical connection already existed", LOG_CATEGORY_CONNECTION_MANAGER);
+			newConnection->Disconnect();
+			delete newConnection;
 		}
+		else
+			m_UnverifiedConnections.push_back(m_NewConnections[i]);
+	}
 
-		// Perform verification
-		switch (m_UnverifiedConnections[i].second)
-		{
-			case ConnectionState::NewIncoming: // TODODB: Implement logic for checking so that the remote client really is a tubes client
-			{
-				ConnectionID connectionID = m_NextConnectionID++;
-				ConnectionIDMessage idMessage = ConnectionIDMessage(connectionID);
-				SendResult result = connection->SerializeAndSendMessage(idMessage, replicator);
-				switch (result)
-				{
-				case SendResult::Disconnect:
-				{
-					connection->Disconnect();
-					delete connection;
-					m_UnverifiedConnections.erase(m_UnverifiedConnections.begin() + i);
-					--i;
-				} break;
+	std::unordered_map<ReplicatorID, MessageReplicator*> replicatorMap; // TODODB: Create overload of Receive() that takes only a single replicator
+	replicatorMap.emplace(replicator.GetID(), &replicator);
 
-				case SendResult::Sent:
-				case SendResult::Queued:
-				case SendResult::Error:
-				default:
-					break;
-				}
+	// Connections that are still unverified are moved towards the front so that the list is compacted in a single pass. The callbacks may request new connections, which are appended and handled by the same pass
+	int keptCount = 0;
+	for (int i = 0; i < m_UnverifiedConnections.size(); ++i)
+	{
+		std::pair<Connection*, ConnectionState> connectionAndState = m_UnverifiedConnections[i];
+		if (!VerifyConnection(connectionAndState.first, connectionAndState.second, replicator, replicatorMap))
+			m_UnverifiedConnections[keptCount++] = connectionAndState;
+	}
+	m_UnverifiedConnections.resize(keptCount);
+}
 
-				m_Connections.emplace(connectionID, connection);
-				m_UnverifiedConnections.erase(m_UnverifiedConnections.begin() + i--);
+void ConnectionManager::SendToConnection(SerializedMessage* message, ConnectionID destinationID, DeliveryMode deliveryMode, MessagePriority priority)
+{
+	SendToConnection(message, destinationID, deliveryMode, priority, nullptr);
+}
 
-				MLOG_INFO("An incoming connection with destination " + TubesUtility::AddressToIPv4String(m_Connections.at(connectionID)->GetAddress()) + " was accepted", LOG_CATEGORY_CONNECTION_MANAGER);
-				ConnectionAttemptResultData connectionResult = ConnectionAttemptResultData(ConnectionAttemptResult::SUCCESS_INCOMING, AddressToIPv4String(connection->GetAddress()), connection->GetPort(), connectionID);
-				m_ConnectionCallbacks.TriggerCallbacks(connectionResult);
-			} break;
+void ConnectionManager::SendDeltaToConnection(SerializedMessage* message, ConnectionID destinationID, DeltaKey key)
+{
+	SendToConnection(message, destinationID, DeliveryMode::RELIABLE_ORDERED, MessagePriority::NORMAL, &key);
+}
 
-			case ConnectionState::NewOutgoing:
-			{
-				Message* message = nullptr;
-				ReceiveResult result;
-				result = connection->Receive(replicatorMap, message);
-				switch(result)
-				{
-					case ReceiveResult::Fullmessage:
-					{
-						if (message->Type == TubesMessages::CONNECTION_ID)
-						{
-							ConnectionIDMessage* idMessage = static_cast<ConnectionIDMessage*>(message);
+void ConnectionManager::SendToAll(SerializedMessage* message, ConnectionID exception, DeliveryMode deliveryMode, MessagePriority priority)
+{
+#if TUBES_DEBUG == 1
+	if (exception != TUBES_INVALID_CONNECTION_ID && !IsConnectionIDValid(exception))
+		MLOG_WARNING("The excepted connectionID supplied to SendToAll does not exist", LOG_CATEGORY_CONNECTION_MANAGER);
+#endif
 
-							m_Connections.emplace(idMessage->ID, connection);
-							m_UnverifiedConnections.erase(m_UnverifiedConnections.begin() + i--);
+	for (uint32_t i = 0; i < m_ShardCount; ++i)
+	{
+		SendToShard(i, message, exception, deliveryMode, priority);
+	}
+}
 
-							MLOG_INFO("An outgoing connection with destination " + TubesUtility::AddressToIPv4String( m_Connections.at(idMessage->ID)->GetAddress()) + " was accepted", LOG_CATEGORY_CONNECTION_MANAGER);
-							ConnectionAttemptResultData connectionResult = ConnectionAttemptResultData(ConnectionAttemptResult::SUCCESS_OUTGOING, AddressToIPv4String(connection->GetAddress()), connection->GetPort(), idMessage->ID);
-							m_ConnectionCallbacks.TriggerCallbacks(connectionResult);
-							free(message);
-						}
-						else
-						{
-							MLOG_WARNING("Received an unexpected message type while verifying socket; message type = " << message->Type, LOG_CATEGORY_CONNECTION_MANAGER);
-							free(message);
-						}
+void ConnectionManager::SendToShard(uint32_t shardIndex, SerializedMessage* message, ConnectionID exception, DeliveryMode deliveryMode, MessagePriority priority)
+{
+	ConnectionShard& shard = m_Shards[shardIndex];
+	std::vector<std::pair<ConnectionID, DisconnectionType>> toDisconnect; // TODODB: Find a better way to disconnect connections while iterating over the connection map
+	{
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		for (uint32_t i = 0; i < shard.Connections.GetCount(); ++i)
+		{
+			ConnectionID ID = shard.Connections.GetIDAt(i);
+			if (ID != exception)
+			{	
+				SendResult result = SendWithDeliveryMode(shard.Connections.GetConnectionAt(i), message, deliveryMode, priority);
+				shard.Connections.UpdateSendStateAt(i);
+				switch (result)
+				{
+					case SendResult::Disconnect:
+					{
+						toDisconnect.push_back(std::make_pair(ID, DisconnectionType::REMOTE_FORCEFUL)); // TODODB: Update the disconnectiontype when we actually know if it was forceful or not
 					} break;
 
-					case ReceiveResult::GracefulDisconnect:
-					case ReceiveResult::ForcefulDisconnect:
+					case SendResult::SlowConsumer:
 					{
-						MLOG_INFO("An unverified outgoing connection with destination " + TubesUtility::AddressToIPv4String(connection->GetAddress()) + " was disconnected during handshake", LOG_CATEGORY_CONNECTION_MANAGER);
-
-						connection->Disconnect();
-						delete connection;
-						m_UnverifiedConnections.erase(m_UnverifiedConnections.begin() + i--);
+						toDisconnect.push_back(std::make_pair(ID, DisconnectionType::LOCAL));
 					} break;
 
-					case ReceiveResult::Empty:
-					case ReceiveResult::PartialMessage:
-					case ReceiveResult::Error:
+					case SendResult::Sent:
+					case SendResult::Queued:
+					case SendResult::Backpressure:
+					case SendResult::Dropped:
+					case SendResult::Error:
 					default:
 						break;
-				} 
-			} break;
+				}
+			}
+		}
+	}
 
-			default:
-				assert( false && "TUBES: A connection is in an unhandled connection state" );
-			break;
+	for (int i = 0; i < toDisconnect.size(); ++i)
+	{
+		Disconnect(toDisconnect[i].second, toDisconnect[i].first);
+	}
+}
+
+void ConnectionManager::SendQueuedMessages(bool flushHeldMessages)
+{
+	for (uint32_t i = 0; i < m_ShardCount; ++i)
+	{
+		SendQueuedMessages(i, flushHeldMessages);
+	}
+}
+
+void ConnectionManager::SendQueuedMessages(uint32_t shardIndex, bool flushHeldMessages)
+{
+	ConnectionShard& shard = m_Shards[shardIndex];
+	std::vector<ConnectionID> toDisconnect;
+	{
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		for (uint32_t i = 0; i < shard.Connections.GetCount(); ++i)
+		{
+			if (!shard.Connections.IsSendPendingAt(i)) // Don't touch idle connections, not even their Connection objects
+				continue;
+
+			Connection* connection = shard.Connections.GetConnectionAt(i);
+			SendResult sendResult = flushHeldMessages ? connection->Flush() : connection->SendQueuedMessages();
+			shard.Connections.UpdateSendStateAt(i);
+			if (sendResult == SendResult::Disconnect)
+				toDisconnect.push_back(shard.Connections.GetIDAt(i));
 		}
 	}
+
+	for (int i = 0; i < toDisconnect.size(); ++i)
+	{
+		Disconnect(DisconnectionType::REMOTE_FORCEFUL, toDisconnect[i]); // TODODB: Update the disconnectionType here when we actually know if it was forceful or not
+	}
+}
+
+void ConnectionManager::Flush(ConnectionID ID)
+{
+	SendResult result = SendResult::Sent;
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	{
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		Connection* connection = shard.Connections.Find(ID);
+		if (connection == nullptr)
+		{
+			MLOG_WARNING("Failed to find requested connection while flushing (Requested ID = " << ID << " )", LOG_CATEGORY_CONNECTION_MANAGER);
+			return;
+		}
+
+		result = connection->Flush();
+		shard.Connections.UpdateSendState(ID);
+	}
+
+	if (result == SendResult::Disconnect)
+		Disconnect(DisconnectionType::REMOTE_FORCEFUL, ID); // TODODB: Update the disconnectionType here when we actually know if it was forceful or not
+}
+
+void ConnectionManager::ReceiveMessages(const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>& outMessages, std::vector<ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages)
+{
+	for (uint32_t i = 0; i < m_ShardCount; ++i)
+	{
+		ReceiveMessages(i, replicators, outMessages, outSenderIDs, outTubesMessages);
+	}
 }
 
-void ConnectionManager::HandleFailedConnectionAttempts()
+void ConnectionManager::ReceiveMessages(uint32_t shardIndex, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>& outMessages, std::vector<ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages)
 {
-	ConnectionAttemptResultData result;
-	while (FailedConnectionAttemptsQueue.Consume(result))
+	ReceiveFromShard(shardIndex, replicators, &outMessages, nullptr, outSenderIDs, outTubesMessages);
+	if (shardIndex == 0)
+		ReceiveDatagrams(replicators, &outMessages, nullptr, outSenderIDs, outTubesMessages);
+}
+
+void ConnectionManager::ReceiveViews(const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<MessageView>& outViews, std::vector<ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages)
+{
+	ReleaseViews();
+	for (uint32_t i = 0; i < m_ShardCount; ++i)
 	{
-		m_ConnectionCallbacks.TriggerCallbacks(result);
+		ReceiveFromShard(i, replicators, nullptr, &outViews, outSenderIDs, outTubesMessages);
+	}
+	ReceiveDatagrams(replicators, nullptr, &outViews, outSenderIDs, outTubesMessages);
+}
+
+void ConnectionManager::ReleaseViews()
+{
+	for (int i = 0; i < m_ConnectionsWithViews.size(); ++i)
+	{
+		ConnectionShard& shard = m_Shards[GetShardIndex(m_ConnectionsWithViews[i])];
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		Connection* connection = shard.Connections.Find(m_ConnectionsWithViews[i]);
+		if (connection != nullptr) // Disconnected connections took their buffers with them
+			connection->ReleaseViews();
+	}
+	m_ConnectionsWithViews.clear();
+
+	for (int i = 0; i < m_RetiredViewData.size(); ++i)
+	{
+		free(m_RetiredViewData[i]);
+	}
+	m_RetiredViewData.clear();
+}
+
+
+void ConnectionManager::ReceiveFromShard(uint32_t shardIndex, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>* outMessages, std::vector<MessageView>* outViews, std::vector<ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages)
+{
+	ConnectionShard& shard = m_Shards[shardIndex];
+	std::vector<std::pair<ConnectionID, DisconnectionType>> toDisconnect; // TODODB: Find a better way to disconnect connections while iterating over the connection map
+	{
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		if (Settings::UseReadinessPolling)
+		{
+			std::vector<ConnectionID> readableIDs;
+			GetReadableConnections(shard, readableIDs);
+			for (int i = 0; i < readableIDs.size(); ++i)
+			{
+				Connection* connection = shard.Connections.Find(readableIDs[i]);
+				if (connection != nullptr)
+				{
+					ReceiveResult result = ReceiveFromConnection(readableIDs[i], connection, replicators, outMessages, outViews, outSenderIDs, outTubesMessages, toDisconnect);
+					shard.Connections.UpdateSendState(readableIDs[i]); // Control frames may have been answered
+					if (result == ReceiveResult::Error && connection->HasReceivedData()) // The poller only reports new data so revisit the messages behind the failed one on the next call
+						shard.ConnectionsWithBufferedData.push_back(readableIDs[i]);
+				}
+			}
+		}
+		else
+		{
+			for (uint32_t i = 0; i < shard.Connections.GetCount(); ++i)
+			{
+				ReceiveFromConnection(shard.Connections.GetIDAt(i), shard.Connections.GetConnectionAt(i), replicators, outMessages, outViews, outSenderIDs, outTubesMessages, toDisconnect);
+				shard.Connections.UpdateSendStateAt(i); // Control frames may have been answered
+			}
+		}
+	}
+
+	for (int i = 0; i < toDisconnect.size(); ++i)
+	{
+		Disconnect(toDisconnect[i].second, toDisconnect[i].first);
 	}
 }
 
 void ConnectionManager::RequestConnection(const std::string& address, Port port)
 {
-	m_RequestedConnections.Produce(ConnectionAttemptData(address, port));
-	m_ConnectionAttemptLockCondition.notify_one();
+	// Set up the socket
+	Socket connectionSocket = static_cast<Socket>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)); // Address Family = INET and the protocol to be used is TCP
+	if (connectionSocket <= 0)
+	{
+		LogAPIErrorMessage("Failed to create socket", LOG_CATEGORY_CONNECTION_MANAGER);
+		m_FailedConnectionAttempts.push_back(ConnectionAttemptResultData(ConnectionAttemptResult::FAILED_INTERNAL_ERROR, address, port));
+		return;
+	}
+
+	Connection* connection = new Connection(connectionSocket, address, port);
+	connection->SetBlockingMode(false);
+	switch (connection->BeginConnect())
+	{
+		case ConnectResult::Connected:
+		{
+			FinishConnectionAttempt(connection, ConnectionAttemptResult::SUCCESS_OUTGOING);
+		} break;
+
+		case ConnectResult::InProgress:
+		{
+			ConnectionID attemptID = m_NextConnectionAttemptID++;
+			if (!m_ConnectionAttemptPoller.Add(connectionSocket, attemptID, true))
+			{
+				FinishConnectionAttempt(connection, ConnectionAttemptResult::FAILED_INTERNAL_ERROR);
+				break;
+			}
+			m_ConnectionAttempts.emplace(attemptID, ConnectionAttempt(connection, std::chrono::steady_clock::now() + std::chrono::seconds(Connection::ConnectionTimeout)));
+		} break;
+
+		case ConnectResult::Failed:
+		default:
+			FinishConnectionAttempt(connection, ConnectionAttemptResult::FAILED_INTERNAL_ERROR);
+			break;
+	}
 }
 
 void ConnectionManager::Disconnect(DisconnectionType type, ConnectionID connectionID) // TODODB: Return boolean result
 {
-	auto& connectionIterator = m_Connections.find(connectionID);
-	if (connectionIterator != m_Connections.end())
+	Connection* connection = nullptr;
+	ConnectionShard& shard = m_Shards[GetShardIndex(connectionID)];
+	{
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		connection = shard.Connections.Find(connectionID);
+		if (connection != nullptr)
+		{
+			shard.Poller.Remove(connection->GetSocket());
+			shard.Connections.Remove(connectionID);
+		}
+	}
+
+	if (connection != nullptr)
 	{
-		Connection* connection = m_Connections.at(connectionID);
+		RemoveConnectionEndpoint(connection);
 		connection->Disconnect();
 		MLOG_INFO("A connection with destination " + TubesUtility::AddressToIPv4String(connection->GetAddress()) + " has been disconnected; disconnection type = " + DisonnectionTypeToString(type), LOG_CATEGORY_CONNECTION_MANAGER);
 
 		DisconnectionData disconnectionData = DisconnectionData(type, AddressToIPv4String(connection->GetAddress()), connection->GetPort(), connectionID);
-
+		if (!m_ConnectionsWithViews.empty()) // Only ever filled on the application thread since views aren't available with network threads
+			connection->HandOverViewedData(m_RetiredViewData);
 		delete connection;
-		m_Connections.erase(connectionIterator);
 
-		m_DisconnectionCallbacks.TriggerCallbacks(disconnectionData);
+		TriggerDisconnectionCallbacks(disconnectionData);
 	}
 	else
-		MLOG_WARNING("Attempted to disconnect socket with id: " << connectionID + " but no socket with that ID was found", LOG_CATEGORY_CONNECTION_MANAGER);
+		MLOG_WARNING("Attempted to disconnect socket with id: " << connectionID << " but no socket with that ID was found", LOG_CATEGORY_CONNECTION_MANAGER);
 }
 
 void ConnectionManager::DisconnectAll()
 {
-	for (auto& connectionAndState = m_UnverifiedConnections.cbegin(); connectionAndState != m_UnverifiedConnections.cend();)
+	for (int i = 0; i < m_UnverifiedConnections.size(); ++i)
 	{
-		connectionAndState->first->Disconnect();
-		MLOG_INFO("An unverified connection with destination " + TubesUtility::AddressToIPv4String( connectionAndState->first->GetAddress()) + " has been disconnected", LOG_CATEGORY_CONNECTION_MANAGER);
+		Connection* connection = m_UnverifiedConnections[i].first;
+		RemoveConnectionEndpoint(connection);
+		connection->Disconnect();
+		MLOG_INFO("An unverified connection with destination " + TubesUtility::AddressToIPv4String(connection->GetAddress()) + " has been disconnected", LOG_CATEGORY_CONNECTION_MANAGER);
 
-		delete connectionAndState->first;
+		delete connection;
 	}
 	m_UnverifiedConnections.clear();
 
-	auto& idAndConnection = m_Connections.cbegin();
-	while (idAndConnection != m_Connections.cend())
+	for (uint32_t shardIndex = 0; shardIndex < m_ShardCount; ++shardIndex)
 	{
-		DisconnectionData disconnectionData = DisconnectionData(DisconnectionType::LOCAL, AddressToIPv4String(idAndConnection->second->GetAddress()), idAndConnection->second->GetPort(), idAndConnection->first);
+		ConnectionShard& shard = m_Shards[shardIndex];
+		std::vector<std::pair<ConnectionID, Connection*>> connections;
+		{
+			std::lock_guard<std::mutex> lock(shard.Lock);
+			for (uint32_t i = 0; i < shard.Connections.GetCount(); ++i)
+			{
+				shard.Poller.Remove(shard.Connections.GetConnectionAt(i)->GetSocket());
+				connections.push_back(std::make_pair(shard.Connections.GetIDAt(i), shard.Connections.GetConnectionAt(i)));
+			}
+			shard.Connections.Clear();
+			shard.ConnectionsWithBufferedData.clear();
+		}
 
-		idAndConnection->second->Disconnect();
-		MLOG_INFO("A connection with destination " + TubesUtility::AddressToIPv4String(idAndConnection->second->GetAddress()) + " has been disconnected; disconnection type = " + DisonnectionTypeToString(DisconnectionType::LOCAL), LOG_CATEGORY_CONNECTION_MANAGER);
+		for (auto& idAndConnection : connections)
+		{
+			DisconnectionData disconnectionData = DisconnectionData(DisconnectionType::LOCAL, AddressToIPv4String(idAndConnection.second->GetAddress()), idAndConnection.second->GetPort(), idAndConnection.first);
 
-		delete idAndConnection->second;
-		m_Connections.erase(idAndConnection++);
+			RemoveConnectionEndpoint(idAndConnection.second);
+			idAndConnection.second->Disconnect();
+			MLOG_INFO("A connection with destination " + TubesUtility::AddressToIPv4String(idAndConnection.second->GetAddress()) + " has been disconnected; disconnection type = " + DisonnectionTypeToString(DisconnectionType::LOCAL), LOG_CATEGORY_CONNECTION_MANAGER);
 
-		m_DisconnectionCallbacks.TriggerCallbacks(disconnectionData);
+			if (!m_ConnectionsWithViews.empty())
+				idAndConnection.second->HandOverViewedData(m_RetiredViewData);
+			delete idAndConnection.second;
+			TriggerDisconnectionCallbacks(disconnectionData);
+		}
 	}
-	m_Connections.clear();
 }
 
 bool ConnectionManager::StartListener(Port port)
@@ -269,9 +497,21 @@ bool ConnectionManager::StartListener(Port port)
 	}
 
 	Listener* listener = new Listener;
-	bool result = listener->StartListening(port);
+	bool result = listener->StartListening(port, Settings::UseReusePortListeners ? m_ShardCount : 1);
 	if (result)
+	{
 		m_ListenerMap.emplace(port, listener);
+		for (uint32_t i = 0; i < listener->GetSocketCount(); ++i)
+		{
+			std::lock_guard<std::mutex> lock(m_Shards[i].Lock);
+			m_Shards[i].Listeners.push_back(listener);
+		}
+
+		if (Settings::UseDatagramChannel && !m_DatagramChannel.Open(port))
+			MLOG_WARNING("Failed to open a datagram socket on port " << port << "; unreliable messages will be sent over the stream", LOG_CATEGORY_CONNECTION_MANAGER);
+	}
+	else
+		delete listener;
 
 	return result;
 }
@@ -282,6 +522,13 @@ bool ConnectionManager::StopListener(Port port)
 	auto portAndListener = m_ListenerMap.find(port);
 	if (portAndListener != m_ListenerMap.end())
 	{
+		for (uint32_t i = 0; i < portAndListener->second->GetSocketCount(); ++i)
+		{
+			std::lock_guard<std::mutex> lock(m_Shards[i].Lock); // Waits for the shard to finish accepting
+			std::vector<Listener*>& shardListeners = m_Shards[i].Listeners;
+			shardListeners.erase(std::remove(shardListeners.begin(), shardListeners.end(), portAndListener->second), shardListeners.end());
+		}
+
 		portAndListener->second->StopListening();
 		delete portAndListener->second;
 		m_ListenerMap.erase(portAndListener);
@@ -338,83 +585,470 @@ void ConnectionManager::CallDisconnectionCallback(const Tubes::DisconnectionData
 	m_DisconnectionCallbacks.TriggerCallbacks(disconnectionData);
 }
 
+void ConnectionManager::SetCallbackDeferral(bool deferCallbacks)
+{
+	m_DeferCallbacks = deferCallbacks;
+}
+
+void ConnectionManager::DispatchDeferredCallbacks()
+{
+	ConnectionAttemptResultData connectionResult;
+	while (m_DeferredConnectionResults.Consume(connectionResult))
+	{
+		m_ConnectionCallbacks.TriggerCallbacks(connectionResult);
+	}
+
+	DisconnectionData disconnectionData;
+	while (m_DeferredDisconnections.Consume(disconnectionData))
+	{
+		m_DisconnectionCallbacks.TriggerCallbacks(disconnectionData);
+	}
+}
+
 // ---------- PRIVATE ----------
 
-void ConnectionManager::ProcessConnectionRequests()
+bool ConnectionManager::VerifyConnection(Connection* connection, ConnectionState state, TubesMessageReplicator& replicator, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicatorMap)
 {
-	m_ConnectionAttemptLock = std::unique_lock<std::mutex>(m_ConnectionAttemptLockMutex);
-	ConnectionAttemptData connectionData;
-	while (m_RunConnectionThread)
+	if (connection->SendQueuedMessages() == SendResult::Disconnect)
+	{
+		DropUnverifiedConnection(connection);
+		return true;
+	}
+
+	switch (state)
 	{
-		if (m_RequestedConnections.Consume(connectionData))
+		case ConnectionState::NewIncoming: // TODODB: Implement logic for checking so that the remote client really is a tubes client
 		{
-			Connect(connectionData.Address, connectionData.Port);
+			ConnectionID connectionID = ReserveConnectionID();
+			if (connectionID == TUBES_INVALID_CONNECTION_ID)
+			{
+				MLOG_WARNING("An incoming connection with destination " << TubesUtility::AddressToIPv4String(connection->GetAddress()) << " was disconnected since the maximum number of connections has been reached", LOG_CATEGORY_CONNECTION_MANAGER);
+				DropUnverifiedConnection(connection);
+				return true;
+			}
+
+			ConnectionIDMessage idMessage = ConnectionIDMessage(connectionID);
+			if (connection->SerializeAndSendMessage(idMessage, replicator, MessagePriority::CRITICAL) == SendResult::Disconnect) // Stays ahead of the control frames, which are CRITICAL as well
+			{
+				ReleaseConnectionID(connectionID);
+				DropUnverifiedConnection(connection);
+				return true;
+			}
+
+			connection->OfferCapabilities();
+			AddVerifiedConnection(connectionID, connection);
+
+			MLOG_INFO("An incoming connection with destination " + TubesUtility::AddressToIPv4String(connection->GetAddress()) + " was accepted", LOG_CATEGORY_CONNECTION_MANAGER);
+			ConnectionAttemptResultData connectionResult = ConnectionAttemptResultData(ConnectionAttemptResult::SUCCESS_INCOMING, AddressToIPv4String(connection->GetAddress()), connection->GetPort(), connectionID);
+			TriggerConnectionCallbacks(connectionResult);
+			return true;
 		}
-		else
-			m_ConnectionAttemptLockCondition.wait(m_ConnectionAttemptLock);
+
+		case ConnectionState::NewOutgoing:
+		{
+			Message* message = nullptr;
+			ReceiveResult result = connection->Receive(replicatorMap, message);
+			switch (result)
+			{
+				case ReceiveResult::Fullmessage:
+				{
+					if (message->Type == TubesMessages::CONNECTION_ID) // The ID the remote side uses for the connection completes the handshake. It isn't used locally since it may collide with the IDs of other connections
+					{
+						MessageAllocator::Free(message);
+						ConnectionID connectionID = ReserveConnectionID();
+						if (connectionID == TUBES_INVALID_CONNECTION_ID)
+						{
+							MLOG_WARNING("An outgoing connection with destination " << TubesUtility::AddressToIPv4String(connection->GetAddress()) << " was disconnected since the maximum number of connections has been reached", LOG_CATEGORY_CONNECTION_MANAGER);
+							DropUnverifiedConnection(connection);
+							return true;
+						}
+						AddVerifiedConnection(connectionID, connection);
+
+						MLOG_INFO("An outgoing connection with destination " + TubesUtility::AddressToIPv4String(connection->GetAddress()) + " was accepted", LOG_CATEGORY_CONNECTION_MANAGER);
+						ConnectionAttemptResultData connectionResult = ConnectionAttemptResultData(ConnectionAttemptResult::SUCCESS_OUTGOING, AddressToIPv4String(connection->GetAddress()), connection->GetPort(), connectionID);
+						TriggerConnectionCallbacks(connectionResult);
+						return true;
+					}
+
+					MLOG_WARNING("Received an unexpected message type while verifying socket; message type = " << message->Type, LOG_CATEGORY_CONNECTION_MANAGER);
+					MessageAllocator::Free(message);
+				} break;
+
+				case ReceiveResult::GracefulDisconnect:
+				case ReceiveResult::ForcefulDisconnect:
+				{
+					MLOG_INFO("An unverified outgoing connection with destination " + TubesUtility::AddressToIPv4String(connection->GetAddress()) + " was disconnected during handshake", LOG_CATEGORY_CONNECTION_MANAGER);
+					DropUnverifiedConnection(connection);
+				} return true;
+
+				case ReceiveResult::Empty:
+				case ReceiveResult::PartialMessage:
+				case ReceiveResult::Error:
+				default:
+					break;
+			}
+		} break;
+
+		default:
+			assert( false && "TUBES: A connection is in an unhandled connection state" );
+		break;
 	}
-	m_ConnectionAttemptLock.unlock();
+
+	return false;
 }
 
-void ConnectionManager::Connect(const std::string& address, Port port)
+void ConnectionManager::DropUnverifiedConnection(Connection* connection)
 {
-	// Set up the socket
-	Socket connectionSocket = static_cast<Socket>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)); // Address Family = INET and the protocol to be used is TCP
-	if (connectionSocket <= 0)
-	{
-		LogAPIErrorMessage("Failed to create socket", LOG_CATEGORY_CONNECTION_MANAGER);
-		return;
-	}
+	RemoveConnectionEndpoint(connection);
+	connection->Disconnect();
+	delete connection;
+}
 
-	Connection* connection = new Connection(connectionSocket, address, port);
-	connection->SetBlockingMode(false);
-	ConnectionAttemptResult result = connection->Connect();
+bool ConnectionManager::AddConnectionEndpoint(const Connection* connection, bool rejectDuplicate)
+{
+	uint64_t endpoint = PackEndpoint(connection);
+	std::lock_guard<std::mutex> lock(m_ConnectionEndpointsLock);
+	if (rejectDuplicate && m_ConnectionEndpoints.find(endpoint) != m_ConnectionEndpoints.end())
+		return false;
+
+	m_ConnectionEndpoints.insert(endpoint);
+	return true;
+}
+
+void ConnectionManager::RemoveConnectionEndpoint(const Connection* connection)
+{
+	std::lock_guard<std::mutex> lock(m_ConnectionEndpointsLock);
+	auto endpoint = m_ConnectionEndpoints.find(PackEndpoint(connection));
+	if (endpoint != m_ConnectionEndpoints.end())
+		m_ConnectionEndpoints.erase(endpoint); // Only one of the duplicates allowed by Settings::AllowDuplicateConnections
+}
+
+void ConnectionManager::FinishConnectionAttempt(Connection* connection, ConnectionAttemptResult result)
+{
 	if (result == ConnectionAttemptResult::SUCCESS_OUTGOING)
 	{
 		connection->SetNoDelay(true);
 
-		MLOG_INFO("Connection attempt to " + address + " was successful!", LOG_CATEGORY_CONNECTION_MANAGER);
+		MLOG_INFO("Connection attempt to " + AddressToIPv4String(connection->GetAddress()) + " was successful!", LOG_CATEGORY_CONNECTION_MANAGER);
+		AddConnectionEndpoint(connection, false); // Outgoing connections are never duplicates themselves, but incoming ones can duplicate them
 		m_UnverifiedConnections.push_back(std::pair<Connection*, ConnectionState>(connection, ConnectionState::NewOutgoing));
 	}
 	else
 	{
-		FailedConnectionAttemptsQueue.Produce(ConnectionAttemptResultData(result, AddressToIPv4String(connection->GetAddress()), connection->GetPort()));
+		m_FailedConnectionAttempts.push_back(ConnectionAttemptResultData(result, AddressToIPv4String(connection->GetAddress()), connection->GetPort()));
+		Socket connectionSocket = connection->GetSocket();
+		CloseSocket(connectionSocket); // Never connected so there is nothing to shut down
 		delete connection;
 	}
 }
 
-Connection* ConnectionManager::GetConnection(ConnectionID ID) const
+ReceiveResult ConnectionManager::ReceiveFromConnection(ConnectionID ID, Connection* connection, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>* outMessages, std::vector<MessageView>* outViews, std::vector<ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages, std::vector<std::pair<ConnectionID, DisconnectionType>>& outToDisconnect)
 {
-	Connection* toReturn = nullptr;
-	if (m_Connections.find(ID) != m_Connections.end())
-		toReturn = m_Connections.at(ID);
+	bool disconnected = false;
+	bool pinnedBuffer = false;
+	Message* message = nullptr;
+	MessageView view;
+	ReceiveResult result;
+	do
+	{
+		message = nullptr;
+		result = outViews != nullptr ? connection->ReceiveView(view) : connection->Receive(replicators, message);
+		switch (result)
+		{
+			case ReceiveResult::Fullmessage:
+			{
+				pinnedBuffer |= outViews != nullptr;
+				if (outViews != nullptr && view.Replicator_ID == TubesMessageReplicator::TubesMessageReplicatorID)
+				{
+					// Tubes messages are always consumed internally so they are deserialized even when receiving views
+					auto idAndReplicator = replicators.find(view.Replicator_ID);
+					if (idAndReplicator != replicators.end())
+						message = idAndReplicator->second->DeserializeMessage(view.Data);
+				}
+				else if (outViews != nullptr)
+				{
+					outViews->push_back(view);
+					if (outSenderIDs)
+						outSenderIDs->push_back(ID);
+				}
+
+				if (message == nullptr)
+					break;
+
+				if (message->Replicator_ID == TubesMessageReplicator::TubesMessageReplicatorID)
+				{
+					outTubesMessages.push_back(reinterpret_cast<TubesMessage*>(message)); // We know that this is a tubes message
+				}
+				else
+				{
+					outMessages->push_back(message);
+					if (outSenderIDs)
+						outSenderIDs->push_back(ID);
+				}
+			} break;
+
+			case ReceiveResult::GracefulDisconnect:
+			case ReceiveResult::ForcefulDisconnect:
+			{
+				outToDisconnect.push_back(std::make_pair(ID, result == ReceiveResult::GracefulDisconnect ? DisconnectionType::REMOTE_GRACEFUL : DisconnectionType::REMOTE_FORCEFUL));
+				disconnected = true;
+			} break;
+
+			case ReceiveResult::Empty:
+			case ReceiveResult::PartialMessage:
+			case ReceiveResult::Error:
+			default:
+				break;
+		}
+	} while (result == ReceiveResult::Fullmessage && !disconnected);
+
+	if (pinnedBuffer)
+		m_ConnectionsWithViews.push_back(ID);
+
+	return result;
+}
+
+void ConnectionManager::ReceiveDatagrams(const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>* outMessages, std::vector<MessageView>* outViews, std::vector<ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages)
+{
+	if (!Settings::UseDatagramChannel)
+		return;
+
+	m_ReceivedDatagrams.clear();
+	m_ReceivedDatagramData.clear();
+	m_DatagramChannel.Receive(m_ReceivedDatagrams, m_ReceivedDatagramData);
+
+	for (int i = 0; i < m_ReceivedDatagrams.size(); ++i)
+	{
+		const ReceivedDatagram& datagram = m_ReceivedDatagrams[i];
+		ConnectionShard& shard = m_Shards[GetShardIndex(datagram.ID)];
+		{
+			std::lock_guard<std::mutex> lock(shard.Lock);
+			Connection* connection = shard.Connections.Find(datagram.ID);
+			if (connection == nullptr)
+				continue;
+
+			bool carriesMessage = connection->AcceptDatagram(datagram);
+			shard.Connections.UpdateSendState(datagram.ID); // Hellos are confirmed over the stream
+			if (!carriesMessage)
+				continue;
+		}
+
+		// The channel has checked that the datagram holds exactly one standard frame
+		const Byte* frame = m_ReceivedDatagramData.data() + datagram.FrameOffset;
+		ReplicatorID replicatorID;
+		memcpy(&replicatorID, frame + sizeof(MessageSize), sizeof(ReplicatorID));
+		if (outViews != nullptr && replicatorID != TubesMessageReplicator::TubesMessageReplicatorID)
+		{
+			MessageView view;
+			view.Data			= frame;
+			view.Size			= datagram.FrameSize;
+			view.Payload		= frame + MESSAGE_HEADER_SIZE;
+			view.PayloadSize	= datagram.FrameSize - MESSAGE_HEADER_SIZE;
+			view.Replicator_ID	= replicatorID;
+			memcpy(&view.Type, frame + sizeof(MessageSize) + sizeof(ReplicatorID), sizeof(MESSAGE_TYPE_ENUM_UNDELYING_TYPE));
+
+			outViews->push_back(view);
+			if (outSenderIDs)
+				outSenderIDs->push_back(datagram.ID);
+			continue;
+		}
+
+		auto idAndReplicator = replicators.find(replicatorID);
+		if (idAndReplicator == replicators.end())
+		{
+			MLOG_ERROR("Received a datagram for replicator with id " << static_cast<uint32_t>(replicatorID) << " but no such replicator exists", LOG_CATEGORY_CONNECTION_MANAGER);
+			continue;
+		}
+
+		Message* message = idAndReplicator->second->DeserializeMessage(frame);
+		if (message == nullptr)
+			continue;
+
+		if (message->Replicator_ID == TubesMessageReplicator::TubesMessageReplicatorID)
+			outTubesMessages.push_back(reinterpret_cast<TubesMessage*>(message));
+		else
+		{
+			outMessages->push_back(message);
+			if (outSenderIDs)
+				outSenderIDs->push_back(datagram.ID);
+		}
+	}
+}
+
+void ConnectionManager::TriggerConnectionCallbacks(const ConnectionAttemptResultData& resultData)
+{
+	if (m_DeferCallbacks)
+	{
+		std::lock_guard<std::mutex> lock(m_DeferredCallbackLock);
+		m_DeferredConnectionResults.Produce(resultData);
+	}
 	else
-		MLOG_WARNING("Attempted to fetch nonexistent connection (ID = " << ID + " )", LOG_CATEGORY_CONNECTION_MANAGER);
+		m_ConnectionCallbacks.TriggerCallbacks(resultData);
+}
+
+void ConnectionManager::TriggerDisconnectionCallbacks(const DisconnectionData& disconnectionData)
+{
+	if (m_DeferCallbacks)
+	{
+		std::lock_guard<std::mutex> lock(m_DeferredCallbackLock);
+		m_DeferredDisconnections.Produce(disconnectionData);
+	}
+	else
+		m_DisconnectionCallbacks.TriggerCallbacks(disconnectionData);
+}
+
+void ConnectionManager::SendToConnection(SerializedMessage* message, ConnectionID destinationID, DeliveryMode deliveryMode, MessagePriority priority, const DeltaKey* deltaKey)
+{
+	SendResult result = SendResult::Error;
+	ConnectionShard& shard = m_Shards[GetShardIndex(destinationID)];
+	{
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		Connection* connection = shard.Connections.Find(destinationID);
+		if (connection == nullptr)
+		{
+			MLOG_WARNING("Failed to find requested connection while sending (Requested ID = " << destinationID << " )", LOG_CATEGORY_CONNECTION_MANAGER);
+			return;
+		}
+
+		result = deltaKey != nullptr ? connection->SendDeltaMessage(message, *deltaKey) : SendWithDeliveryMode(connection, message, deliveryMode, priority);
+		shard.Connections.UpdateSendState(destinationID);
+	}
+
+	switch (result)
+	{
+		case SendResult::Disconnect:
+		{
+			Disconnect(DisconnectionType::REMOTE_FORCEFUL, destinationID); // TODODB: Update the disconnectionType when we actually know if was forceful or not
+		} break;
+
+		case SendResult::SlowConsumer:
+		{
+			Disconnect(DisconnectionType::LOCAL, destinationID);
+		} break;
 
-	return toReturn;
+		case SendResult::Sent:
+		case SendResult::Queued:
+		case SendResult::Backpressure:
+		case SendResult::Dropped:
+		case SendResult::Error:
+		default:
+			break;
+	}
 }
 
-const std::unordered_map<ConnectionID, Connection*>& ConnectionManager::GetVerifiedConnections() const
+ConnectionID ConnectionManager::ReserveConnectionID()
 {
-	return m_Connections;
+	for (uint32_t i = 0; i < m_ShardCount; ++i) // A full shard hands over to the next one
+	{
+		ConnectionShard& shard = m_Shards[m_NextShardIndex];
+		m_NextShardIndex = (m_NextShardIndex + 1) % m_ShardCount;
+
+		std::lock_guard<std::mutex> lock(shard.Lock);
+		ConnectionID ID = shard.Connections.Reserve();
+		if (ID != TUBES_INVALID_CONNECTION_ID)
+			return ID;
+	}
+	return TUBES_INVALID_CONNECTION_ID;
+}
+
+void ConnectionManager::ReleaseConnectionID(ConnectionID ID)
+{
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	shard.Connections.Remove(ID);
+}
+
+void ConnectionManager::AddVerifiedConnection(ConnectionID ID, Connection* connection)
+{
+	if (Settings::UseDatagramChannel)
+		connection->AttachDatagramChannel(&m_DatagramChannel, ID);
+
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	shard.Connections.Insert(ID, connection);
+	shard.Poller.Add(connection->GetSocket(), ID);
+
+	if (connection->HasReceivedData()) // Messages following the handshake may have been received along with it
+		shard.ConnectionsWithBufferedData.push_back(ID);
+}
+
+bool ConnectionManager::GetReadableConnections(ConnectionShard& shard, std::vector<ConnectionID>& outReadableIDs) // Called with the shard lock held
+{
+	for (int i = 0; i < shard.ConnectionsWithBufferedData.size(); ++i)
+	{
+		if (shard.Connections.Find(shard.ConnectionsWithBufferedData[i]) != nullptr)
+			outReadableIDs.push_back(shard.ConnectionsWithBufferedData[i]);
+	}
+	shard.ConnectionsWithBufferedData.clear();
+
+	return shard.Poller.Poll(outReadableIDs);
+}
+
+uint32_t ConnectionManager::GetShardCount() const
+{
+	return m_ShardCount;
+}
+
+uint32_t ConnectionManager::GetShardIndex(ConnectionID ID) const
+{
+	uint32_t shardIndex = ConnectionTable::GetSlotIndex(ID) & m_ShardIndexMask;
+	return shardIndex < m_ShardCount ? shardIndex : 0; // Invalid IDs may point past the last shard. They are rejected by the shard's connection table
 }
 
 uint32_t ConnectionManager::GetVerifiedConnctionCount() const
 {
-	return static_cast<uint32_t>(m_Connections.size());
+	uint32_t connectionCount = 0;
+	for (uint32_t i = 0; i < m_ShardCount; ++i)
+	{
+		std::lock_guard<std::mutex> lock(m_Shards[i].Lock);
+		connectionCount += static_cast<uint32_t>(m_Shards[i].Connections.GetCount());
+	}
+	return connectionCount;
 }
 
 std::string ConnectionManager::GetAddressOfConnection(ConnectionID ID) const
 {
-	return TubesUtility::AddressToIPv4String(m_Connections.at(ID)->GetAddress());
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	Connection* connection = shard.Connections.Find(ID);
+	return connection != nullptr ? TubesUtility::AddressToIPv4String(connection->GetAddress()) : ""; // The connection may have been disconnected by a network thread since it was validated
 }
 
 Port ConnectionManager::GetPortOfConnection(ConnectionID ID) const
 {
-	return m_Connections.at(ID)->GetPort();
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	Connection* connection = shard.Connections.Find(ID);
+	return connection != nullptr ? connection->GetPort() : TUBES_INVALID_PORT;
+}
+
+int64_t ConnectionManager::GetQueuedByteCount(ConnectionID ID) const
+{
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	return shard.Connections.GetQueuedByteCount(ID);
+}
+
+bool ConnectionManager::IsBackpressured(ConnectionID ID) const
+{
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	Connection* connection = shard.Connections.Find(ID);
+	return connection != nullptr ? connection->IsBackpressured() : false;
+}
+
+void ConnectionManager::SetSendQueueWatermarks(ConnectionID ID, uint32_t highWatermark, uint32_t lowWatermark)
+{
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	Connection* connection = shard.Connections.Find(ID);
+	if (connection != nullptr)
+		connection->SetSendQueueWatermarks(highWatermark, lowWatermark);
 }
 
 bool ConnectionManager::IsConnectionIDValid(ConnectionID ID) const
 {
-	return m_Connections.find(ID) != m_Connections.end();
+	ConnectionShard& shard = m_Shards[GetShardIndex(ID)];
+	std::lock_guard<std::mutex> lock(shard.Lock);
+	return shard.Connections.Find(ID) != nullptr;
 }
\ No newline at end of file
@@ -2,20 +2,40 @@
 #include "Interface/Tubes.h" // TODODB: Remove this when callbacks have been changed to no longer depend upon the externals in MUTility (Causes struct redefinition is TubesTypes.h is included instead)
 #include "InternalTubesTypes.h"
 #include "Connection.h"
+#include "ConnectionTable.h"
 #include "Listener.h"
+#include "SocketPoller.h"
 #include <MUtilityExternal/CallbackRegister.h>
 #include <MUtilityLocklessQueue.h>
+#include <unordered_set>
 
-class TubesMessageReplicator;
+class	TubesMessageReplicator;
+class	SerializedMessage;
+struct	TubesMessage;
 
 class ConnectionManager // TODODB: Make this a namespace instead
 {
 public:
-	ConnectionManager();
+	ConnectionManager(uint32_t shardCount = 1);
 	~ConnectionManager();
 
+	void AcceptConnections();
+	void AcceptConnections(uint32_t shardIndex); // Accepts from the listening sockets that belong to the shard. Connections are verified by the next call to VerifyNewConnections
+	void UpdateConnectionAttempts(); // Progresses the outgoing connection attempts and reports the failed ones. Connected sockets are verified by the next call to VerifyNewConnections
 	void VerifyNewConnections(TubesMessageReplicator& replicator);
-	void HandleFailedConnectionAttempts();
+
+	// The functions without a shard index operate on all shards
+	void SendToConnection(SerializedMessage* message, Tubes::ConnectionID destinationID, Tubes::DeliveryMode deliveryMode = Tubes::DeliveryMode::RELIABLE_ORDERED, Tubes::MessagePriority priority = Tubes::MessagePriority::NORMAL);
+	void SendDeltaToConnection(SerializedMessage* message, Tubes::ConnectionID destinationID, Tubes::DeltaKey key);
+	void SendToAll(SerializedMessage* message, Tubes::ConnectionID exception, Tubes::DeliveryMode deliveryMode = Tubes::DeliveryMode::RELIABLE_ORDERED, Tubes::MessagePriority priority = Tubes::MessagePriority::NORMAL);
+	void SendToShard(uint32_t shardIndex, SerializedMessage* message, Tubes::ConnectionID exception, Tubes::DeliveryMode deliveryMode = Tubes::DeliveryMode::RELIABLE_ORDERED, Tubes::MessagePriority priority = Tubes::MessagePriority::NORMAL);
+	void SendQueuedMessages(bool flushHeldMessages = false); // flushHeldMessages also sends the messages held by Settings::UseMessageCoalescing
+	void SendQueuedMessages(uint32_t shardIndex, bool flushHeldMessages = false);
+	void Flush(Tubes::ConnectionID ID);
+	void ReceiveMessages(const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>& outMessages, std::vector<Tubes::ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages);
+	void ReceiveMessages(uint32_t shardIndex, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>& outMessages, std::vector<Tubes::ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages);
+	void ReceiveViews(const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<MessageView>& outViews, std::vector<Tubes::ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages);
+	void ReleaseViews(); // Invalidates all views handed out by ReceiveViews
 
 	void RequestConnection(const std::string& address, Port port);
 	void Disconnect(Tubes::DisconnectionType type, Tubes::ConnectionID connectionID);
@@ -33,49 +53,92 @@ public:
 	void CallConnectionCallback(const Tubes::ConnectionAttemptResultData& resultData);
 	void CallDisconnectionCallback(const Tubes::DisconnectionData& disconnectionData);
 
-	Connection* GetConnection(Tubes::ConnectionID ID) const;
-	const std::unordered_map<Tubes::ConnectionID, Connection*>& GetVerifiedConnections() const;
+	void SetCallbackDeferral(bool deferCallbacks); // Queue connection and disconnection callbacks until DispatchDeferredCallbacks is called instead of triggering them right away. Used when another thread than the application thread drives the connections
+	void DispatchDeferredCallbacks();
+
+	uint32_t GetShardCount() const;
+	uint32_t GetShardIndex(Tubes::ConnectionID ID) const;
 
 	uint32_t GetVerifiedConnctionCount() const;
 	std::string GetAddressOfConnection(Tubes::ConnectionID ID) const;
 	uint16_t GetPortOfConnection(Tubes::ConnectionID ID) const;
+	int64_t GetQueuedByteCount(Tubes::ConnectionID ID) const;
+	bool IsBackpressured(Tubes::ConnectionID ID) const;
+	void SetSendQueueWatermarks(Tubes::ConnectionID ID, uint32_t highWatermark, uint32_t lowWatermark);
 
 	bool IsConnectionIDValid(Tubes::ConnectionID ID) const;
 
 private:
-	struct ConnectionAttemptData
+	struct ConnectionAttempt
 	{
-		ConnectionAttemptData() {}
-		ConnectionAttemptData(const std::string& address, Port port) : Address(address), Port(port) {}
-	
-		ConnectionAttemptData& operator=(const ConnectionAttemptData& other)
-		{
-			Address = other.Address;
-			Port	= other.Port;
-			return *this;
-		}
-
-		std::string Address;
-		Port Port = TUBES_INVALID_PORT;
+		ConnectionAttempt() {}
+		ConnectionAttempt(Connection* connection, std::chrono::steady_clock::time_point deadline) : PendingConnection(connection), Deadline(deadline) {}
+
+		Connection*								PendingConnection = nullptr;
+		std::chrono::steady_clock::time_point	Deadline;
 	};
 
-	void ProcessConnectionRequests();
-	void Connect(const std::string& address, Port port);
+	// Verified connections are split into shards by connection ID so that each shard can be served by its own network thread.
+	// A connection never changes shard which keeps the messages of a connection in order.
+	struct ConnectionShard
+	{
+		std::mutex												Lock; // Guards everything in the shard. Taken after the connection manager lock when both are needed
+		ConnectionTable											Connections;
+		SocketPoller											Poller;
+		std::vector<Tubes::ConnectionID>						ConnectionsWithBufferedData; // Connections that may hold received messages which the poller won't report. E.g. newly verified ones, or ones where a failed message stopped the receiving
+		std::vector<Listener*>									Listeners; // Listeners with a socket that is accepted from by the shard
+	};
+
+	void FinishConnectionAttempt(Connection* connection, Tubes::ConnectionAttemptResult result);
+	void SendToConnection(SerializedMessage* message, Tubes::ConnectionID destinationID, Tubes::DeliveryMode deliveryMode, Tubes::MessagePriority priority, const Tubes::DeltaKey* deltaKey); // Delta compressed if deltaKey isn't null
+	bool VerifyConnection(Connection* connection, ConnectionState state, TubesMessageReplicator& replicator, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicatorMap); // Returns true once the connection has been verified or dropped
+	void DropUnverifiedConnection(Connection* connection);
+	Tubes::ConnectionID ReserveConnectionID(); // Picks the shard of a connection that is about to be verified. Returns TUBES_INVALID_CONNECTION_ID if all shards are full
+	void ReleaseConnectionID(Tubes::ConnectionID ID); // For reserved IDs whose connections failed verification
+	void AddVerifiedConnection(Tubes::ConnectionID ID, Connection* connection); // ID must have been reserved
+	bool AddConnectionEndpoint(const Connection* connection, bool rejectDuplicate); // Returns false without adding the endpoint if rejectDuplicate is set and a connection with the same address, port and local port exists
+	void RemoveConnectionEndpoint(const Connection* connection);
+	bool GetReadableConnections(ConnectionShard& shard, std::vector<Tubes::ConnectionID>& outReadableIDs);
+	void ReceiveFromShard(uint32_t shardIndex, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>* outMessages, std::vector<MessageView>* outViews, std::vector<Tubes::ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages);
+	ReceiveResult ReceiveFromConnection(Tubes::ConnectionID ID, Connection* connection, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>* outMessages, std::vector<MessageView>* outViews, std::vector<Tubes::ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages, std::vector<std::pair<Tubes::ConnectionID, Tubes::DisconnectionType>>& outToDisconnect); // Returns the result that ended the receiving
+
+	void ReceiveDatagrams(const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators, std::vector<Message*>* outMessages, std::vector<MessageView>* outViews, std::vector<Tubes::ConnectionID>* outSenderIDs, std::vector<TubesMessage*>& outTubesMessages); // Done along with shard 0 since all connections share the datagram sockets. Views stay valid until the next call
+
+	void TriggerConnectionCallbacks(const Tubes::ConnectionAttemptResultData& resultData);
+	void TriggerDisconnectionCallbacks(const Tubes::DisconnectionData& disconnectionData);
 
 	std::vector<std::pair<Connection*, ConnectionState>> m_UnverifiedConnections;
-	std::unordered_map<Tubes::ConnectionID, Connection*> m_Connections;
+	std::vector<std::pair<Connection*, ConnectionState>> m_NewConnections; // Reused by VerifyNewConnections
+
+	std::unordered_multiset<uint64_t>	m_ConnectionEndpoints; // Packed IPv4 address, port and local port of every unverified and verified connection. A multiset since Settings::AllowDuplicateConnections may let the same endpoint in more than once
+	std::mutex							m_ConnectionEndpointsLock; // Verified connections are disconnected from the network threads without the connection manager lock
 	std::unordered_map<Port, Listener*> m_ListenerMap;
 
+	ConnectionShard*	m_Shards;
+	uint32_t			m_ShardCount;
+	uint32_t			m_ShardIndexMask;
+
+	std::vector<Tubes::ConnectionID>	m_ConnectionsWithViews; // Connections whose receive buffers are pinned by views handed out by ReceiveViews
+	std::vector<MUtility::Byte*>		m_RetiredViewData; // Buffers of disconnected connections that views handed out by ReceiveViews may point into. Freed when the views are released
+
+	DatagramChannel					m_DatagramChannel;
+	std::vector<ReceivedDatagram>	m_ReceivedDatagrams;
+	std::vector<MUtility::Byte>		m_ReceivedDatagramData; // Holds the frames of the received datagrams until the next receive
+
 	CallbackRegister<Tubes::ConnectionCallbackTag, void, const Tubes::ConnectionAttemptResultData&> m_ConnectionCallbacks;
 	CallbackRegister<Tubes::DisconnectionCallbackTag, void, const Tubes::DisconnectionData&> m_DisconnectionCallbacks;
-	MUtility::LocklessQueue<Tubes::ConnectionAttemptResultData> FailedConnectionAttemptsQueue;
 
-	Tubes::ConnectionID m_NextConnectionID = 1;
+	bool														m_DeferCallbacks = false;
+	std::mutex													m_DeferredCallbackLock; // Serializes the network threads producing deferred callbacks
+	MUtility::LocklessQueue<Tubes::ConnectionAttemptResultData>	m_DeferredConnectionResults;
+	MUtility::LocklessQueue<Tubes::DisconnectionData>			m_DeferredDisconnections;
+
+	uint32_t m_NextShardIndex = 0; // New connections are spread over the shards round robin
 
-	std::thread						m_ConnectionThread;
-	std::atomic<bool>				m_RunConnectionThread;
-	std::unique_lock<std::mutex>	m_ConnectionAttemptLock;
-	std::mutex						m_ConnectionAttemptLockMutex;
-	std::condition_variable			m_ConnectionAttemptLockCondition;
-	MUtility::LocklessQueue<ConnectionAttemptData> m_RequestedConnections;
+	// Outgoing connects are non-blocking so that any number of them can be in flight. They are guarded by the connection manager lock like the unverified connections
+	std::unordered_map<Tubes::ConnectionID, ConnectionAttempt>	m_ConnectionAttempts; // Keyed by attempt ID, which is only used to identify the attempt to the poller
+	SocketPoller												m_ConnectionAttemptPoller; // Reports the sockets whose connects have completed
+	std::vector<Tubes::ConnectionAttemptResultData>				m_FailedConnectionAttempts; // Reported on the next update so that the callbacks are never triggered from within RequestConnection
+	Tubes::ConnectionID											m_NextConnectionAttemptID = 0;
+	std::vector<Tubes::ConnectionID>							m_CompletedConnectionAttemptIDs;
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "ConnectionTable.h"
+#include "Connection.h"
+#include <cassert>
+
+using namespace Tubes;
+
+// ---------- PUBLIC ----------
+
+void ConnectionTable::SetSlotLayout(uint32_t firstSlotIndex, uint32_t slotIndexShift)
+{
+	assert(m_Slots.empty() && "TUBES: The slot layout of a connection table can't be changed once IDs have been handed out");
+	assert(firstSlotIndex < (1u << slotIndexShift) && "TUBES: The first slot index of a connection table must fit in the shifted bits");
+	m_FirstSlotIndex	= firstSlotIndex;
+	m_SlotIndexShift	= slotIndexShift;
+}
+
+ConnectionID ConnectionTable::Reserve()
+{
+	uint32_t localSlotIndex = static_cast<uint32_t>(m_Slots.size());
+	bool canGrow = (static_cast<uint64_t>(localSlotIndex) << m_SlotIndexShift | m_FirstSlotIndex) <= SLOT_MASK;
+	if (!m_FreeSlots.empty() && (m_FreeSlots.size() >= MIN_FREE_SLOTS || !canGrow))
+	{
+		localSlotIndex = m_FreeSlots.front();
+		m_FreeSlots.pop_front();
+	}
+	else
+	{
+		if (!canGrow)
+			return TUBES_INVALID_CONNECTION_ID;
+
+		m_Slots.push_back(Slot());
+	}
+
+	m_Slots[localSlotIndex].Taken = true;
+	return ToID(localSlotIndex);
+}
+
+void ConnectionTable::Insert(ConnectionID reservedID, Connection* connection)
+{
+	uint32_t localSlotIndex;
+	bool isReserved = ToLocalSlotIndex(reservedID, localSlotIndex) && m_Slots[localSlotIndex].Taken && m_Slots[localSlotIndex].EntryIndex == UNUSED_ENTRY_INDEX;
+	assert(isReserved && "TUBES: Attempted to insert a connection with an ID that wasn't reserved");
+	if (!isReserved)
+		return;
+
+	uint32_t entryIndex = GetCount();
+	m_Slots[localSlotIndex].SlotConnection	= connection;
+	m_Slots[localSlotIndex].EntryIndex		= entryIndex;
+	m_IDs.push_back(reservedID);
+	m_Connections.push_back(connection);
+	m_SendPending.push_back(0);
+	m_QueuedByteCounts.push_back(0);
+	UpdateSendStateAt(entryIndex);
+}
+
+bool ConnectionTable::Remove(ConnectionID ID)
+{
+	uint32_t localSlotIndex;
+	if (!ToLocalSlotIndex(ID, localSlotIndex) || !m_Slots[localSlotIndex].Taken)
+		return false;
+
+	uint32_t entryIndex = m_Slots[localSlotIndex].EntryIndex;
+	if (entryIndex != UNUSED_ENTRY_INDEX)
+	{
+		// Fill the hole with the last entry to keep the entries dense
+		uint32_t lastEntryIndex = GetCount() - 1;
+		if (entryIndex != lastEntryIndex)
+		{
+			m_IDs[entryIndex]				= m_IDs[lastEntryIndex];
+			m_Connections[entryIndex]		= m_Connections[lastEntryIndex];
+			m_SendPending[entryIndex]		= m_SendPending[lastEntryIndex];
+			m_QueuedByteCounts[entryIndex]	= m_QueuedByteCounts[lastEntryIndex];
+
+			uint32_t movedLocalSlotIndex;
+			ToLocalSlotIndex(m_IDs[entryIndex], movedLocalSlotIndex);
+			m_Slots[movedLocalSlotIndex].EntryIndex = entryIndex;
+		}
+		m_IDs.pop_back();
+		m_Connections.pop_back();
+		m_SendPending.pop_back();
+		m_QueuedByteCounts.pop_back();
+	}
+
+	FreeSlot(localSlotIndex);
+	return true;
+}
+
+void ConnectionTable::Clear()
+{
+	for (uint32_t i = 0; i < m_Slots.size(); ++i)
+	{
+		if (m_Slots[i].Taken)
+			FreeSlot(i);
+	}
+	m_IDs.clear();
+	m_Connections.clear();
+	m_SendPending.clear();
+	m_QueuedByteCounts.clear();
+}
+
+Connection* ConnectionTable::Find(ConnectionID ID) const
+{
+	uint32_t localSlotIndex;
+	if (!ToLocalSlotIndex(ID, localSlotIndex))
+		return nullptr;
+
+	return m_Slots[localSlotIndex].SlotConnection;
+}
+
+int64_t ConnectionTable::GetQueuedByteCount(ConnectionID ID) const
+{
+	uint32_t localSlotIndex;
+	if (!ToLocalSlotIndex(ID, localSlotIndex) || m_Slots[localSlotIndex].EntryIndex == UNUSED_ENTRY_INDEX)
+		return 0;
+
+	return m_QueuedByteCounts[m_Slots[localSlotIndex].EntryIndex];
+}
+
+void ConnectionTable::UpdateSendState(ConnectionID ID)
+{
+	uint32_t localSlotIndex;
+	if (ToLocalSlotIndex(ID, localSlotIndex) && m_Slots[localSlotIndex].EntryIndex != UNUSED_ENTRY_INDEX)
+		UpdateSendStateAt(m_Slots[localSlotIndex].EntryIndex);
+}
+
+void ConnectionTable::UpdateSendStateAt(uint32_t entryIndex)
+{
+	const Connection* connection = m_Connections[entryIndex];
+	m_QueuedByteCounts[entryIndex]	= connection->GetQueuedByteCount();
+	m_SendPending[entryIndex]		= connection->HasUnsentMessages() || connection->IsAwaitingDatagramConfirmation();
+}
+
+// ---------- PRIVATE ----------
+
+ConnectionID ConnectionTable::ToID(uint32_t localSlotIndex) const
+{
+	uint32_t slotIndex = localSlotIndex << m_SlotIndexShift | m_FirstSlotIndex;
+	return static_cast<ConnectionID>((static_cast<uint32_t>(m_Slots[localSlotIndex].Generation) << SLOT_BITS) | slotIndex);
+}
+
+bool ConnectionTable::ToLocalSlotIndex(ConnectionID ID, uint32_t& outLocalSlotIndex) const
+{
+	if (ID < 0)
+		return false;
+
+	uint32_t slotIndex = GetSlotIndex(ID);
+	if ((slotIndex & ((1u << m_SlotIndexShift) - 1)) != m_FirstSlotIndex)
+		return false;
+
+	outLocalSlotIndex = slotIndex >> m_SlotIndexShift;
+	return outLocalSlotIndex < m_Slots.size() && m_Slots[outLocalSlotIndex].Generation == static_cast<uint32_t>(ID) >> SLOT_BITS;
+}
+
+void ConnectionTable::FreeSlot(uint32_t localSlotIndex)
+{
+	Slot& slot = m_Slots[localSlotIndex];
+	slot.SlotConnection	= nullptr;
+	slot.EntryIndex		= UNUSED_ENTRY_INDEX;
+	slot.Taken			= false;
+	slot.Generation		= static_cast<uint16_t>(slot.Generation % MAX_GENERATION + 1); // Wraps around to 1
+	m_FreeSlots.push_back(localSlotIndex);
+}
\ No newline at end of file
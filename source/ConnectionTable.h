@@ -0,0 +1,68 @@
+#pragma once
+#include "Interface/TubesTypes.h"
+#include <deque>
+#include <vector>
+
+class Connection;
+
+// Holds the verified connections of a shard. The connections are kept densely packed in parallel arrays so that iterating over them walks arrays rather than chasing Connection pointers.
+// What the per-frame sweeps check on every connection is mirrored into the arrays, which lets them skip idle connections without touching the Connection objects.
+// A connection ID is the index of a slot, which points out where in the dense arrays the connection is, combined with the generation of the slot.
+// The generation is bumped whenever a slot is freed, which makes IDs of disconnected connections stale instead of letting them alias the connection that reuses the slot.
+// Freed slots are reused first in first out and only once MIN_FREE_SLOTS of them are waiting, so a stale ID can only alias a new connection after its slot has been freed MAX_GENERATION times,
+// which takes at least MAX_GENERATION * MIN_FREE_SLOTS disconnections in the shard. Once the table can't grow any further the oldest free slot is reused right away
+class ConnectionTable
+{
+public:
+	static constexpr uint32_t	SLOT_BITS		= 20;
+	static constexpr uint32_t	SLOT_MASK		= (1u << SLOT_BITS) - 1;
+	static constexpr uint32_t	MAX_GENERATION	= (1u << (31 - SLOT_BITS)) - 1; // IDs stay positive so that they are never mistaken for TUBES_INVALID_CONNECTION_ID
+	static constexpr uint32_t	MIN_FREE_SLOTS	= 1024; // Freed slots that wait before the oldest of them is reused. A waiting slot only costs the memory of the slot
+
+	static uint32_t GetSlotIndex(Tubes::ConnectionID ID) { return static_cast<uint32_t>(ID) & SLOT_MASK; }
+
+	void				SetSlotLayout(uint32_t firstSlotIndex, uint32_t slotIndexShift); // Lets several tables hand out IDs without overlapping. The table owns the slot indices (n << slotIndexShift) | firstSlotIndex
+
+	Tubes::ConnectionID	Reserve(); // Returns an ID that Find won't report until it is passed to Insert, or TUBES_INVALID_CONNECTION_ID if all slots are taken
+	void				Insert(Tubes::ConnectionID reservedID, Connection* connection);
+	bool				Remove(Tubes::ConnectionID ID); // Also releases IDs that were reserved but never inserted
+	void				Clear();
+
+	Connection*			Find(Tubes::ConnectionID ID) const; // Returns nullptr for IDs that are stale or were never handed out
+	int64_t				GetQueuedByteCount(Tubes::ConnectionID ID) const; // Returns 0 for IDs that are stale or were never handed out
+
+	void				UpdateSendState(Tubes::ConnectionID ID); // Must be called after anything that may have queued or sent data on the connection
+	void				UpdateSendStateAt(uint32_t entryIndex);
+
+	// Entries are indexed from 0 to GetCount() - 1. Removing a connection moves the last entry into its place
+	uint32_t			GetCount() const { return static_cast<uint32_t>(m_IDs.size()); }
+	Tubes::ConnectionID	GetIDAt(uint32_t entryIndex) const { return m_IDs[entryIndex]; }
+	Connection*			GetConnectionAt(uint32_t entryIndex) const { return m_Connections[entryIndex]; }
+	bool				IsSendPendingAt(uint32_t entryIndex) const { return m_SendPending[entryIndex] != 0; } // The connection has unsent data or datagram hellos to send
+
+private:
+	static constexpr uint32_t UNUSED_ENTRY_INDEX = ~0u; // The slot is free or reserved
+
+	struct Slot
+	{
+		Connection*	SlotConnection	= nullptr; // Duplicates the entry so that a lookup only touches the slot
+		uint32_t	EntryIndex		= UNUSED_ENTRY_INDEX;
+		uint16_t	Generation		= 1;
+		bool		Taken			= false; // Reserved or inserted
+	};
+
+	Tubes::ConnectionID	ToID(uint32_t localSlotIndex) const;
+	bool				ToLocalSlotIndex(Tubes::ConnectionID ID, uint32_t& outLocalSlotIndex) const; // Returns false if the ID doesn't belong to a slot of the table
+	void				FreeSlot(uint32_t localSlotIndex);
+
+	// Dense, indexed by entry index
+	std::vector<Tubes::ConnectionID>	m_IDs;
+	std::vector<Connection*>			m_Connections; // Everything that isn't mirrored below
+	std::vector<uint8_t>				m_SendPending;
+	std::vector<int64_t>				m_QueuedByteCounts;
+
+	std::vector<Slot>		m_Slots; // Indexed by local slot index
+	std::deque<uint32_t>	m_FreeSlots; // Oldest first
+	uint32_t				m_FirstSlotIndex	= 0;
+	uint32_t				m_SlotIndexShift	= 0;
+};
\ No newline at end of file
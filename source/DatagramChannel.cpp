@@ -0,0 +1,249 @@
+#include "DatagramChannel.h"
+#include "TubesUtility.h"
+#include "Interface/TubesSettings.h"
+#include <MUtilityLog.h>
+
+#if PLATFORM != PLATFORM_WINDOWS
+#include <fcntl.h>
+#include <sys/socket.h>
+#endif
+
+#define LOG_CATEGORY_DATAGRAM_CHANNEL "TubesDatagramChannel"
+
+#if PLATFORM == PLATFORM_WINDOWS
+#define IS_WOULD_BLOCK_ERROR(errorCode) (errorCode == WSAEWOULDBLOCK)
+#else
+#define IS_WOULD_BLOCK_ERROR(errorCode) (errorCode == EWOULDBLOCK || errorCode == EAGAIN)
+#endif
+
+using namespace Tubes;
+using namespace TubesUtility;
+using MUtility::Byte;
+
+constexpr int32_t MAX_DATAGRAMS_PER_SOCKET_AND_RECEIVE = 256; // Bounds the time spent receiving when a peer floods a socket
+
+// ---------- PUBLIC ----------
+
+DatagramChannel::DatagramChannel()
+{
+	std::random_device randomDevice;
+	m_Random.seed((static_cast<uint64_t>(randomDevice()) << 32) | randomDevice());
+}
+
+DatagramChannel::~DatagramChannel()
+{
+	CloseAll();
+}
+
+bool DatagramChannel::Open(Port port)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	if (m_Sockets.find(port) != m_Sockets.end())
+		return true;
+
+	Socket datagramSocket = static_cast<Socket>(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+	if (datagramSocket == INVALID_SOCKET)
+	{
+		LogAPIErrorMessage("Failed to create datagram socket", LOG_CATEGORY_DATAGRAM_CHANNEL);
+		return false;
+	}
+
+	sockaddr_in sockAddr;
+	memset(&sockAddr, 0, sizeof(sockAddr));
+	sockAddr.sin_family			= AF_INET;
+	sockAddr.sin_addr.s_addr	= htonl(INADDR_ANY);
+	sockAddr.sin_port			= htons(port);
+	if (bind(datagramSocket, reinterpret_cast<sockaddr*>(&sockAddr), sizeof(sockAddr)) < 0)
+	{
+		LogAPIErrorMessage("Failed to bind datagram socket to port " << port, LOG_CATEGORY_DATAGRAM_CHANNEL);
+		CloseSocket(datagramSocket);
+		return false;
+	}
+
+#if PLATFORM == PLATFORM_WINDOWS
+	u_long nonBlocking = 1;
+	bool setNonBlocking = ioctlsocket(datagramSocket, FIONBIO, &nonBlocking) == 0;
+#else
+	int flags = fcntl(datagramSocket, F_GETFL, 0);
+	bool setNonBlocking = flags >= 0 && fcntl(datagramSocket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+	if (!setNonBlocking)
+	{
+		LogAPIErrorMessage("Failed to make datagram socket non blocking", LOG_CATEGORY_DATAGRAM_CHANNEL);
+		CloseSocket(datagramSocket);
+		return false;
+	}
+
+	m_Sockets.emplace(port, datagramSocket);
+	MLOG_INFO("Opened datagram socket on port " << port, LOG_CATEGORY_DATAGRAM_CHANNEL);
+	return true;
+}
+
+void DatagramChannel::CloseAll()
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	for (auto& portAndSocket : m_Sockets)
+	{
+		CloseSocket(portAndSocket.second);
+	}
+	m_Sockets.clear();
+	m_Tokens.clear();
+	m_DelayedDatagrams.clear();
+}
+
+Socket DatagramChannel::GetSocket(Port port) const
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	auto portAndSocket = m_Sockets.find(port);
+	return portAndSocket != m_Sockets.end() ? portAndSocket->second : INVALID_SOCKET;
+}
+
+uint64_t DatagramChannel::CreateToken(ConnectionID ID)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	uint64_t token;
+	do
+	{
+		token = m_Random();
+	} while (token == 0 || m_Tokens.find(token) != m_Tokens.end()); // 0 means that no token has been received
+
+	m_Tokens.emplace(token, ID);
+	return token;
+}
+
+void DatagramChannel::RegisterToken(uint64_t token, ConnectionID ID)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Tokens[token] = ID;
+}
+
+void DatagramChannel::UnregisterToken(uint64_t token)
+{
+	std::lock_guard<std::mutex> lock(m_Lock);
+	m_Tokens.erase(token);
+}
+
+bool DatagramChannel::Send(Socket socket, const sockaddr_in& destination, uint64_t token, uint32_t sequence, const Byte* frame, int32_t frameSize)
+{
+	Byte datagram[MAX_DATAGRAM_SIZE];
+	int32_t datagramSize = DATAGRAM_HEADER_SIZE + frameSize;
+	memcpy(datagram, &token, sizeof(token));
+	memcpy(datagram + sizeof(token), &sequence, sizeof(sequence));
+	if (frameSize > 0)
+		memcpy(datagram + DATAGRAM_HEADER_SIZE, frame, frameSize);
+
+	if (Settings::DatagramLossRate > 0.0f || Settings::DatagramLatencyMilliseconds > 0)
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		if (std::uniform_real_distribution<float>(0.0f, 1.0f)(m_Random) < Settings::DatagramLossRate)
+			return false;
+
+		if (Settings::DatagramLatencyMilliseconds > 0)
+		{
+			DelayedDatagram delayedDatagram;
+			delayedDatagram.DueTime		= std::chrono::steady_clock::now() + std::chrono::milliseconds(Settings::DatagramLatencyMilliseconds);
+			delayedDatagram.SendSocket	= socket;
+			delayedDatagram.Destination	= destination;
+			delayedDatagram.Data.assign(datagram, datagram + datagramSize);
+			m_DelayedDatagrams.push_back(std::move(delayedDatagram));
+			return true;
+		}
+	}
+
+	return SendNow(socket, destination, datagram, datagramSize);
+}
+
+void DatagramChannel::Receive(std::vector<ReceivedDatagram>& outDatagrams, std::vector<Byte>& outData)
+{
+	std::vector<Socket> sockets;
+	{
+		std::lock_guard<std::mutex> lock(m_Lock);
+		SendDueDatagrams();
+		for (const auto& portAndSocket : m_Sockets)
+		{
+			sockets.push_back(portAndSocket.second);
+		}
+	}
+
+	for (int i = 0; i < sockets.size(); ++i)
+	{
+		ReceiveFromSocket(sockets[i], outDatagrams, outData);
+	}
+}
+
+// ---------- PRIVATE ----------
+
+bool DatagramChannel::SendNow(Socket socket, const sockaddr_in& destination, const Byte* datagram, int32_t datagramSize)
+{
+	if (sendto(socket, reinterpret_cast<const char*>(datagram), datagramSize, 0, reinterpret_cast<const sockaddr*>(&destination), sizeof(destination)) < 0)
+	{
+		int errorCode = GET_NETWORK_ERROR;
+		if (!IS_WOULD_BLOCK_ERROR(errorCode)) // A full socket buffer is just another lost datagram
+			LogAPIErrorMessage("Failed to send datagram", LOG_CATEGORY_DATAGRAM_CHANNEL);
+		return false;
+	}
+	return true;
+}
+
+void DatagramChannel::SendDueDatagrams()
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	while (!m_DelayedDatagrams.empty() && m_DelayedDatagrams.front().DueTime <= now)
+	{
+		const DelayedDatagram& delayedDatagram = m_DelayedDatagrams.front();
+		SendNow(delayedDatagram.SendSocket, delayedDatagram.Destination, delayedDatagram.Data.data(), static_cast<int32_t>(delayedDatagram.Data.size()));
+		m_DelayedDatagrams.pop_front();
+	}
+}
+
+void DatagramChannel::ReceiveFromSocket(Socket socket, std::vector<ReceivedDatagram>& outDatagrams, std::vector<Byte>& outData)
+{
+	Byte datagram[MAX_DATAGRAM_SIZE + 1]; // One extra byte tells oversized datagrams apart from ones that exactly fit
+	for (int32_t i = 0; i < MAX_DATAGRAMS_PER_SOCKET_AND_RECEIVE; ++i)
+	{
+		ReceivedDatagram received;
+		socklen_t sourceSize = sizeof(received.Source);
+		int64_t datagramSize = recvfrom(socket, reinterpret_cast<char*>(datagram), sizeof(datagram), 0, reinterpret_cast<sockaddr*>(&received.Source), &sourceSize);
+		if (datagramSize < 0)
+		{
+			int errorCode = GET_NETWORK_ERROR;
+			if (!IS_WOULD_BLOCK_ERROR(errorCode))
+				LogAPIErrorMessage("Failed to receive datagram", LOG_CATEGORY_DATAGRAM_CHANNEL);
+			return;
+		}
+
+		if (datagramSize < DATAGRAM_HEADER_SIZE || datagramSize > MAX_DATAGRAM_SIZE)
+			continue;
+
+		memcpy(&received.Token, datagram, sizeof(received.Token));
+		memcpy(&received.Sequence, datagram + sizeof(received.Token), sizeof(received.Sequence));
+		received.ReceivingSocket	= socket;
+		received.FrameSize			= static_cast<int32_t>(datagramSize) - DATAGRAM_HEADER_SIZE;
+
+		// A datagram holds a single standard frame and control frames are only sent over the stream
+		if (received.FrameSize > 0)
+		{
+			const Byte* frame = datagram + DATAGRAM_HEADER_SIZE;
+			MessageSize messageSize;
+			ReplicatorID replicatorID;
+			if (received.FrameSize < MESSAGE_HEADER_SIZE)
+				continue;
+			memcpy(&messageSize, frame, sizeof(MessageSize));
+			memcpy(&replicatorID, frame + sizeof(MessageSize), sizeof(ReplicatorID));
+			if (messageSize != received.FrameSize || replicatorID == CONNECTION_CONTROL_REPLICATOR_ID)
+				continue;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_Lock);
+			auto tokenAndID = m_Tokens.find(received.Token);
+			if (tokenAndID == m_Tokens.end()) // Stray datagrams and datagrams for connections that have been closed
+				continue;
+			received.ID = tokenAndID->second;
+		}
+
+		received.FrameOffset = static_cast<int32_t>(outData.size());
+		outData.insert(outData.end(), datagram + DATAGRAM_HEADER_SIZE, datagram + datagramSize);
+		outDatagrams.push_back(received);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+#include "Interface/TubesTypes.h"
+#include "InternalTubesTypes.h"
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#if PLATFORM == PLATFORM_WINDOWS
+#include <WinSock2.h>
+#else
+#include <netinet/in.h> // for sockaddr_in
+#endif
+
+constexpr int32_t DATAGRAM_HEADER_SIZE		= sizeof(uint64_t) + sizeof(uint32_t); // Token and sequence
+constexpr int32_t MAX_DATAGRAM_SIZE			= 1200; // Stays below the path MTU of common networks so that datagrams are never fragmented by IP
+constexpr int32_t MAX_DATAGRAM_FRAME_SIZE	= MAX_DATAGRAM_SIZE - DATAGRAM_HEADER_SIZE;
+
+struct ReceivedDatagram
+{
+	Tubes::ConnectionID	ID				= TUBES_INVALID_CONNECTION_ID;
+	uint64_t			Token			= 0;
+	uint32_t			Sequence		= 0; // 0 for datagrams that aren't sequenced
+	Socket				ReceivingSocket	= INVALID_SOCKET;
+	sockaddr_in			Source;
+	int32_t				FrameOffset		= 0; // Into the data filled in by DatagramChannel::Receive
+	int32_t				FrameSize		= 0; // 0 for hellos which only tell the accepting side where the connecting side can be reached
+};
+
+// UDP sockets that carry the unreliable messages of all connections. A datagram is [token][sequence][standard frame].
+// The token identifies the connection and is handed out by the accepting side over the connection's stream. The accepting side receives on a socket bound to each listening port and learns the port of the peer from the datagrams carrying its token. Datagrams are only accepted from the IP address at the other end of the stream.
+// The connecting side uses a single socket for all its outgoing connections.
+// Settings::DatagramLossRate and Settings::DatagramLatencyMilliseconds drop and delay outgoing datagrams to simulate a bad network.
+// Sending and token registration are thread safe. Receive must only be called from one thread at a time.
+class DatagramChannel
+{
+public:
+	DatagramChannel();
+	~DatagramChannel();
+
+	bool	Open(Port port); // TUBES_PORT_ANY opens the socket used by outgoing connections. Sockets stay open until CloseAll is called so that connections never send through a closed socket
+	void	CloseAll();
+	Socket	GetSocket(Port port) const;
+
+	uint64_t	CreateToken(Tubes::ConnectionID ID); // Creates and registers a token that no other connection uses
+	void		RegisterToken(uint64_t token, Tubes::ConnectionID ID);
+	void		UnregisterToken(uint64_t token);
+
+	bool Send(Socket socket, const sockaddr_in& destination, uint64_t token, uint32_t sequence, const MUtility::Byte* frame, int32_t frameSize); // Returns false if the datagram was dropped, by the simulated loss or because the socket didn't take it
+	void Receive(std::vector<ReceivedDatagram>& outDatagrams, std::vector<MUtility::Byte>& outData); // Appends the datagrams that carry a registered token. Also sends the delayed datagrams that are due
+
+private:
+	struct DelayedDatagram
+	{
+		std::chrono::steady_clock::time_point	DueTime;
+		Socket									SendSocket;
+		sockaddr_in								Destination;
+		std::vector<MUtility::Byte>				Data;
+	};
+
+	bool SendNow(Socket socket, const sockaddr_in& destination, const MUtility::Byte* datagram, int32_t datagramSize);
+	void SendDueDatagrams();
+	void ReceiveFromSocket(Socket socket, std::vector<ReceivedDatagram>& outDatagrams, std::vector<MUtility::Byte>& outData);
+
+	mutable std::mutex								m_Lock; // Guards everything below
+	std::unordered_map<Port, Socket>				m_Sockets;
+	std::unordered_map<uint64_t, Tubes::ConnectionID>	m_Tokens;
+	std::mt19937_64									m_Random;
+	std::deque<DelayedDatagram>						m_DelayedDatagrams; // Ordered by due time since the simulated latency is the same for all datagrams
+};
\ No newline at end of file
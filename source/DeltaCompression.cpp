@@ -0,0 +1,216 @@
+#include "DeltaCompression.h"
+#include "SerializedMessage.h"
+#include "Interface/messaging/MessageAllocator.h"
+#include "Interface/messaging/SerializationCursor.h"
+#include <algorithm>
+
+using MUtility::Byte;
+
+constexpr int32_t	MIN_UNCHANGED_RUN_LENGTH		= 3;	// Shorter unchanged runs are sent as changed bytes since a new run costs at least two bytes
+constexpr size_t	MAX_BASELINE_COUNT				= 4096;	// Per connection and direction. Evicted baselines are recovered through a NACK and a full image
+constexpr int32_t	DELTA_FRAME_HEADER_RESERVE		= MESSAGE_HEADER_SIZE + 4 * CompactEncoding::MAX_VARINT_BYTE_SIZE;
+
+namespace
+{
+	template<typename Baseline>
+	Baseline& UseBaseline(std::unordered_map<Tubes::DeltaKey, Baseline>& baselines, std::list<Tubes::DeltaKey>& keysByRecency, Tubes::DeltaKey key) // Finds or creates the baseline of key and marks it as the most recently used one
+	{
+		auto keyAndBaseline = baselines.find(key);
+		if (keyAndBaseline != baselines.end())
+		{
+			keysByRecency.splice(keysByRecency.begin(), keysByRecency, keyAndBaseline->second.RecencyPosition);
+			return keyAndBaseline->second;
+		}
+
+		if (baselines.size() >= MAX_BASELINE_COUNT)
+		{
+			baselines.erase(keysByRecency.back());
+			keysByRecency.pop_back();
+		}
+
+		keysByRecency.push_front(key);
+		Baseline& baseline			= baselines[key];
+		baseline.RecencyPosition	= keysByRecency.begin();
+		return baseline;
+	}
+
+	void WriteRuns(WriteCursor& writer, const Byte* baseline, int32_t baselineSize, const Byte* image, int32_t imageSize)
+	{
+		int32_t comparableSize	= std::min(baselineSize, imageSize);
+		int32_t position		= 0;
+		while (position < imageSize)
+		{
+			int32_t unchangedStart = position;
+			while (position < comparableSize && image[position] == baseline[position])
+			{
+				++position;
+			}
+
+			// Extend the changed run over unchanged runs that are too short to be worth their own run
+			int32_t changedStart = position;
+			while (position < imageSize)
+			{
+				if (position >= comparableSize || image[position] != baseline[position])
+				{
+					++position;
+					continue;
+				}
+
+				int32_t unchangedEnd = position;
+				while (unchangedEnd < comparableSize && unchangedEnd - position < MIN_UNCHANGED_RUN_LENGTH && image[unchangedEnd] == baseline[unchangedEnd])
+				{
+					++unchangedEnd;
+				}
+
+				if (unchangedEnd - position >= MIN_UNCHANGED_RUN_LENGTH || unchangedEnd == imageSize)
+					break;
+
+				position = unchangedEnd;
+			}
+
+			writer.WriteVarUint(changedStart - unchangedStart);
+			writer.WriteVarUint(position - changedStart);
+			writer.WriteMemory(image + changedStart, position - changedStart);
+		}
+	}
+
+	SerializedMessage* WriteFrame(Tubes::DeltaKey key, uint64_t sequence, uint64_t baselineSequence, const std::vector<Byte>* baseline, const Byte* image, int32_t imageSize, int32_t maxFrameSize)
+	{
+		WriteCursor writer;
+		writer.BeginGrowable(DELTA_FRAME_HEADER_RESERVE + (baseline == nullptr ? imageSize : imageSize / 4));
+		writer.Write(static_cast<MessageSize>(0)); // Patched below
+		writer.Write(static_cast<ReplicatorID>(CONNECTION_CONTROL_REPLICATOR_ID));
+		writer.Write(static_cast<MESSAGE_TYPE_ENUM_UNDELYING_TYPE>(ConnectionControlType::Delta));
+		writer.WriteVarUint(key);
+		writer.WriteVarUint(sequence);
+		writer.WriteVarUint(baselineSequence);
+		writer.WriteVarUint(static_cast<uint64_t>(imageSize));
+
+		if (baseline != nullptr)
+			WriteRuns(writer, baseline->data(), static_cast<int32_t>(baseline->size()), image, imageSize);
+		else if (imageSize > 0)
+		{
+			writer.WriteVarUint(0);
+			writer.WriteVarUint(static_cast<uint64_t>(imageSize));
+			writer.WriteMemory(image, imageSize);
+		}
+
+		MessageSize frameSize = writer.GetWrittenByteCount();
+		writer.WriteAt(0, &frameSize, sizeof(MessageSize));
+
+		MessageSize writtenByteCount;
+		Byte* frame = writer.Release(&writtenByteCount);
+		if (frame == nullptr)
+			return nullptr;
+
+		if (writtenByteCount > maxFrameSize) // The delta didn't pay off
+		{
+			MessageAllocator::Free(frame);
+			return nullptr;
+		}
+
+		return SerializedMessage::Create(frame, writtenByteCount);
+	}
+}
+
+// ---------- PUBLIC ----------
+
+SerializedMessage* DeltaEncoder::Encode(const SerializedMessage* message, Tubes::DeltaKey key)
+{
+	Baseline& baseline	= UseBaseline(m_Baselines, m_KeysByRecency, key);
+	uint64_t sequence	= ++m_LastSequence;
+
+	SerializedMessage* frame = nullptr;
+	if (baseline.Image.empty())
+	{
+		frame = WriteFrame(key, sequence, 0, nullptr, message->GetData(), message->GetSize(), INT32_MAX);
+		baseline.FullSequence = sequence;
+	}
+	else
+		frame = WriteFrame(key, sequence, baseline.Sequence, &baseline.Image, message->GetData(), message->GetSize(), message->GetSize() - 1);
+
+	if (frame == nullptr) // Sending the message as it is is cheaper. The receiver keeps the current baseline so later deltas can still refer to it
+		return nullptr;
+
+	baseline.Sequence = sequence;
+	baseline.Image.assign(message->GetData(), message->GetData() + message->GetSize());
+	return frame;
+}
+
+void DeltaEncoder::HandleNack(Tubes::DeltaKey key, uint64_t failedSequence)
+{
+	auto keyAndBaseline = m_Baselines.find(key);
+	if (keyAndBaseline != m_Baselines.end() && failedSequence > keyAndBaseline->second.FullSequence)
+		keyAndBaseline->second.Image.clear(); // Send the next image in full
+}
+
+DeltaDecoder::Result DeltaDecoder::Decode(ReadCursor& reader, const Byte*& outImage, Tubes::DeltaKey& outKey, uint64_t& outSequence)
+{
+	uint64_t key;
+	uint64_t baselineSequence;
+	uint64_t imageSize;
+	reader.ReadVarUint(key);
+	reader.ReadVarUint(outSequence);
+	reader.ReadVarUint(baselineSequence);
+	reader.ReadVarUint(imageSize);
+	outKey = static_cast<Tubes::DeltaKey>(key);
+	if (reader.HasFailed() || key > UINT32_MAX)
+		return Result::Malformed;
+
+	const std::vector<Byte>* baselineImage = nullptr;
+	auto keyAndBaseline = m_Baselines.find(outKey);
+	if (baselineSequence != 0)
+	{
+		if (keyAndBaseline == m_Baselines.end() || keyAndBaseline->second.Sequence != baselineSequence)
+			return Result::MissingBaseline;
+
+		baselineImage = &keyAndBaseline->second.Image;
+	}
+
+	// Every byte of the image comes from either the baseline or the frame, which bounds what a malformed frame can make us allocate
+	size_t availableByteCount = reader.GetRemainingByteCount() + (baselineImage != nullptr ? baselineImage->size() : 0);
+	if (imageSize > availableByteCount || imageSize < static_cast<uint64_t>(MESSAGE_HEADER_SIZE))
+		return Result::Malformed;
+
+	std::vector<Byte> image(static_cast<size_t>(imageSize));
+	size_t position = 0;
+	while (position < image.size())
+	{
+		uint64_t unchangedByteCount;
+		uint64_t changedByteCount;
+		reader.ReadVarUint(unchangedByteCount);
+		reader.ReadVarUint(changedByteCount);
+		if (reader.HasFailed() || (unchangedByteCount == 0 && changedByteCount == 0))
+			return Result::Malformed;
+
+		if (unchangedByteCount > 0)
+		{
+			if (baselineImage == nullptr || unchangedByteCount > image.size() - position || position + unchangedByteCount > baselineImage->size())
+				return Result::Malformed;
+
+			memcpy(image.data() + position, baselineImage->data() + position, static_cast<size_t>(unchangedByteCount));
+			position += static_cast<size_t>(unchangedByteCount);
+		}
+
+		const Byte* changedBytes = changedByteCount <= image.size() - position ? reader.Claim(static_cast<size_t>(changedByteCount)) : nullptr;
+		if (changedBytes == nullptr && changedByteCount > 0)
+			return Result::Malformed;
+
+		memcpy(image.data() + position, changedBytes, static_cast<size_t>(changedByteCount));
+		position += static_cast<size_t>(changedByteCount);
+	}
+
+	// The image must be a single complete frame that isn't itself a control frame
+	MessageSize embeddedSize;
+	ReplicatorID embeddedReplicatorID;
+	memcpy(&embeddedSize, image.data(), sizeof(MessageSize));
+	memcpy(&embeddedReplicatorID, image.data() + sizeof(MessageSize), sizeof(ReplicatorID));
+	if (static_cast<uint64_t>(embeddedSize) != imageSize || embeddedReplicatorID == CONNECTION_CONTROL_REPLICATOR_ID)
+		return Result::Malformed;
+
+	Baseline& baseline = UseBaseline(m_Baselines, m_KeysByRecency, outKey);
+	baseline.Sequence = outSequence;
+	baseline.Image.swap(image);
+	outImage = baseline.Image.data();
+	return Result::Decoded;
+}
\ No newline at end of file
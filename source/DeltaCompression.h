@@ -0,0 +1,59 @@
+#pragma once
+#include "Interface/TubesTypes.h"
+#include "InternalTubesTypes.h"
+#include <MUtilityByte.h>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+class	SerializedMessage;
+class	ReadCursor;
+
+// Delta compression of repeated state messages. The image of a message is its full serialized frame and is compared byte by byte against the last image sent with the same key.
+// A delta frame holds alternating runs of unchanged and changed bytes, where the unchanged bytes are copied from the receivers baseline.
+// TCP delivers the frames in order, so every image that has been queued is the receivers next baseline; a receiver that lacks the referenced baseline answers with a NACK and the next image is sent in full.
+// Both sides keep at most MAX_BASELINE_COUNT baselines and evict the least recently used one, so the receiver usually evicts the same key as the sender.
+// Delta frame payload: [Varint key][Varint sequence][Varint baseline sequence (0 for a full image)][Varint image size][Runs...] where each run is [Varint unchanged byte count][Varint changed byte count][Changed bytes]
+class DeltaEncoder
+{
+public:
+	SerializedMessage*	Encode(const SerializedMessage* message, Tubes::DeltaKey key); // Returns a delta control frame holding one reference, or nullptr if the message should be sent as it is (The delta isn't smaller than the message or the frame couldn't be written)
+	void				HandleNack(Tubes::DeltaKey key, uint64_t failedSequence);
+
+private:
+	struct Baseline
+	{
+		uint64_t								Sequence		= 0;
+		uint64_t								FullSequence	= 0; // Sequence of the last full image. Frames sent before it don't need to trigger another one
+		std::vector<MUtility::Byte>				Image;
+		std::list<Tubes::DeltaKey>::iterator	RecencyPosition;
+	};
+
+	std::unordered_map<Tubes::DeltaKey, Baseline>	m_Baselines;
+	std::list<Tubes::DeltaKey>						m_KeysByRecency;		// Most recently used first
+	uint64_t										m_LastSequence	= 0;	// Shared by all keys so that a baseline recreated after an eviction never reuses a sequence the receiver may still hold
+};
+
+class DeltaDecoder
+{
+public:
+	enum class Result
+	{
+		Decoded,
+		MissingBaseline,
+		Malformed,
+	};
+
+	Result Decode(ReadCursor& reader, const MUtility::Byte*& outImage, Tubes::DeltaKey& outKey, uint64_t& outSequence); // outImage is valid until the next call to Decode
+
+private:
+	struct Baseline
+	{
+		uint64_t								Sequence = 0;
+		std::vector<MUtility::Byte>				Image;
+		std::list<Tubes::DeltaKey>::iterator	RecencyPosition;
+	};
+
+	std::unordered_map<Tubes::DeltaKey, Baseline>	m_Baselines;
+	std::list<Tubes::DeltaKey>						m_KeysByRecency; // Most recently used first
+};
\ No newline at end of file
@@ -6,6 +6,8 @@
 #define MESSAGE_TYPE_HALF_BIT_SIZE (sizeof( MESSAGE_TYPE_ENUM_UNDELYING_TYPE) * 4) // *4 since we want the bit count instead of byte count and we want half the size (8/2)
 #define MESSAGE_TYPE_BITFLAG_MIDDLE (1ULL << MESSAGE_TYPE_HALF_BIT_SIZE)
 
+constexpr MessageSize MESSAGE_HEADER_SIZE = sizeof(MessageSize) + sizeof(ReplicatorID) + sizeof(MESSAGE_TYPE_ENUM_UNDELYING_TYPE); // Size, replicator ID and type
+
 struct Message
 {
 public:
@@ -17,5 +19,5 @@ public:
 	ReplicatorID						Replicator_ID	= INVALID_REPLICATOR_ID; // TODODB: See if the _ in Replicator_ID can be removed somehow
 
 protected:
-	~Message() {}; // Messages are always allocated using malloc and thus the destructor should never be called. Use Destroy() instead
+	~Message() {}; // Messages are always allocated using MessageAllocator::Allocate (Or malloc) and thus the destructor should never be called. Use Destroy() followed by MessageAllocator::Free() instead
 };
\ No newline at end of file
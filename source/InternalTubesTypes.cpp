@@ -1,22 +1,178 @@
 #include "InternalTubesTypes.h"
 #include "Interface/messaging/MessagingTypes.h"
-#include "TubesUtility.h"
+#include "Interface/messaging/SerializationCursor.h"
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+constexpr int32_t RECEIVE_BUFFER_DEFAULT_CAPACITY	= 8 * 1024;
+constexpr int32_t RECEIVE_BUFFER_HEADROOM			= MESSAGE_HEADER_SIZE; // Room for expanding the header of a compact frame at the start of the buffer
+
+static bool GetGrownCapacity(int32_t capacity, int32_t usedByteCount, int32_t freeByteCount, int32_t& outCapacity) // Doubles the capacity until freeByteCount bytes fit after usedByteCount. Fails if that can't be addressed with 32 bits
+{
+	int64_t requiredCapacity = static_cast<int64_t>(usedByteCount) + freeByteCount;
+	if (requiredCapacity > INT32_MAX)
+		return false;
+
+	int64_t newCapacity = capacity > 0 ? capacity : RECEIVE_BUFFER_DEFAULT_CAPACITY;
+	while (newCapacity < requiredCapacity)
+	{
+		newCapacity *= 2;
+	}
+
+	outCapacity = static_cast<int32_t>(std::min<int64_t>(newCapacity, INT32_MAX));
+	return true;
+}
 
 ReceiveBuffer::ReceiveBuffer()
 {
+	Data		= nullptr;
+	Capacity	= 0;
+	Pinned		= false;
 	Reset();
 }
 
 ReceiveBuffer::~ReceiveBuffer()
 {
-	if (PayloadData != nullptr)
-		free(PayloadData);
+	if (Data != nullptr)
+		free(Data);
+
+	Unpin();
 }
 
 void ReceiveBuffer::Reset()
 {
-	ExpectedHeaderBytes		= sizeof(MessageSize);
-	ExpectedPayloadBytes	= NOT_EXPECTING_PAYLOAD;
-	PayloadData				= nullptr;
-	Walker					= reinterpret_cast<MUtility::Byte*>(&ExpectedPayloadBytes);
+	if (Pinned) // Drop the buffered bytes without rewinding so that the pinned bytes aren't overwritten
+		ReadOffset	= WriteOffset;
+	else
+	{
+		ReadOffset	= RECEIVE_BUFFER_HEADROOM;
+		WriteOffset	= RECEIVE_BUFFER_HEADROOM;
+	}
+	SocketDrained	= false;
+}
+
+bool ReceiveBuffer::Reserve(int32_t freeByteCount)
+{
+	if (GetFreeByteCount() >= freeByteCount)
+		return true;
+
+	int32_t bufferedByteCount = GetBufferedByteCount();
+	int32_t newCapacity;
+	if (Pinned)
+	{
+		// Views point into the current buffer so move the unconsumed bytes into a new one instead of compacting or reallocating
+		if (!GetGrownCapacity(Capacity, RECEIVE_BUFFER_HEADROOM + bufferedByteCount, freeByteCount, newCapacity))
+			return false;
+
+		MUtility::Byte* newData = static_cast<MUtility::Byte*>(malloc(newCapacity));
+		if (newData == nullptr)
+			return false;
+
+		memcpy(newData + RECEIVE_BUFFER_HEADROOM, Data + ReadOffset, bufferedByteCount);
+		RetiredData.push_back(Data);
+
+		Data		= newData;
+		Capacity	= newCapacity;
+		ReadOffset	= RECEIVE_BUFFER_HEADROOM;
+		WriteOffset	= RECEIVE_BUFFER_HEADROOM + bufferedByteCount;
+		Pinned		= false; // Nothing in the new buffer is referenced yet
+		return true;
+	}
+
+	// Move the unconsumed bytes to the front of the buffer
+	if (ReadOffset > RECEIVE_BUFFER_HEADROOM)
+	{
+		memmove(Data + RECEIVE_BUFFER_HEADROOM, Data + ReadOffset, bufferedByteCount);
+		ReadOffset	= RECEIVE_BUFFER_HEADROOM;
+		WriteOffset	= RECEIVE_BUFFER_HEADROOM + bufferedByteCount;
+	}
+
+	// Grow the buffer if compacting wasn't enough
+	if (GetFreeByteCount() < freeByteCount)
+	{
+		if (!GetGrownCapacity(Capacity, WriteOffset, freeByteCount, newCapacity))
+			return false;
+
+		MUtility::Byte* newData = static_cast<MUtility::Byte*>(realloc(Data, newCapacity));
+		if (newData == nullptr)
+			return false;
+
+		Data		= newData;
+		Capacity	= newCapacity;
+	}
+	return true;
+}
+
+void ReceiveBuffer::Consume(int32_t byteCount)
+{
+	ReadOffset += byteCount;
+	if (ReadOffset == WriteOffset && !Pinned) // Rewind when empty so that no bytes have to be moved on the next recv
+	{
+		ReadOffset	= RECEIVE_BUFFER_HEADROOM;
+		WriteOffset	= RECEIVE_BUFFER_HEADROOM;
+	}
+}
+
+void ReceiveBuffer::Pin()
+{
+	Pinned = true;
+}
+
+void ReceiveBuffer::Unpin()
+{
+	Pinned = false;
+	for (int i = 0; i < RetiredData.size(); ++i)
+	{
+		free(RetiredData[i]);
+	}
+	RetiredData.clear();
+
+	if (ReadOffset == WriteOffset) // Rewinding was held back while pinned
+	{
+		ReadOffset	= RECEIVE_BUFFER_HEADROOM;
+		WriteOffset	= RECEIVE_BUFFER_HEADROOM;
+	}
+}
+
+void ReceiveBuffer::HandOverPinnedData(std::vector<MUtility::Byte*>& outData)
+{
+	if (Pinned)
+	{
+		outData.push_back(Data);
+		Data		= nullptr;
+		Capacity	= 0;
+		Pinned		= false;
+		Reset();
+	}
+
+	outData.insert(outData.end(), RetiredData.begin(), RetiredData.end());
+	RetiredData.clear();
+}
+
+bool ReceiveBuffer::ContainsFullMessage(MessageSize& outMessageSize) const
+{
+	int32_t bufferedByteCount = GetBufferedByteCount();
+	if (bufferedByteCount < static_cast<int32_t>(sizeof(MessageSize)))
+		return false;
+
+	memcpy(&outMessageSize, Data + ReadOffset, sizeof(MessageSize));
+	return bufferedByteCount >= outMessageSize;
+}
+
+bool ReceiveBuffer::ContainsFullCompactMessage(int32_t& outFrameSize) const
+{
+	uint64_t bodySize;
+	int32_t sizeByteCount = CompactEncoding::DecodeVarint(Data + ReadOffset, GetBufferedByteCount(), bodySize);
+	if (sizeByteCount == 0)
+		return false;
+
+	if (sizeByteCount < 0 || bodySize > INT32_MAX - sizeByteCount)
+	{
+		outFrameSize = -1;
+		return true; // Let the caller handle the malformed frame right away
+	}
+
+	outFrameSize = sizeByteCount + static_cast<int32_t>(bodySize);
+	return GetBufferedByteCount() >= outFrameSize;
 }
\ No newline at end of file
@@ -2,10 +2,12 @@
 #include <stdint.h>
 #include <thread>
 #include <atomic>
+#include <vector>
 #include <MUtilityPlatformDefinitions.h>
 #include <MUtilityByte.h>
 #include <MUtilityDataSizes.h>
 #include "Interface/messaging/MessagingTypes.h"
+#include "Interface/Messaging/Message.h"
 #include "TubesErrors.h"
 
 #if PLATFORM != PLATFORM_WINDOWS // winsock already defines this on windows
@@ -21,21 +23,63 @@ typedef int64_t		Socket;
 typedef int socklen_t;
 #endif
 
+#define CONNECTION_CONTROL_REPLICATOR_ID INVALID_REPLICATOR_ID // Frames with this replicator ID are handled by the connection itself. Peers without support for them log and drop them since no replicator can use the ID
+
+enum class ConnectionControlType : MESSAGE_TYPE_ENUM_UNDELYING_TYPE
+{
+	Capabilities, // Payload is the offered and the active capabilities of the sender. The sender uses the active capabilities for everything it sends after this frame
+	Delta, // A delta compressed message. See DeltaCompression.h
+	DeltaNack, // Payload is the varint key and sequence of a delta frame whose baseline was missing
+	Compressed, // Payload is the varint size of the decompressed data followed by an LZ4 block holding one or more standard frames
+	DatagramToken, // Payload is the token that the receiver puts in its datagrams. See DatagramChannel.h
+	DatagramConfirmed, // Tells the connecting side that its datagrams have arrived so that it can stop sending hellos
+};
+
+namespace ConnectionCapabilities
+{
+	enum Flags : uint8_t
+	{
+		COMPACT_FRAMES		= 1 << 0, // Frame header with varint size and type instead of the fixed width header
+		DELTA_FRAMES		= 1 << 1, // Delta compressed state messages
+		COMPRESSED_FRAMES	= 1 << 2, // LZ4 compressed batches of frames
+	};
+}
+
+constexpr int32_t COMPACT_FRAME_HEADER_MAX_SIZE = 5 + sizeof(ReplicatorID) + 10; // Varint size, replicator ID and varint type
+
 enum class ConnectionState
 {
 	NewOutgoing,
 	NewIncoming,
 };
 
+// Contiguous per connection buffer that a single recv can fill with as many messages as the kernel has available.
+// Messages are framed and deserialized directly from the buffer; unconsumed bytes are moved to the front before the next recv.
+// A compact frame header is expanded into a full header in the bytes just before the payload, so the buffer keeps MESSAGE_HEADER_SIZE bytes of headroom before the first message.
+// While message views into the buffer are alive the buffer is pinned and bytes are never moved; a full buffer is then replaced instead and the old one is kept until Unpin is called.
 struct ReceiveBuffer
 {
 	ReceiveBuffer();
 	~ReceiveBuffer();
 
 	void Reset();
+	bool Reserve(int32_t freeByteCount); // Makes sure at least freeByteCount bytes can be written at WriteOffset. Returns false and leaves the buffer as it was if it couldn't grow
+	void Consume(int32_t byteCount);
+	void Pin(); // Keeps every byte from ReadOffset and onwards at its current address until Unpin is called
+	void Unpin();
+	void HandOverPinnedData(std::vector<MUtility::Byte*>& outData); // Moves the buffers that pinned bytes lie in to outData, which then owns them. The buffer is left empty
+
+	bool ContainsFullMessage(MessageSize& outMessageSize) const; // outMessageSize is set as soon as the size header is available
+	bool ContainsFullCompactMessage(int32_t& outFrameSize) const; // outFrameSize is set as soon as the varint size is available and is -1 if the size is malformed
+	
+	int32_t GetBufferedByteCount() const	{ return WriteOffset - ReadOffset; }
+	int32_t GetFreeByteCount() const		{ return Capacity - WriteOffset; }
 
-	int16_t				ExpectedHeaderBytes;	// How many more bytes of header we expect for the current packet
-	MessageSize			ExpectedPayloadBytes;	// How many more bytes of payload we expect for the current packet
-	MUtility::Byte*		PayloadData;			// Dynamic buffer for packet payload
-	MUtility::Byte*		Walker;					// Pointer to where the next recv should write to
+	MUtility::Byte*		Data;			// Allocated on first use so that idle connections don't hold any buffer memory
+	int32_t				Capacity;
+	int32_t				ReadOffset;		// Start of the first unconsumed message
+	int32_t				WriteOffset;	// Where the next recv should write to
+	bool				SocketDrained;	// The last recv didn't fill the free space, meaning that the kernel buffer was empty at that point
+	bool				Pinned;
+	std::vector<MUtility::Byte*>	RetiredData;	// Replaced buffers that pinned views may still point into
 };
\ No newline at end of file
@@ -1,68 +1,115 @@
 #include "Listener.h"
 #include "Connection.h"
+#include "Interface/TubesSettings.h"
 #include "TubesUtility.h"
-#include <MUtilityThreading.h>
+#include <MUtilityLog.h>
+
+#if PLATFORM != PLATFORM_WINDOWS
+#include <fcntl.h>
+#endif
 
 #define LOG_CATEGORY_LISTENER "TubesListener"
 
+using namespace Tubes;
+using namespace TubesUtility;
+
+// ---------- PUBLIC ----------
+
 Listener::Listener()
 {
-	m_Thread = nullptr;
-	m_ListeningSocket = INVALID_SOCKET;
-	m_ShouldTerminateListeningThread = new std::atomic<bool>(false);
 }
 
 Listener::~Listener()
 {
-	delete m_Thread;
-	delete m_ShouldTerminateListeningThread;
+	StopListening();
 }
 
-bool Listener::StartListening(Port port)
+bool Listener::StartListening(Port port, uint32_t socketCount)
 {
-	m_ListeningSocket = static_cast<Socket>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)); // Will be used to listen for incoming connections
-	if (m_ListeningSocket == INVALID_SOCKET)
+#if PLATFORM != PLATFORM_LINUX
+	if (socketCount > 1)
 	{
-		LogAPIErrorMessage("Failed to set up listening socket", LOG_CATEGORY_LISTENER);
-		return false;
+		MLOG_WARNING("SO_REUSEPORT listeners are only supported on Linux; port " << port << " will be served by a single listening socket", LOG_CATEGORY_LISTENER);
+		socketCount = 1;
 	}
+#endif
 
-	// Allow reuse of listening socket port
-	char reuse = 1;
-	setsockopt(m_ListeningSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(char)); // TODODB: Check return value
+	for (uint32_t i = 0; i < socketCount; ++i)
+	{
+		Socket listeningSocket = OpenListeningSocket(port, socketCount > 1);
+		if (listeningSocket == INVALID_SOCKET)
+		{
+			StopListening();
+			return false;
+		}
+		m_ListeningSockets.push_back(listeningSocket);
+	}
 
-	// Set up the sockaddr for the listenign socket
-	sockaddr_in sockAddr;
-	memset(&sockAddr, 0, sizeof(sockAddr));
-	sockAddr.sin_family = AF_INET;
-	sockAddr.sin_addr.s_addr = htonl(INADDR_ANY);
-	sockAddr.sin_port = htons(port);
+	if (socketCount > 1)
+		MLOG_INFO("Listening for incoming connections on port " << port << " with " << socketCount << " SO_REUSEPORT sockets", LOG_CATEGORY_LISTENER);
+	else
+		MLOG_INFO("Listening for incoming connections on port " << port, LOG_CATEGORY_LISTENER);
+	return true;
+}
 
-	// Bind the listening socket object to an actual socket.
-	if (bind(m_ListeningSocket, (sockaddr*)&sockAddr, sizeof(sockAddr)) < 0)
+void Listener::StopListening()
+{
+	for (int i = 0; i < m_ListeningSockets.size(); ++i)
 	{
-		LogAPIErrorMessage("Failed to bind listening socket", LOG_CATEGORY_LISTENER);
-		return false;
+		CloseSocket(m_ListeningSockets[i]);
 	}
+	m_ListeningSockets.clear();
 
-	// Start listening for incoming connections
-	if (listen(m_ListeningSocket, MAX_LISTENING_BACKLOG) < 0)
+	std::lock_guard<std::mutex> lock(m_AcceptedConnectionsLock);
+	for (int i = 0; i < m_AcceptedConnections.size(); ++i)
 	{
-		LogAPIErrorMessage("Failed to start listening socket", LOG_CATEGORY_LISTENER);
-		return false;
+		m_AcceptedConnections[i]->Disconnect();
+		delete m_AcceptedConnections[i];
 	}
-
-	m_Thread = new std::thread(&Listener::Listen, this);
-
-	MLOG_INFO("Listening for incoming connections on port " << port, LOG_CATEGORY_LISTENER);
-	return true;
+	m_AcceptedConnections.clear();
 }
 
-void Listener::StopListening()
+void Listener::Accept(uint32_t socketIndex)
 {
-	*m_ShouldTerminateListeningThread = true;
-	TubesUtility::CloseSocket(m_ListeningSocket);
-	MUtilityThreading::JoinThread(*m_Thread);
+	if (socketIndex >= m_ListeningSockets.size())
+		return;
+
+	std::vector<Connection*> acceptedConnections;
+	while (true)
+	{
+		sockaddr_in incomingConnectionInfo;
+		socklen_t incomingConnectionInfoLength = sizeof(incomingConnectionInfo);
+#if PLATFORM == PLATFORM_LINUX
+		Socket incomingConnectionSocket = static_cast<Socket>(accept4(static_cast<int>(m_ListeningSockets[socketIndex]), reinterpret_cast<sockaddr*>(&incomingConnectionInfo), &incomingConnectionInfoLength, SOCK_NONBLOCK)); // Saves the system calls for making the socket non blocking
+#else
+		Socket incomingConnectionSocket = static_cast<Socket>(accept(m_ListeningSockets[socketIndex], reinterpret_cast<sockaddr*>(&incomingConnectionInfo), &incomingConnectionInfoLength));
+#endif
+		if (incomingConnectionSocket == INVALID_SOCKET)
+		{
+			int error = GET_NETWORK_ERROR;
+			if (error == TUBES_EWOULDBLOCK) // All pending connections have been accepted
+				break;
+
+			if (error == TUBES_EINTR || error == TUBES_ECONNECTIONABORTED) // The connection was reset while waiting in the backlog
+				continue;
+
+			LogAPIErrorMessage("An incoming connection attempt failed", LOG_CATEGORY_LISTENER); // Out of descriptors or memory. The remaining connections wait in the backlog until the next call
+			break;
+		}
+
+		Connection* connection = new Connection(incomingConnectionSocket, incomingConnectionInfo);
+#if PLATFORM != PLATFORM_LINUX
+		connection->SetBlockingMode(false);
+#endif
+		connection->SetNoDelay(true);
+		acceptedConnections.push_back(connection);
+	}
+
+	if (!acceptedConnections.empty())
+	{
+		std::lock_guard<std::mutex> lock(m_AcceptedConnectionsLock);
+		m_AcceptedConnections.insert(m_AcceptedConnections.end(), acceptedConnections.begin(), acceptedConnections.end());
+	}
 }
 
 void Listener::FetchAcceptedConnections(std::vector<std::pair<Connection*, ConnectionState>>& outConnections)
@@ -76,30 +123,72 @@ void Listener::FetchAcceptedConnections(std::vector<std::pair<Connection*, Conne
 	m_AcceptedConnectionsLock.unlock();
 }
 
-void Listener::Listen()
+uint32_t Listener::GetSocketCount() const
+{
+	return static_cast<uint32_t>(m_ListeningSockets.size());
+}
+
+// ---------- PRIVATE ----------
+
+Socket Listener::OpenListeningSocket(Port port, bool reusePort)
 {
-	do
+	Socket listeningSocket = static_cast<Socket>(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)); // Will be used to listen for incoming connections
+	if (listeningSocket == INVALID_SOCKET)
 	{
-		Socket incomingConnectionSocket;
-		sockaddr_in incomingConnectionInfo;
-		socklen_t incomingConnectionInfoLength = sizeof(incomingConnectionInfo);
+		LogAPIErrorMessage("Failed to set up listening socket", LOG_CATEGORY_LISTENER);
+		return INVALID_SOCKET;
+	}
 
-		// Wait for a connection or fetch one from the backlog
-		incomingConnectionSocket = static_cast<Socket>(accept(m_ListeningSocket, reinterpret_cast<sockaddr*>(&incomingConnectionInfo), &incomingConnectionInfoLength)); // Blocking
-		if (incomingConnectionSocket != INVALID_SOCKET)
-		{
-			Connection* connection = new Connection(incomingConnectionSocket, incomingConnectionInfo);
-			connection->SetBlockingMode(false);
-			connection->SetNoDelay(true);
-			m_AcceptedConnectionsLock.lock();
-			m_AcceptedConnections.push_back(connection);
-			m_AcceptedConnectionsLock.unlock();
-		}
-		else
-		{
-			int error = GET_NETWORK_ERROR;
-			if (error != TUBES_EINTR) // The socket was killed on purpose
-				LogAPIErrorMessage("An incoming connection attempt failed", LOG_CATEGORY_LISTENER); // TODODB: See if we cant get the ip and print it here
-		}
-	} while (!*m_ShouldTerminateListeningThread);
+	// Allow reuse of listening socket port
+	int reuse = 1; // Linux rejects option values smaller than an int
+	if (setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse)) != 0)
+		LogAPIErrorMessage("Failed to allow reuse of the address of the listening socket", LOG_CATEGORY_LISTENER);
+
+#if PLATFORM == PLATFORM_LINUX
+	if (reusePort && setsockopt(listeningSocket, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) != 0)
+	{
+		LogAPIErrorMessage("Failed to enable SO_REUSEPORT on listening socket", LOG_CATEGORY_LISTENER);
+		CloseSocket(listeningSocket);
+		return INVALID_SOCKET;
+	}
+#endif
+
+	// Set up the sockaddr for the listening socket
+	sockaddr_in sockAddr;
+	memset(&sockAddr, 0, sizeof(sockAddr));
+	sockAddr.sin_family = AF_INET;
+	sockAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	sockAddr.sin_port = htons(port);
+
+	// Bind the listening socket object to an actual socket.
+	if (bind(listeningSocket, (sockaddr*)&sockAddr, sizeof(sockAddr)) < 0)
+	{
+		LogAPIErrorMessage("Failed to bind listening socket", LOG_CATEGORY_LISTENER);
+		CloseSocket(listeningSocket);
+		return INVALID_SOCKET;
+	}
+
+#if PLATFORM == PLATFORM_WINDOWS
+	u_long nonBlocking = 1;
+	bool setNonBlocking = ioctlsocket(listeningSocket, FIONBIO, &nonBlocking) == 0;
+#else
+	int flags = fcntl(static_cast<int>(listeningSocket), F_GETFL, 0);
+	bool setNonBlocking = flags >= 0 && fcntl(static_cast<int>(listeningSocket), F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+	if (!setNonBlocking)
+	{
+		LogAPIErrorMessage("Failed to make listening socket non blocking", LOG_CATEGORY_LISTENER);
+		CloseSocket(listeningSocket);
+		return INVALID_SOCKET;
+	}
+
+	// Start listening for incoming connections
+	if (listen(listeningSocket, static_cast<int>(Settings::ListenBacklog)) < 0)
+	{
+		LogAPIErrorMessage("Failed to start listening socket", LOG_CATEGORY_LISTENER);
+		CloseSocket(listeningSocket);
+		return INVALID_SOCKET;
+	}
+
+	return listeningSocket;
 }
\ No newline at end of file
@@ -1,31 +1,30 @@
 #pragma once
 #include "InternalTubesTypes.h"
-#include <atomic>
 #include <mutex>
-#include <thread>
 #include <vector>
 
-#define	MAX_LISTENING_BACKLOG 16 // How many incoming connections that can be connecting at the same time
-
 class Connection;
 
+// Accepts incoming connections on a non-blocking listening socket. Every call to Accept drains all connections that are pending at that point.
+// With Settings::UseReusePortListeners there is one SO_REUSEPORT socket per shard so that the kernel spreads the incoming connections, and the accept work, across the network threads.
 class Listener
 {
 public:
 	Listener();
 	~Listener();
 
-	bool StartListening(Port port);
+	bool StartListening(Port port, uint32_t socketCount = 1);
 	void StopListening();
 
+	void Accept(uint32_t socketIndex); // Thread safe as long as each socket is only accepted from by one thread at a time
 	void FetchAcceptedConnections(std::vector<std::pair<Connection*, ConnectionState>>& outConnections);
 
+	uint32_t GetSocketCount() const;
+
 private:
-	void Listen();
+	Socket OpenListeningSocket(Port port, bool reusePort);
 
-	Socket				m_ListeningSocket;
-	std::thread*		m_Thread;
-	std::atomic<bool>*	m_ShouldTerminateListeningThread;
+	std::vector<Socket>	m_ListeningSockets;
 
 	std::mutex					m_AcceptedConnectionsLock;
 	std::vector<Connection*>	m_AcceptedConnections;
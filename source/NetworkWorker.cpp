@@ -0,0 +1,233 @@
+#include "NetworkWorker.h"
+#include "ConnectionManager.h"
+#include "SerializedMessage.h"
+#include "TubesMessageBase.h"
+#include "TubesMessageReplicator.h"
+#include "Interface/messaging/MessageAllocator.h"
+#include <MUtilityLog.h>
+#include <MUtilityThreading.h>
+#include <chrono>
+
+#define LOG_CATEGORY_NETWORK_WORKER "TubesNetworkWorker"
+
+using namespace Tubes;
+
+constexpr std::chrono::milliseconds NETWORK_THREAD_IDLE_WAIT = std::chrono::milliseconds(1); // Upper bound on the added receive latency while the network thread is idle
+
+// ---------- PUBLIC ----------
+
+NetworkWorker::NetworkWorker(uint32_t shardIndex, ConnectionManager& connectionManager, std::mutex& connectionManagerLock, TubesMessageReplicator& tubesMessageReplicator, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators)
+	: m_ShardIndex(shardIndex), m_ConnectionManager(connectionManager), m_ConnectionManagerLock(connectionManagerLock), m_TubesMessageReplicator(tubesMessageReplicator), m_Replicators(replicators)
+{
+	m_RunThread		= false;
+	m_WakeRequested	= false;
+}
+
+NetworkWorker::~NetworkWorker()
+{
+	Stop();
+}
+
+void NetworkWorker::Start()
+{
+	if (m_RunThread)
+		return;
+
+	m_RunThread = true;
+	m_Thread = std::thread(&NetworkWorker::Run, this);
+	MLOG_INFO("Network thread for shard " << m_ShardIndex << " started", LOG_CATEGORY_NETWORK_WORKER);
+}
+
+void NetworkWorker::Stop()
+{
+	if (!m_RunThread)
+		return;
+
+	m_RunThread = false;
+	m_WakeCondition.notify_one();
+	MUtilityThreading::JoinThread(m_Thread);
+
+	// Release everything that was left in transit
+	Command command;
+	while (m_Commands.Consume(command))
+	{
+		if (command.Payload != nullptr)
+			command.Payload->Release();
+	}
+
+	ReceivedMessage receivedMessage;
+	while (m_ReceivedMessages.Consume(receivedMessage))
+	{
+		receivedMessage.Payload->Destroy();
+		MessageAllocator::Free(receivedMessage.Payload);
+	}
+
+	for (int i = 0; i < m_ReceivedTubesMessages.size(); ++i)
+	{
+		MessageAllocator::Free(m_ReceivedTubesMessages[i]);
+	}
+	m_ReceivedTubesMessages.clear();
+
+	MLOG_INFO("Network thread for shard " << m_ShardIndex << " stopped", LOG_CATEGORY_NETWORK_WORKER);
+}
+
+void NetworkWorker::EnqueueSend(SerializedMessage* message, ConnectionID destinationID, DeliveryMode deliveryMode, MessagePriority priority)
+{
+	Command command(CommandType::Send, destinationID, message);
+	command.Mode		= deliveryMode;
+	command.Priority	= priority;
+	EnqueueCommand(command);
+}
+
+void NetworkWorker::EnqueueDeltaSend(SerializedMessage* message, ConnectionID destinationID, DeltaKey key)
+{
+	EnqueueCommand(Command(CommandType::SendDelta, destinationID, message, key));
+}
+
+void NetworkWorker::EnqueueBroadcast(SerializedMessage* message, ConnectionID exception, DeliveryMode deliveryMode, MessagePriority priority)
+{
+	Command command(CommandType::Broadcast, exception, message);
+	command.Mode		= deliveryMode;
+	command.Priority	= priority;
+	EnqueueCommand(command);
+}
+
+void NetworkWorker::EnqueueFlush(ConnectionID ID)
+{
+	EnqueueCommand(Command(CommandType::Flush, ID, nullptr));
+}
+
+void NetworkWorker::EnqueueDisconnect(ConnectionID ID)
+{
+	EnqueueCommand(Command(CommandType::Disconnect, ID, nullptr));
+}
+
+void NetworkWorker::EnqueueDisconnectAll()
+{
+	EnqueueCommand(Command(CommandType::DisconnectAll, TUBES_INVALID_CONNECTION_ID, nullptr));
+}
+
+void NetworkWorker::EnqueueReplicatorRegistration(MessageReplicator* replicator)
+{
+	Command command(CommandType::RegisterReplicator, TUBES_INVALID_CONNECTION_ID, nullptr);
+	command.Replicator = replicator;
+	EnqueueCommand(command);
+}
+
+void NetworkWorker::FetchReceivedMessages(std::vector<Message*>& outMessages, std::vector<ConnectionID>* outSenderIDs)
+{
+	ReceivedMessage receivedMessage;
+	while (m_ReceivedMessages.Consume(receivedMessage))
+	{
+		outMessages.push_back(receivedMessage.Payload);
+		if (outSenderIDs)
+			outSenderIDs->push_back(receivedMessage.SenderID);
+	}
+}
+
+// ---------- PRIVATE ----------
+
+void NetworkWorker::Run()
+{
+	std::vector<Message*>		receivedMessages;
+	std::vector<ConnectionID>	senderIDs;
+	while (m_RunThread)
+	{
+		bool performedWork = ProcessCommands();
+		m_ConnectionManager.AcceptConnections(m_ShardIndex);
+		if (m_ShardIndex == 0)
+		{
+			std::lock_guard<std::mutex> lock(m_ConnectionManagerLock);
+			m_ConnectionManager.UpdateConnectionAttempts();
+			m_ConnectionManager.VerifyNewConnections(m_TubesMessageReplicator);
+		}
+
+		// The shard is guarded by its own lock so the shards can be served in parallel
+		m_ConnectionManager.ReceiveMessages(m_ShardIndex, m_Replicators, receivedMessages, &senderIDs, m_ReceivedTubesMessages);
+		m_ConnectionManager.SendQueuedMessages(m_ShardIndex);
+
+		for (int i = 0; i < receivedMessages.size(); ++i)
+		{
+			m_ReceivedMessages.Produce(ReceivedMessage(receivedMessages[i], senderIDs[i]));
+		}
+		performedWork |= !receivedMessages.empty();
+		receivedMessages.clear();
+		senderIDs.clear();
+
+		if (!performedWork)
+		{
+			std::unique_lock<std::mutex> wakeLock(m_WakeLock);
+			m_WakeCondition.wait_for(wakeLock, NETWORK_THREAD_IDLE_WAIT, [this] { return m_WakeRequested.load() || !m_RunThread; });
+		}
+		m_WakeRequested = false;
+	}
+}
+
+bool NetworkWorker::ProcessCommands()
+{
+	bool processedCommand = false;
+	Command command;
+	while (m_Commands.Consume(command))
+	{
+		switch (command.Type)
+		{
+			case CommandType::Send:
+			{
+				m_ConnectionManager.SendToConnection(command.Payload, command.ID, command.Mode, command.Priority);
+				command.Payload->Release();
+			} break;
+
+			case CommandType::SendDelta:
+			{
+				m_ConnectionManager.SendDeltaToConnection(command.Payload, command.ID, command.Key);
+				command.Payload->Release();
+			} break;
+
+			case CommandType::Broadcast:
+			{
+				m_ConnectionManager.SendToShard(m_ShardIndex, command.Payload, command.ID, command.Mode, command.Priority);
+				command.Payload->Release();
+			} break;
+
+			case CommandType::Flush:
+			{
+				if (command.ID == TUBES_INVALID_CONNECTION_ID)
+					m_ConnectionManager.SendQueuedMessages(m_ShardIndex, true);
+				else
+					m_ConnectionManager.Flush(command.ID);
+			} break;
+
+			case CommandType::Disconnect:
+			{
+				m_ConnectionManager.Disconnect(DisconnectionType::LOCAL, command.ID);
+			} break;
+
+			case CommandType::DisconnectAll:
+			{
+				std::lock_guard<std::mutex> lock(m_ConnectionManagerLock);
+				m_ConnectionManager.DisconnectAll();
+			} break;
+
+			case CommandType::RegisterReplicator:
+			{
+				m_Replicators.emplace(command.Replicator->GetID(), command.Replicator);
+			} break;
+
+			default:
+				MLOG_ERROR("Network thread received a command of unknown type", LOG_CATEGORY_NETWORK_WORKER);
+				break;
+		}
+		processedCommand = true;
+	}
+
+	return processedCommand;
+}
+
+void NetworkWorker::EnqueueCommand(const Command& command)
+{
+	m_Commands.Produce(command);
+
+	// Wake the network thread if it is idle. A wake up racing with the thread going to sleep is at most delayed by NETWORK_THREAD_IDLE_WAIT
+	if (!m_WakeRequested.exchange(true))
+		m_WakeCondition.notify_one();
+}
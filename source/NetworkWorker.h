@@ -0,0 +1,100 @@
+#pragma once
+#include "Interface/TubesTypes.h"
+#include "InternalTubesTypes.h"
+#include <MUtilityLocklessQueue.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class	ConnectionManager;
+class	MessageReplicator;
+class	SerializedMessage;
+class	TubesMessageReplicator;
+struct	Message;
+struct	TubesMessage;
+
+// Owns a thread that performs the socket I/O of one connection shard when Settings::UseNetworkThread is enabled.
+// The application thread hands outgoing messages to it and fetches received messages from it through single producer/single consumer lockless queues.
+// The worker of shard 0 additionally accepts, verifies and connects new connections. All other access to the connection manager must be guarded by the connection manager lock while workers are running.
+class NetworkWorker
+{
+public:
+	NetworkWorker(uint32_t shardIndex, ConnectionManager& connectionManager, std::mutex& connectionManagerLock, TubesMessageReplicator& tubesMessageReplicator, const std::unordered_map<ReplicatorID, MessageReplicator*>& replicators);
+	~NetworkWorker();
+
+	void Start();
+	void Stop();
+
+	// The Enqueue functions take over the callers reference to the message
+	void EnqueueSend(SerializedMessage* message, Tubes::ConnectionID destinationID, Tubes::DeliveryMode deliveryMode = Tubes::DeliveryMode::RELIABLE_ORDERED, Tubes::MessagePriority priority = Tubes::MessagePriority::NORMAL);
+	void EnqueueDeltaSend(SerializedMessage* message, Tubes::ConnectionID destinationID, Tubes::DeltaKey key);
+	void EnqueueBroadcast(SerializedMessage* message, Tubes::ConnectionID exception, Tubes::DeliveryMode deliveryMode = Tubes::DeliveryMode::RELIABLE_ORDERED, Tubes::MessagePriority priority = Tubes::MessagePriority::NORMAL);
+	void EnqueueFlush(Tubes::ConnectionID ID); // TUBES_INVALID_CONNECTION_ID flushes every connection of the shard
+	void EnqueueDisconnect(Tubes::ConnectionID ID);
+	void EnqueueDisconnectAll();
+	void EnqueueReplicatorRegistration(MessageReplicator* replicator); // Must be called after a replicator has been registered since the worker deserializes using its own replicator map
+
+	void FetchReceivedMessages(std::vector<Message*>& outMessages, std::vector<Tubes::ConnectionID>* outSenderIDs);
+
+private:
+	enum class CommandType
+	{
+		Send,
+		SendDelta,
+		Broadcast,
+		Flush,
+		Disconnect,
+		DisconnectAll,
+		RegisterReplicator,
+
+		Invalid,
+	};
+
+	struct Command
+	{
+		Command() {}
+		Command(CommandType type, Tubes::ConnectionID id, SerializedMessage* payload, Tubes::DeltaKey key = 0) : Type(type), ID(id), Payload(payload), Key(key) {}
+
+		CommandType				Type		= CommandType::Invalid;
+		Tubes::ConnectionID		ID			= TUBES_INVALID_CONNECTION_ID; // Destination, or the excepted connection for broadcasts
+		SerializedMessage*		Payload		= nullptr;
+		MessageReplicator*		Replicator	= nullptr; // Only used by RegisterReplicator
+		Tubes::DeltaKey			Key			= 0; // Only used by SendDelta
+		Tubes::DeliveryMode		Mode		= Tubes::DeliveryMode::RELIABLE_ORDERED; // Only used by Send and Broadcast
+		Tubes::MessagePriority	Priority	= Tubes::MessagePriority::NORMAL; // Only used by Send and Broadcast
+	};
+
+	struct ReceivedMessage
+	{
+		ReceivedMessage() {}
+		ReceivedMessage(Message* payload, Tubes::ConnectionID senderID) : Payload(payload), SenderID(senderID) {}
+
+		Message*			Payload		= nullptr;
+		Tubes::ConnectionID	SenderID	= TUBES_INVALID_CONNECTION_ID;
+	};
+
+	void Run();
+	bool ProcessCommands();
+	void EnqueueCommand(const Command& command);
+
+	uint32_t													m_ShardIndex;
+	ConnectionManager&											m_ConnectionManager;
+	std::mutex&													m_ConnectionManagerLock;
+	TubesMessageReplicator&										m_TubesMessageReplicator;
+	std::unordered_map<ReplicatorID, MessageReplicator*>		m_Replicators; // Copy used while receiving. Registrations arrive through the command queue so that no replicator map is shared between threads
+
+	std::thread			m_Thread;
+	std::atomic<bool>	m_RunThread;
+
+	std::mutex				m_WakeLock;
+	std::condition_variable	m_WakeCondition;
+	std::atomic<bool>		m_WakeRequested;
+
+	MUtility::LocklessQueue<Command>			m_Commands;			// Application thread -> network thread
+	MUtility::LocklessQueue<ReceivedMessage>	m_ReceivedMessages;	// Network thread -> application thread
+
+	std::vector<TubesMessage*> m_ReceivedTubesMessages;
+};
\ No newline at end of file
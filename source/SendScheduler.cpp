@@ -0,0 +1,181 @@
+#include "SendScheduler.h"
+#include "Interface/TubesSettings.h"
+#include <algorithm>
+
+using namespace Tubes;
+
+constexpr int64_t	DRR_QUANTUM									= 4096; // Bytes a lane may send per round and weight unit
+constexpr int64_t	LANE_WEIGHTS[MESSAGE_PRIORITY_COUNT]		= { 0, 4, 2, 1 }; // CRITICAL isn't part of the round robin
+constexpr int64_t	MIN_BUDGET_BURST							= 16 * 1024;
+constexpr int64_t	BUDGET_BURST_DIVISOR						= 10; // The bucket holds a tenth of a seconds worth of bytes
+
+// ---------- PUBLIC ----------
+
+SendScheduler::SendScheduler()
+{
+	m_BudgetRefillTime = std::chrono::steady_clock::now();
+}
+
+void SendScheduler::Push(const UnsentMessage& message, MessagePriority priority)
+{
+	int32_t laneIndex = static_cast<int32_t>(priority);
+	if (laneIndex < 0 || laneIndex >= MESSAGE_PRIORITY_COUNT)
+		laneIndex = static_cast<int32_t>(MessagePriority::NORMAL);
+
+	m_Lanes[laneIndex].Messages.push_back(message);
+	m_QueuedByteCount += message.Payload->GetWireSize(message.Compact);
+}
+
+bool SendScheduler::Pop(UnsentMessage& outMessage)
+{
+	bool hasBudget = HasBudget();
+
+	Lane& criticalLane = m_Lanes[static_cast<int32_t>(MessagePriority::CRITICAL)];
+	if (!criticalLane.Messages.empty())
+	{
+		Take(criticalLane, outMessage);
+		return true;
+	}
+
+	return hasBudget && PopWeighted(outMessage);
+}
+
+void SendScheduler::PopAll(std::deque<UnsentMessage>& outMessages)
+{
+	for (int32_t i = 0; i < MESSAGE_PRIORITY_COUNT; ++i)
+	{
+		outMessages.insert(outMessages.end(), m_Lanes[i].Messages.begin(), m_Lanes[i].Messages.end());
+		m_Lanes[i].Messages.clear();
+		m_Lanes[i].Deficit		= 0;
+		m_Lanes[i].RewriteStart	= 0;
+	}
+	m_QueuedByteCount = 0;
+}
+
+int64_t SendScheduler::DropOldest(int64_t byteCount)
+{
+	int64_t droppedByteCount = 0;
+	for (int32_t i = MESSAGE_PRIORITY_COUNT - 1; i > static_cast<int32_t>(MessagePriority::CRITICAL) && droppedByteCount < byteCount; --i)
+	{
+		std::deque<UnsentMessage>& messages = m_Lanes[i].Messages;
+		size_t& rewriteStart = m_Lanes[i].RewriteStart;
+		while (!messages.empty() && droppedByteCount < byteCount)
+		{
+			droppedByteCount += messages.front().Payload->GetWireSize(messages.front().Compact);
+			messages.front().Payload->Release();
+			messages.pop_front();
+			if (rewriteStart > 0)
+				--rewriteStart;
+		}
+	}
+
+	m_QueuedByteCount -= droppedByteCount;
+	return droppedByteCount;
+}
+
+bool SendScheduler::IsEmpty() const
+{
+	for (int32_t i = 0; i < MESSAGE_PRIORITY_COUNT; ++i)
+	{
+		if (!m_Lanes[i].Messages.empty())
+			return false;
+	}
+	return true;
+}
+
+void SendScheduler::Clear()
+{
+	for (int32_t i = 0; i < MESSAGE_PRIORITY_COUNT; ++i)
+	{
+		for (int j = 0; j < m_Lanes[i].Messages.size(); ++j)
+		{
+			m_Lanes[i].Messages[j].Payload->Release();
+		}
+		m_Lanes[i].Messages.clear();
+		m_Lanes[i].Deficit		= 0;
+		m_Lanes[i].RewriteStart	= 0;
+	}
+	m_QueuedByteCount = 0;
+}
+
+// ---------- PRIVATE ----------
+
+bool SendScheduler::PopWeighted(UnsentMessage& outMessage)
+{
+	bool anyQueued = false;
+	for (int32_t i = static_cast<int32_t>(MessagePriority::HIGH); i < MESSAGE_PRIORITY_COUNT; ++i)
+	{
+		anyQueued |= !m_Lanes[i].Messages.empty();
+	}
+	if (!anyQueued)
+		return false;
+
+	// Terminates since a lane with queued messages gains credit every round
+	while (true)
+	{
+		Lane& lane = m_Lanes[m_CurrentLane];
+		if (!lane.Messages.empty())
+		{
+			if (!m_CurrentLaneCredited)
+			{
+				lane.Deficit += LANE_WEIGHTS[m_CurrentLane] * DRR_QUANTUM;
+				m_CurrentLaneCredited = true;
+			}
+
+			const UnsentMessage& head = lane.Messages.front();
+			int64_t headSize = head.Payload->GetWireSize(head.Compact);
+			if (headSize <= lane.Deficit)
+			{
+				lane.Deficit -= headSize;
+				Take(lane, outMessage);
+				if (lane.Messages.empty()) // Idle lanes don't save up credit
+					lane.Deficit = 0;
+				return true;
+			}
+		}
+		else
+			lane.Deficit = 0;
+
+		m_CurrentLane			= m_CurrentLane + 1 < MESSAGE_PRIORITY_COUNT ? m_CurrentLane + 1 : static_cast<int32_t>(MessagePriority::HIGH);
+		m_CurrentLaneCredited	= false;
+	}
+}
+
+bool SendScheduler::HasBudget()
+{
+	int64_t bytesPerSecond = Settings::ConnectionBandwidthLimit;
+	if (bytesPerSecond == 0)
+		return true;
+
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	int64_t burst = std::max(bytesPerSecond / BUDGET_BURST_DIVISOR, MIN_BUDGET_BURST);
+	int64_t elapsedMicroseconds = std::chrono::duration_cast<std::chrono::microseconds>(now - m_BudgetRefillTime).count();
+	if (elapsedMicroseconds >= 1000000) // Long enough to fill any bucket
+	{
+		m_Budget			= burst;
+		m_BudgetRefillTime	= now;
+	}
+	else
+	{
+		int64_t refill = bytesPerSecond * elapsedMicroseconds / 1000000;
+		if (refill > 0) // The refill time only advances by whole bytes so that frequent calls don't lose bytes to rounding
+		{
+			m_Budget = std::min(m_Budget + refill, burst);
+			m_BudgetRefillTime += std::chrono::microseconds(refill * 1000000 / bytesPerSecond);
+		}
+	}
+
+	return m_Budget > 0;
+}
+
+void SendScheduler::Take(Lane& lane, UnsentMessage& outMessage)
+{
+	outMessage = lane.Messages.front();
+	lane.Messages.pop_front();
+	m_QueuedByteCount -= outMessage.Payload->GetWireSize(outMessage.Compact);
+	if (lane.RewriteStart > 0)
+		--lane.RewriteStart;
+
+	if (Settings::ConnectionBandwidthLimit > 0)
+		m_Budget -= outMessage.Payload->GetWireSize(outMessage.Compact);
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+#include "Interface/TubesTypes.h"
+#include "SerializedMessage.h"
+#include <chrono>
+#include <deque>
+
+struct UnsentMessage
+{
+	UnsentMessage() {}
+	UnsentMessage(SerializedMessage* payload, bool compact, bool compressible) : Payload(payload), Compact(compact), Compressible(compressible) {}
+
+	SerializedMessage*	Payload			= nullptr;
+	bool				Compact			= false;	// Sent with the compact frame header
+	bool				Compressible	= false;	// May be compressed together with its neighbours
+};
+
+constexpr int32_t MESSAGE_PRIORITY_COUNT = static_cast<int32_t>(Tubes::MessagePriority::COUNT);
+
+// Decides in which order the queued messages of a connection are written to its socket. Messages of the same priority are always sent in the order they were queued.
+// CRITICAL messages go first. The other priorities share the connection by deficit round robin, weighted 4:2:1 so that LOW is slowed down but never starved.
+// When Settings::ConnectionBandwidthLimit is set, a token bucket defers everything but CRITICAL messages once the connection has used up its budget.
+class SendScheduler
+{
+public:
+	SendScheduler();
+
+	void	Push(const UnsentMessage& message, Tubes::MessagePriority priority);
+	bool	Pop(UnsentMessage& outMessage); // Returns false if nothing may be sent right now
+	void	PopAll(std::deque<UnsentMessage>& outMessages); // Appends all queued messages in priority order, regardless of the bandwidth budget
+	int64_t	DropOldest(int64_t byteCount); // Releases the oldest messages of the lowest priorities until at least byteCount bytes have been dropped. CRITICAL messages are never dropped. Returns the number of dropped bytes
+	bool	IsEmpty() const;
+	void	Clear(); // Releases all queued messages
+
+	int64_t	GetQueuedByteCount() const { return m_QueuedByteCount; }
+
+	std::deque<UnsentMessage>&	GetLane(Tubes::MessagePriority priority) { return m_Lanes[static_cast<int32_t>(priority)].Messages; } // For rewriting queued messages in place (E.g. compressing them)
+	size_t&						GetLaneRewriteStart(Tubes::MessagePriority priority) { return m_Lanes[static_cast<int32_t>(priority)].RewriteStart; } // Index of the first message of the lane that hasn't been looked at by the rewriter. Follows the messages as they leave the lane
+	void						AdjustQueuedByteCount(int64_t byteCountChange) { m_QueuedByteCount += byteCountChange; } // Must be called when a lane has been rewritten
+
+private:
+	struct Lane
+	{
+		std::deque<UnsentMessage>	Messages;
+		int64_t						Deficit			= 0; // Bytes the lane may still send in the current round
+		size_t						RewriteStart	= 0;
+	};
+
+	bool	PopWeighted(UnsentMessage& outMessage);
+	bool	HasBudget();
+	void	Take(Lane& lane, UnsentMessage& outMessage);
+
+	Lane									m_Lanes[MESSAGE_PRIORITY_COUNT];
+	int32_t									m_CurrentLane			= static_cast<int32_t>(Tubes::MessagePriority::HIGH);
+	bool									m_CurrentLaneCredited	= false;
+	int64_t									m_QueuedByteCount		= 0; // Wire size of all queued messages
+	int64_t									m_Budget				= 0; // Bytes that may be sent before the bucket has to refill. Goes negative after a message larger than what was left
+	std::chrono::steady_clock::time_point	m_BudgetRefillTime;
+};
\ No newline at end of file
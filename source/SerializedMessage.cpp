@@ -0,0 +1,48 @@
+#include "SerializedMessage.h"
+#include "Interface/messaging/MessageAllocator.h"
+#include "Interface/messaging/SerializationCursor.h"
+#include <string.h>
+
+// ---------- PUBLIC ----------
+
+SerializedMessage* SerializedMessage::Create(MUtility::Byte* data, MessageSize size)
+{
+	return new SerializedMessage(data, size);
+}
+
+void SerializedMessage::AddReference()
+{
+	m_ReferenceCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SerializedMessage::Release()
+{
+	if (m_ReferenceCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		delete this;
+}
+
+// ---------- PRIVATE ----------
+
+SerializedMessage::SerializedMessage(MUtility::Byte* data, MessageSize size) : m_Data(data), m_Size(size), m_ReferenceCount(1)
+{
+	ReplicatorID replicatorID;
+	MESSAGE_TYPE_ENUM_UNDELYING_TYPE type;
+	memcpy(&replicatorID, data + sizeof(MessageSize), sizeof(ReplicatorID));
+	memcpy(&type, data + sizeof(MessageSize) + sizeof(ReplicatorID), sizeof(MESSAGE_TYPE_ENUM_UNDELYING_TYPE));
+
+	// [Varint body size][Replicator ID][Varint type] where the body is everything after the size
+	MUtility::Byte encodedType[CompactEncoding::MAX_VARINT_BYTE_SIZE];
+	int32_t typeByteCount	= CompactEncoding::EncodeVarint(type, encodedType);
+	int32_t bodySize		= sizeof(ReplicatorID) + typeByteCount + GetPayloadSize();
+
+	m_CompactHeaderSize = CompactEncoding::EncodeVarint(static_cast<uint64_t>(bodySize), m_CompactHeader);
+	m_CompactHeader[m_CompactHeaderSize] = replicatorID;
+	m_CompactHeaderSize += sizeof(ReplicatorID);
+	memcpy(m_CompactHeader + m_CompactHeaderSize, encodedType, typeByteCount);
+	m_CompactHeaderSize += typeByteCount;
+}
+
+SerializedMessage::~SerializedMessage()
+{
+	MessageAllocator::Free(m_Data);
+}
\ No newline at end of file
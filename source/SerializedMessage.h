@@ -0,0 +1,36 @@
+#pragma once
+#include "InternalTubesTypes.h"
+#include "Interface/messaging/MessagingTypes.h"
+#include <MUtilityByte.h>
+#include <atomic>
+
+// A serialized message that can be queued on several connections at once so that broadcasts only need to be serialized once.
+// The message buffer is freed when the last reference is released.
+// The compact frame header is encoded once on creation so that connections using either frame format can share the same buffer.
+class SerializedMessage
+{
+public:
+	static SerializedMessage* Create(MUtility::Byte* data, MessageSize size); // Takes ownership of data which must have been allocated using MessageAllocator. The returned message holds one reference
+
+	void AddReference();
+	void Release();
+
+	MUtility::Byte*	GetData() const { return m_Data; }
+	MessageSize		GetSize() const { return m_Size; }
+
+	const MUtility::Byte*	GetCompactHeader() const		{ return m_CompactHeader; }
+	int32_t					GetCompactHeaderSize() const	{ return m_CompactHeaderSize; }
+	MUtility::Byte*			GetPayload() const				{ return m_Data + MESSAGE_HEADER_SIZE; }
+	int32_t					GetPayloadSize() const			{ return m_Size - MESSAGE_HEADER_SIZE; }
+	int32_t					GetWireSize(bool compact) const	{ return compact ? m_CompactHeaderSize + GetPayloadSize() : m_Size; }
+
+private:
+	SerializedMessage(MUtility::Byte* data, MessageSize size);
+	~SerializedMessage();
+
+	MUtility::Byte*			m_Data;
+	MessageSize				m_Size;
+	MUtility::Byte			m_CompactHeader[COMPACT_FRAME_HEADER_MAX_SIZE];
+	int32_t					m_CompactHeaderSize;
+	std::atomic<int32_t>	m_ReferenceCount;
+};
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "SocketPoller.h"
+#include "TubesUtility.h"
+#include <MUtilityLog.h>
+
+#if PLATFORM != PLATFORM_WINDOWS
+#include <unistd.h>
+#endif
+
+#if PLATFORM == PLATFORM_WINDOWS
+#define TUBES_POLL WSAPoll
+#else
+#define TUBES_POLL poll
+#endif
+
+#define LOG_CATEGORY_SOCKET_POLLER "TubesSocketPoller"
+
+using namespace Tubes;
+
+constexpr int32_t MIN_EPOLL_EVENT_CAPACITY = 64;
+
+// ---------- PUBLIC ----------
+
+SocketPoller::SocketPoller()
+{
+#if PLATFORM == PLATFORM_LINUX
+	m_EpollDescriptor = epoll_create1(0);
+	if (m_EpollDescriptor < 0)
+		LogAPIErrorMessage("Failed to create epoll instance", LOG_CATEGORY_SOCKET_POLLER);
+
+	m_Events.resize(MIN_EPOLL_EVENT_CAPACITY);
+#endif
+}
+
+SocketPoller::~SocketPoller()
+{
+#if PLATFORM == PLATFORM_LINUX
+	if (m_EpollDescriptor >= 0)
+		close(m_EpollDescriptor);
+#endif
+}
+
+bool SocketPoller::Add(Socket socket, ConnectionID ID, bool pollWritable)
+{
+#if PLATFORM == PLATFORM_LINUX
+	epoll_event event;
+	event.events	= pollWritable ? EPOLLOUT : EPOLLIN | EPOLLRDHUP; // Level triggered so that partially drained sockets are reported again on the next poll
+	event.data.u64	= static_cast<uint32_t>(ID);
+	if (epoll_ctl(m_EpollDescriptor, EPOLL_CTL_ADD, static_cast<int>(socket), &event) != 0)
+	{
+		LogAPIErrorMessage("Failed to add socket to epoll instance", LOG_CATEGORY_SOCKET_POLLER);
+		return false;
+	}
+#else
+	pollfd descriptor;
+	descriptor.fd		= socket;
+	descriptor.events	= pollWritable ? POLLOUT : POLLIN;
+	descriptor.revents	= 0;
+	m_PollDescriptors.push_back(descriptor);
+	m_PollIDs.push_back(ID);
+#endif
+
+	++m_SocketCount;
+	return true;
+}
+
+bool SocketPoller::Remove(Socket socket)
+{
+#if PLATFORM == PLATFORM_LINUX
+	epoll_event event = {}; // Kernels older than 2.6.9 require a non null event even though it is ignored
+	if (epoll_ctl(m_EpollDescriptor, EPOLL_CTL_DEL, static_cast<int>(socket), &event) != 0)
+	{
+		LogAPIErrorMessage("Failed to remove socket from epoll instance", LOG_CATEGORY_SOCKET_POLLER);
+		return false;
+	}
+#else
+	bool found = false;
+	for (int i = 0; i < m_PollDescriptors.size(); ++i)
+	{
+		if (m_PollDescriptors[i].fd == socket)
+		{
+			// Swap and pop since the order of the descriptors doesn't matter
+			m_PollDescriptors[i]	= m_PollDescriptors.back();
+			m_PollIDs[i]			= m_PollIDs.back();
+			m_PollDescriptors.pop_back();
+			m_PollIDs.pop_back();
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+	{
+		MLOG_WARNING("Attempted to remove a socket that isn't registered with the poller", LOG_CATEGORY_SOCKET_POLLER);
+		return false;
+	}
+#endif
+
+	--m_SocketCount;
+	return true;
+}
+
+bool SocketPoller::Poll(std::vector<ConnectionID>& outReadyIDs, int32_t timeoutMilliseconds)
+{
+	if (m_SocketCount == 0)
+		return true;
+
+#if PLATFORM == PLATFORM_LINUX
+	if (m_Events.size() < m_SocketCount)
+		m_Events.resize(m_SocketCount);
+
+	int readyCount = epoll_wait(m_EpollDescriptor, m_Events.data(), static_cast<int>(m_Events.size()), timeoutMilliseconds);
+	if (readyCount < 0)
+	{
+		if (GET_NETWORK_ERROR != TUBES_EINTR)
+		{
+			LogAPIErrorMessage("Failed to wait for epoll events", LOG_CATEGORY_SOCKET_POLLER);
+			return false;
+		}
+		return true;
+	}
+
+	for (int i = 0; i < readyCount; ++i)
+	{
+		outReadyIDs.push_back(static_cast<ConnectionID>(m_Events[i].data.u64));
+	}
+#else
+	int readyCount = TUBES_POLL(m_PollDescriptors.data(), static_cast<unsigned long>(m_PollDescriptors.size()), timeoutMilliseconds);
+	if (readyCount < 0)
+	{
+		LogAPIErrorMessage("Failed to poll sockets", LOG_CATEGORY_SOCKET_POLLER);
+		return false;
+	}
+
+	for (int i = 0; i < m_PollDescriptors.size() && readyCount > 0; ++i)
+	{
+		if (m_PollDescriptors[i].revents != 0) // Errors and hang ups are reported as ready so that Receive() can detect the disconnect
+		{
+			outReadyIDs.push_back(m_PollIDs[i]);
+			--readyCount;
+		}
+	}
+#endif
+
+	return true;
+}
+
+uint32_t SocketPoller::GetSocketCount() const
+{
+	return m_SocketCount;
+}
\ No newline at end of file
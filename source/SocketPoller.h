@@ -0,0 +1,37 @@
+#pragma once
+#include "Interface/TubesTypes.h"
+#include "InternalTubesTypes.h"
+#include <vector>
+#if PLATFORM == PLATFORM_LINUX
+#include <sys/epoll.h>
+#elif PLATFORM == PLATFORM_WINDOWS
+#include <WinSock2.h>
+#else
+#include <poll.h>
+#endif
+
+// Readiness notification for connection sockets so that only connections with pending data need to be visited.
+// Uses epoll on Linux and falls back to poll (WSAPoll on Windows) on other platforms.
+class SocketPoller
+{
+public:
+	SocketPoller();
+	~SocketPoller();
+
+	bool Add(Socket socket, Tubes::ConnectionID ID, bool pollWritable = false); // pollWritable reports the socket once it can be written to instead of once it can be read from. Used to wait for non-blocking connects
+	bool Remove(Socket socket);
+
+	bool Poll(std::vector<Tubes::ConnectionID>& outReadyIDs, int32_t timeoutMilliseconds = 0);
+
+	uint32_t GetSocketCount() const;
+
+private:
+#if PLATFORM == PLATFORM_LINUX
+	int							m_EpollDescriptor = -1;
+	std::vector<epoll_event>	m_Events;
+#else
+	std::vector<pollfd>					m_PollDescriptors;
+	std::vector<Tubes::ConnectionID>	m_PollIDs; // Parallel to m_PollDescriptors
+#endif
+	uint32_t m_SocketCount = 0;
+};
\ No newline at end of file
@@ -5,7 +5,13 @@
 #include "TubesMessageBase.h"
 #include "TubesMessageReplicator.h"
 #include "ConnectionManager.h"
+#include "NetworkWorker.h"
+#include "SerializedMessage.h"
+#include "Interface/TubesSettings.h"
+#include "Interface/messaging/MessageAllocator.h"
+#include "Interface/messaging/MessageView.h"
 #include <MUtilityLog.h>
+#include <mutex>
 
 #if PLATFORM == PLATFORM_WINDOWS
 	#include <MUtilityWindowsInclude.h>
@@ -31,7 +37,15 @@ namespace Tubes
 
 	std::vector<TubesMessage*>* m_ReceivedTubesMessages;
 
+	std::vector<NetworkWorker*>	m_NetworkWorkers; // One per connection shard. Only created when Settings::UseNetworkThread is enabled
+	std::mutex*					m_ConnectionManagerLock;
+
 	bool m_Initialized = false;
+
+	std::unique_lock<std::mutex>	LockConnectionManager();
+	SerializedMessage*				SerializeMessage(const Message* message);
+	void							Send(const Message* message, ConnectionID destinationConnectionID, DeliveryMode deliveryMode, MessagePriority priority);
+	void							Broadcast(const Message* message, ConnectionID exception, DeliveryMode deliveryMode, MessagePriority priority);
 }
 
 bool Tubes::Initialize()
@@ -56,9 +70,21 @@ bool Tubes::Initialize()
 
 	if (m_Initialized)
 	{
-		m_ConnectionManager = new ConnectionManager;
+		uint32_t shardCount = Settings::UseNetworkThread && Settings::NetworkThreadCount > 0 ? Settings::NetworkThreadCount : 1;
+		m_ConnectionManager = new ConnectionManager(shardCount);
 		m_TubesMessageReplicator = new TubesMessageReplicator;
 		m_ReplicatorReferences->emplace(m_TubesMessageReplicator->GetID(), m_TubesMessageReplicator);
+		m_ConnectionManagerLock = new std::mutex;
+
+		if (Settings::UseNetworkThread)
+		{
+			m_ConnectionManager->SetCallbackDeferral(true);
+			for (uint32_t i = 0; i < shardCount; ++i)
+			{
+				m_NetworkWorkers.push_back(new NetworkWorker(i, *m_ConnectionManager, *m_ConnectionManagerLock, *m_TubesMessageReplicator, *m_ReplicatorReferences));
+				m_NetworkWorkers.back()->Start();
+			}
+		}
 
 		MLOG_INFO("Tubes initialized successfully", LOG_CATEGORY_GENERAL);
 	}
@@ -74,6 +100,20 @@ void Tubes::Shutdown()
 		return;
 	}
 
+	if (!m_NetworkWorkers.empty())
+	{
+		for (int i = 0; i < m_NetworkWorkers.size(); ++i)
+		{
+			m_NetworkWorkers[i]->Stop();
+			delete m_NetworkWorkers[i];
+		}
+		m_NetworkWorkers.clear();
+
+		m_ConnectionManager->DispatchDeferredCallbacks();
+		m_ConnectionManager->SetCallbackDeferral(false);
+	}
+	delete m_ConnectionManagerLock;
+
 	m_ConnectionManager->StopAllListeners();
 	m_ConnectionManager->DisconnectAll();
 
@@ -92,7 +132,7 @@ void Tubes::Shutdown()
 
 	for ( int i = 0; i < m_ReceivedTubesMessages->size(); ++i )
 	{
-		free((*m_ReceivedTubesMessages)[i]);
+		MessageAllocator::Free((*m_ReceivedTubesMessages)[i]);
 	}
 	m_ReceivedTubesMessages->clear();
 	delete m_ReceivedTubesMessages;
@@ -109,28 +149,56 @@ void Tubes::Update()
 		return;
 	}
 
-	m_ConnectionManager->VerifyNewConnections(*m_TubesMessageReplicator);
-	m_ConnectionManager->HandleFailedConnectionAttempts();
-
-	// Send queued messages
-	std::vector<ConnectionID> toDisconnect;
-	for (auto& idAndConnection : m_ConnectionManager->GetVerifiedConnections())
+	if (!m_NetworkWorkers.empty())
 	{
-		SendResult sendResult = idAndConnection.second->SendQueuedMessages();
-		if (sendResult == SendResult::Disconnect)
+		// The network threads do all socket work; only hand over the callbacks it has queued up and end the frame of coalesced messages
+		if (Settings::UseMessageCoalescing)
 		{
-			toDisconnect.push_back(idAndConnection.first);
-			continue;
+			for (int i = 0; i < m_NetworkWorkers.size(); ++i)
+			{
+				m_NetworkWorkers[i]->EnqueueFlush(TUBES_INVALID_CONNECTION_ID);
+			}
 		}
+		m_ConnectionManager->DispatchDeferredCallbacks();
+		return;
 	}
 
-	for ( int i = 0; i < toDisconnect.size(); ++i )
+	m_ConnectionManager->AcceptConnections();
+	m_ConnectionManager->UpdateConnectionAttempts();
+	m_ConnectionManager->VerifyNewConnections(*m_TubesMessageReplicator);
+	m_ConnectionManager->SendQueuedMessages(true);
+}
+
+void Tubes::Flush(ConnectionID connectionID)
+{
+	if (!m_Initialized)
 	{
-		m_ConnectionManager->Disconnect(DisconnectionType::REMOTE_FORCEFUL, toDisconnect[i]); // TODODB: Update the disconnectionType here when we actually know if it was forceful or not
+		MLOG_WARNING("Attempted to flush connection using an uninitialized instance of Tubes", LOG_CATEGORY_GENERAL);
+		return;
 	}
+
+	if (!m_NetworkWorkers.empty())
+		m_NetworkWorkers[m_ConnectionManager->GetShardIndex(connectionID)]->EnqueueFlush(connectionID);
+	else
+		m_ConnectionManager->Flush(connectionID);
 }
 
 void Tubes::SendToConnection(const Message* message, ConnectionID destinationConnectionID)
+{
+	Send(message, destinationConnectionID, DeliveryMode::RELIABLE_ORDERED, MessagePriority::NORMAL);
+}
+
+void Tubes::SendToConnection(const Message* message, ConnectionID destinationConnectionID, DeliveryMode deliveryMode)
+{
+	Send(message, destinationConnectionID, deliveryMode, MessagePriority::NORMAL);
+}
+
+void Tubes::SendToConnection(const Message* message, ConnectionID destinationConnectionID, MessagePriority priority)
+{
+	Send(message, destinationConnectionID, DeliveryMode::RELIABLE_ORDERED, priority);
+}
+
+void Tubes::SendDeltaToConnection(const Message* message, ConnectionID destinationConnectionID, DeltaKey key)
 {
 	if (!m_Initialized)
 	{
@@ -138,93 +206,58 @@ void Tubes::SendToConnection(const Message* message, ConnectionID destinationCon
 		return;
 	}
 
-	Connection* connection = m_ConnectionManager->GetConnection(destinationConnectionID);
-	if (connection != nullptr)
+	SerializedMessage* serializedMessage = SerializeMessage(message);
+	if (serializedMessage == nullptr)
+		return;
+
+	if (!m_NetworkWorkers.empty())
+		m_NetworkWorkers[m_ConnectionManager->GetShardIndex(destinationConnectionID)]->EnqueueDeltaSend(serializedMessage, destinationConnectionID, key);
+	else
 	{
-		auto& idAndConnectionIterator = m_ReplicatorReferences->find(message->Replicator_ID);
-		if (idAndConnectionIterator != m_ReplicatorReferences->end() )
-		{
-			SendResult result = connection->SerializeAndSendMessage(*message, *idAndConnectionIterator->second);
-			switch (result)
-			{
-				case SendResult::Disconnect:
-				{
-					m_ConnectionManager->Disconnect(DisconnectionType::REMOTE_FORCEFUL, destinationConnectionID); // TODODB: Update the disconnectionType when we actually know if was forceful or not
-				} break;
-
-				case SendResult::Sent:
-				case SendResult::Queued:
-				case SendResult::Error:
-				default:
-					break;
-			}
-		}
-		else
-			MLOG_WARNING("Attempted to send message for which no replicator has been registered. Replicator ID = " << message->Replicator_ID, LOG_CATEGORY_GENERAL);
+		m_ConnectionManager->SendDeltaToConnection(serializedMessage, destinationConnectionID, key);
+		serializedMessage->Release(); // The connection holds its own reference if the message had to be queued
 	}
-	else
-		MLOG_WARNING("Failed to find requested connection while sending (Requested ID = " << destinationConnectionID + " )", LOG_CATEGORY_GENERAL);
 }
 
 void Tubes::SendToAll(const Message* message, ConnectionID exception)
+{
+	Broadcast(message, exception, DeliveryMode::RELIABLE_ORDERED, MessagePriority::NORMAL);
+}
+
+void Tubes::SendToAll(const Message* message, DeliveryMode deliveryMode, ConnectionID exception)
+{
+	Broadcast(message, exception, deliveryMode, MessagePriority::NORMAL);
+}
+
+void Tubes::SendToAll(const Message* message, MessagePriority priority, ConnectionID exception)
+{
+	Broadcast(message, exception, DeliveryMode::RELIABLE_ORDERED, priority);
+}
+
+void Tubes::Receive(std::vector<Message*>& outMessages, std::vector<ConnectionID>* outSenderIDs)
 {
 	if (!m_Initialized)
 	{
-		MLOG_WARNING("Attempted to send using an uninitialized instance of Tubes", LOG_CATEGORY_GENERAL);
+		MLOG_WARNING("Attempted to receive using an uninitialized instance of Tubes", LOG_CATEGORY_GENERAL);
 		return;
 	}
 
-	auto& idAndReplicatorIterator = m_ReplicatorReferences->find(message->Replicator_ID);
-	if (idAndReplicatorIterator != m_ReplicatorReferences->end())
+	if (!m_NetworkWorkers.empty())
 	{
-		const std::unordered_map<ConnectionID, Connection*>& connections = m_ConnectionManager->GetVerifiedConnections();
-
-#if TUBES_DEBUG == 1
-		if (exception != TUBES_INVALID_CONNECTION_ID)
-		{
-			bool exceptionExists = false;
-			for (auto& idAndConnection : connections)
-			{
-				if (idAndConnection.first == exception)
-					exceptionExists = true;
-			}
-
-			if (!exceptionExists)
-				MLOG_WARNING("The excepted connectionID supplied to SendToAll does not exist", LOG_CATEGORY_GENERAL);
-		}
-#endif
-		std::vector<ConnectionID> toDisconnect; // TODODB: Find a better way to disconnect connections while iterating over the connection map
-		for (auto& idAndConnection : connections)
-		{
-			if (idAndConnection.first != exception)
-			{	
-				SendResult result = idAndConnection.second->SerializeAndSendMessage(*message, *idAndReplicatorIterator->second);
-				switch (result)
-				{
-					case SendResult::Disconnect:
-					{
-						toDisconnect.push_back(idAndConnection.first);
-					} break;
-
-					case SendResult::Sent:
-					case SendResult::Queued:
-					case SendResult::Error:
-					default:
-						break;
-				}
-			}
-		}
-
-		for (int i = 0; i < toDisconnect.size(); ++i)
+		// Each connection belongs to a single shard so the messages of a connection stay in order
+		for (int i = 0; i < m_NetworkWorkers.size(); ++i)
 		{
-			m_ConnectionManager->Disconnect(DisconnectionType::REMOTE_FORCEFUL, toDisconnect[i] ); // TODODB: Update the disconnectiontype when we actually know if it was forceful or not
+			m_NetworkWorkers[i]->FetchReceivedMessages(outMessages, outSenderIDs);
 		}
 	}
 	else
-		MLOG_WARNING("Attempted to send message for which no replicator has been registered. Replicator ID = " << message->Replicator_ID, LOG_CATEGORY_GENERAL);
+	{
+		m_ConnectionManager->ReleaseViews();
+		m_ConnectionManager->ReceiveMessages(*m_ReplicatorReferences, outMessages, outSenderIDs, *m_ReceivedTubesMessages);
+	}
 }
 
-void Tubes::Receive(std::vector<Message*>& outMessages, std::vector<ConnectionID>* outSenderIDs)
+void Tubes::ReceiveViews(std::vector<MessageView>& outViews, std::vector<ConnectionID>* outSenderIDs)
 {
 	if (!m_Initialized)
 	{
@@ -232,52 +265,13 @@ void Tubes::Receive(std::vector<Message*>& outMessages, std::vector<ConnectionID
 		return;
 	}
 
-	std::vector<std::pair<ConnectionID, DisconnectionType>> toDisconnect; // TODODB: Find a better way to disconnect connections while iterating over the connection map
-	const std::unordered_map<ConnectionID, Connection*>& connections = m_ConnectionManager->GetVerifiedConnections();
-	for (auto& idAndConnection : connections)
+	if (!m_NetworkWorkers.empty())
 	{
-		bool disconnected = false;
-		Message* message = nullptr;
-		ReceiveResult result;
-		do
-		{
-			result = idAndConnection.second->Receive(*m_ReplicatorReferences, message);
-			switch (result)
-			{
-				case ReceiveResult::Fullmessage:
-				{
-					if (message->Replicator_ID == TubesMessageReplicator::TubesMessageReplicatorID)
-					{
-						m_ReceivedTubesMessages->push_back(reinterpret_cast<TubesMessage*>(message)); // We know that this is a tubes message
-					}
-					else
-					{
-						outMessages.push_back(message);
-						if (outSenderIDs)
-							outSenderIDs->push_back(idAndConnection.first);
-					}
-				} break;
-
-				case ReceiveResult::GracefulDisconnect:
-				case ReceiveResult::ForcefulDisconnect:
-				{
-					toDisconnect.push_back(std::make_pair(idAndConnection.first, result == ReceiveResult::GracefulDisconnect ? DisconnectionType::REMOTE_GRACEFUL : DisconnectionType::REMOTE_FORCEFUL));
-					disconnected = true;
-				} break;
-
-				case ReceiveResult::Empty:
-				case ReceiveResult::PartialMessage:
-				case ReceiveResult::Error:
-				default:
-					break;
-			}
-		} while (result == ReceiveResult::Fullmessage && !disconnected);
+		MLOG_WARNING("Attempted to receive message views while the network threads are running; use Receive instead", LOG_CATEGORY_GENERAL);
+		return;
 	}
 
-	for (int i = 0; i < toDisconnect.size(); ++i)
-	{
-		m_ConnectionManager->Disconnect(toDisconnect[i].second, toDisconnect[i].first);
-	}
+	m_ConnectionManager->ReceiveViews(*m_ReplicatorReferences, outViews, outSenderIDs, *m_ReceivedTubesMessages);
 }
 
 void Tubes::RequestConnection(const std::string& address, uint16_t port)
@@ -300,6 +294,7 @@ void Tubes::RequestConnection(const std::string& address, uint16_t port)
 		return;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	m_ConnectionManager->RequestConnection(address, port);
 }
 
@@ -311,6 +306,7 @@ bool Tubes::StartListener(uint16_t port)
 		return false;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	return m_ConnectionManager->StartListener(port);
 }
 bool Tubes::StopListener(uint16_t port)
@@ -321,6 +317,7 @@ bool Tubes::StopListener(uint16_t port)
 		return false;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	return m_ConnectionManager->StopListener(port);
 }
 
@@ -332,6 +329,7 @@ bool Tubes::StopAllListeners()
 		MLOG_WARNING("Attempted to stop all listeners although the tubes instance is uninitialized", LOG_CATEGORY_GENERAL);
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	return m_ConnectionManager->StopAllListeners();
 }
 
@@ -343,7 +341,10 @@ void Tubes::Disconnect(ConnectionID connectionID)
 		return;
 	}
 	
-	m_ConnectionManager->Disconnect(DisconnectionType::LOCAL, connectionID);
+	if (!m_NetworkWorkers.empty())
+		m_NetworkWorkers[m_ConnectionManager->GetShardIndex(connectionID)]->EnqueueDisconnect(connectionID);
+	else
+		m_ConnectionManager->Disconnect(DisconnectionType::LOCAL, connectionID);
 }
 
 void Tubes::DisconnectAll()
@@ -354,7 +355,10 @@ void Tubes::DisconnectAll()
 		return;
 	}
 
-	m_ConnectionManager->DisconnectAll();
+	if (!m_NetworkWorkers.empty())
+		m_NetworkWorkers[0]->EnqueueDisconnectAll();
+	else
+		m_ConnectionManager->DisconnectAll();
 }
 
 void Tubes::RegisterReplicator(MessageReplicator* replicator) // TODODB: Add unregistration function
@@ -365,7 +369,12 @@ void Tubes::RegisterReplicator(MessageReplicator* replicator) // TODODB: Add unr
 		return;
 	}
 
+	// The replicator map is only used by the application thread. The network threads deserialize using their own copies, which are kept up to date through their command queues
 	m_ReplicatorReferences->emplace(replicator->GetID(), replicator); // TODODB: Add error checking (Nullptr and duplicates)	
+	for (int i = 0; i < m_NetworkWorkers.size(); ++i)
+	{
+		m_NetworkWorkers[i]->EnqueueReplicatorRegistration(replicator);
+	}
 }
 
 ConnectionCallbackHandle Tubes::RegisterConnectionCallback(ConnectionCallbackFunction callbackFunction)
@@ -377,6 +386,7 @@ ConnectionCallbackHandle Tubes::RegisterConnectionCallback(ConnectionCallbackFun
 		return toReturn;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	return m_ConnectionManager->RegisterConnectionCallback(callbackFunction);
 }
 
@@ -388,6 +398,7 @@ bool Tubes::UnregisterConnectionCallback(ConnectionCallbackHandle handle)
 		return false;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	return m_ConnectionManager->UnregisterConnectionCallback(handle);
 }
 
@@ -400,6 +411,7 @@ DisconnectionCallbackHandle Tubes::RegisterDisconnectionCallback(DisconnectionCa
 		return toReturn;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	return m_ConnectionManager->RegisterDisconnectionCallback(callbackFunction);
 }
 
@@ -411,6 +423,7 @@ bool Tubes::UnregisterDisconnectionCallback(DisconnectionCallbackHandle handle)
 		return false;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	return m_ConnectionManager->UnregisterDisconnectionCallback(handle);
 }
 
@@ -422,6 +435,7 @@ uint32_t Tubes::GetConnectionCount()
 		return 0;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	return m_ConnectionManager->GetVerifiedConnctionCount();
 }
 
@@ -434,6 +448,7 @@ ConnectionInfo Tubes::GetConnectionInfo(ConnectionID id)
 		return toReturn;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	if (!m_ConnectionManager->IsConnectionIDValid(id))
 	{
 		MLOG_WARNING("Attempted to get address of nonexistent connection (ID = " << id + " )", LOG_CATEGORY_GENERAL);
@@ -455,6 +470,7 @@ std::string Tubes::GetAddressOfConnection(ConnectionID id)
 		return "";
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	if (!m_ConnectionManager->IsConnectionIDValid(id))
 	{
 		MLOG_WARNING("Attempted to get address of nonexistent connection (ID = " << id + " )", LOG_CATEGORY_GENERAL);
@@ -472,6 +488,7 @@ uint16_t Tubes::GetPortOfConnection(ConnectionID id)
 		return TUBES_INVALID_PORT;
 	}
 
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
 	if (!m_ConnectionManager->IsConnectionIDValid(id))
 	{
 		MLOG_WARNING("Attempted to get port of nonexistent connection (ID = " << id + " )", LOG_CATEGORY_GENERAL);
@@ -481,6 +498,66 @@ uint16_t Tubes::GetPortOfConnection(ConnectionID id)
 	return m_ConnectionManager->GetPortOfConnection(id);
 }
 
+uint64_t Tubes::GetQueuedByteCount(ConnectionID id)
+{
+	if (!m_Initialized)
+	{
+		MLOG_WARNING("Attempted to get queued byte count of connection using an uninitialized instance of Tubes", LOG_CATEGORY_GENERAL);
+		return 0;
+	}
+
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
+	if (!m_ConnectionManager->IsConnectionIDValid(id))
+	{
+		MLOG_WARNING("Attempted to get queued byte count of nonexistent connection (ID = " << id << " )", LOG_CATEGORY_GENERAL);
+		return 0;
+	}
+
+	return m_ConnectionManager->GetQueuedByteCount(id);
+}
+
+bool Tubes::IsBackpressured(ConnectionID id)
+{
+	if (!m_Initialized)
+	{
+		MLOG_WARNING("Attempted to get backpressure of connection using an uninitialized instance of Tubes", LOG_CATEGORY_GENERAL);
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
+	if (!m_ConnectionManager->IsConnectionIDValid(id))
+	{
+		MLOG_WARNING("Attempted to get backpressure of nonexistent connection (ID = " << id << " )", LOG_CATEGORY_GENERAL);
+		return false;
+	}
+
+	return m_ConnectionManager->IsBackpressured(id);
+}
+
+void Tubes::SetSendQueueWatermarks(ConnectionID id, uint32_t highWatermark, uint32_t lowWatermark)
+{
+	if (!m_Initialized)
+	{
+		MLOG_WARNING("Attempted to set send queue watermarks of connection using an uninitialized instance of Tubes", LOG_CATEGORY_GENERAL);
+		return;
+	}
+
+	if (lowWatermark > highWatermark)
+	{
+		MLOG_WARNING("Attempted to set a send queue low watermark (" << lowWatermark << ") above the high watermark (" << highWatermark << ")", LOG_CATEGORY_GENERAL);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock = LockConnectionManager();
+	if (!m_ConnectionManager->IsConnectionIDValid(id))
+	{
+		MLOG_WARNING("Attempted to set send queue watermarks of nonexistent connection (ID = " << id << " )", LOG_CATEGORY_GENERAL);
+		return;
+	}
+
+	m_ConnectionManager->SetSendQueueWatermarks(id, highWatermark, lowWatermark);
+}
+
 bool Tubes::IsValidIPv4Address(const char* ipv4String)
 {
 	struct sockaddr_in sa;
@@ -491,4 +568,89 @@ bool Tubes::IsValidIPv4Address(const char* ipv4String)
 	result = inet_pton(AF_INET, ipv4String, &(sa.sin_addr));
 #endif
 	return result != 0;
+}
+
+// ---------- INTERNAL ----------
+
+std::unique_lock<std::mutex> Tubes::LockConnectionManager()
+{
+	// The connection manager is only shared with other threads when the network threads are running
+	if (!m_NetworkWorkers.empty())
+		return std::unique_lock<std::mutex>(*m_ConnectionManagerLock);
+
+	return std::unique_lock<std::mutex>(*m_ConnectionManagerLock, std::defer_lock);
+}
+
+SerializedMessage* Tubes::SerializeMessage(const Message* message)
+{
+	auto idAndReplicatorIterator = m_ReplicatorReferences->find(message->Replicator_ID);
+	if (idAndReplicatorIterator == m_ReplicatorReferences->end())
+	{
+		MLOG_WARNING("Attempted to send message for which no replicator has been registered. Replicator ID = " << message->Replicator_ID, LOG_CATEGORY_GENERAL);
+		return nullptr;
+	}
+	MessageReplicator* replicator = idAndReplicatorIterator->second;
+
+	MessageSize messageSize;
+	MUtility::Byte* serializedMessage = replicator->SerializeMessage(message, &messageSize);
+	if (serializedMessage == nullptr)
+	{
+		MLOG_WARNING("Failed to serialize message of type " << message->Type << ". The message will not be sent", LOG_CATEGORY_GENERAL);
+		return nullptr;
+	}
+
+	return SerializedMessage::Create(serializedMessage, messageSize);
+}
+
+void Tubes::Send(const Message* message, ConnectionID destinationConnectionID, DeliveryMode deliveryMode, MessagePriority priority)
+{
+	if (!m_Initialized)
+	{
+		MLOG_WARNING("Attempted to send using an uninitialized instance of Tubes", LOG_CATEGORY_GENERAL);
+		return;
+	}
+
+	SerializedMessage* serializedMessage = SerializeMessage(message);
+	if (serializedMessage == nullptr)
+		return;
+
+	if (!m_NetworkWorkers.empty())
+		m_NetworkWorkers[m_ConnectionManager->GetShardIndex(destinationConnectionID)]->EnqueueSend(serializedMessage, destinationConnectionID, deliveryMode, priority);
+	else
+	{
+		m_ConnectionManager->SendToConnection(serializedMessage, destinationConnectionID, deliveryMode, priority);
+		serializedMessage->Release(); // The connection holds its own reference if the message had to be queued
+	}
+}
+
+void Tubes::Broadcast(const Message* message, ConnectionID exception, DeliveryMode deliveryMode, MessagePriority priority)
+{
+	if (!m_Initialized)
+	{
+		MLOG_WARNING("Attempted to send using an uninitialized instance of Tubes", LOG_CATEGORY_GENERAL);
+		return;
+	}
+
+	// Serialize the message once and share the buffer between all receiving connections
+	SerializedMessage* serializedMessage = SerializeMessage(message);
+	if (serializedMessage == nullptr)
+		return;
+
+	if (!m_NetworkWorkers.empty())
+	{
+		for (int i = 1; i < m_NetworkWorkers.size(); ++i)
+		{
+			serializedMessage->AddReference(); // Each network thread releases its own reference
+		}
+
+		for (int i = 0; i < m_NetworkWorkers.size(); ++i)
+		{
+			m_NetworkWorkers[i]->EnqueueBroadcast(serializedMessage, exception, deliveryMode, priority);
+		}
+	}
+	else
+	{
+		m_ConnectionManager->SendToAll(serializedMessage, exception, deliveryMode, priority);
+		serializedMessage->Release(); // Connections that couldn't send the message right away hold their own references
+	}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "TubesMessageBase.h"
 #include "Interface/TubesTypes.h"
+#include "Interface/messaging/MessageSchema.h"
 
 using Tubes::ConnectionID;
 
@@ -14,7 +15,10 @@ namespace TubesMessages
 
 struct ConnectionIDMessage : TubesMessage
 {
+	ConnectionIDMessage() : TubesMessage(TubesMessages::CONNECTION_ID) {}
 	ConnectionIDMessage(ConnectionID id) : TubesMessage(TubesMessages::CONNECTION_ID) { ID = id; }
 
-	ConnectionID ID;
+	ConnectionID ID = TUBES_INVALID_CONNECTION_ID;
+
+	using Schema = MessageSchema<TubesMessages::CONNECTION_ID, SCHEMA_FIELD(ConnectionIDMessage, ID)>;
 };
\ No newline at end of file
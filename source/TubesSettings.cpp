@@ -0,0 +1,27 @@
+#include "Interface/TubesSettings.h"
+
+namespace Tubes
+{
+	namespace Settings
+	{
+		bool AllowDuplicateConnections	= false;
+		bool UseReadinessPolling		= false;
+		bool UseNetworkThread			= false;
+		uint32_t NetworkThreadCount		= 1;
+		uint32_t ListenBacklog			= 128;
+		bool UseReusePortListeners		= false;
+		bool UseCompactWireFormat		= false;
+		bool UseDeltaCompression		= false;
+		bool UseCompression				= false;
+		uint32_t CompressionThreshold	= 1024;
+		bool UseMessageCoalescing		= false;
+		uint32_t CoalescingFlushThreshold = 16384;
+		uint32_t ConnectionBandwidthLimit = 0;
+		uint32_t SendQueueHighWatermark	= 0;
+		uint32_t SendQueueLowWatermark	= 0;
+		SlowConsumerPolicy SendQueuePolicy = SlowConsumerPolicy::DROP_NEWEST;
+		bool UseDatagramChannel			= false;
+		float DatagramLossRate			= 0.0f;
+		uint32_t DatagramLatencyMilliseconds = 0;
+	}
+}
\ No newline at end of file
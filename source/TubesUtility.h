@@ -10,8 +10,6 @@
 #define GET_NETWORK_ERROR errno
 #endif
 
-#define NOT_EXPECTING_PAYLOAD -1
-
 // Always output API related errors through this define or string constructors may overwrite errno
 #define LogAPIErrorMessage(outputMessage, logCategory) { int __errorCode = GET_NETWORK_ERROR; MLOG_ERROR(outputMessage << " - Error (" << __errorCode << ") " << TubesUtility::GetErrorName(__errorCode), logCategory); }
 
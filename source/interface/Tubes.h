@@ -9,6 +9,7 @@
 
 class	MessageReplicator;
 struct	Message;
+struct	MessageView;
 
 namespace Tubes // TODOD: Remove redundant "connection" from connectionID parameters
 {
@@ -17,8 +18,15 @@ namespace Tubes // TODOD: Remove redundant "connection" from connectionID parame
 	void Update();
 
 	void SendToConnection(const Message* message, ConnectionID destinationConnectionID);
+	void SendDeltaToConnection(const Message* message, ConnectionID destinationConnectionID, DeltaKey key); // For state that is sent repeatedly. Only the bytes that changed since the last message sent with the same key are transmitted when both ends have enabled Settings::UseDeltaCompression
 	void SendToAll(const Message* message, ConnectionID exception = TUBES_INVALID_CONNECTION_ID);
+	void SendToConnection(const Message* message, ConnectionID destinationConnectionID, DeliveryMode deliveryMode); // Unreliable messages are sent as datagrams when Settings::UseDatagramChannel is enabled on both ends and the serialized message fits in one. Otherwise they are sent reliably
+	void SendToAll(const Message* message, DeliveryMode deliveryMode, ConnectionID exception = TUBES_INVALID_CONNECTION_ID);
+	void SendToConnection(const Message* message, ConnectionID destinationConnectionID, MessagePriority priority); // Messages of a higher priority overtake queued messages of a lower priority when the connection can't keep up. Messages of the same priority stay in order
+	void SendToAll(const Message* message, MessagePriority priority, ConnectionID exception = TUBES_INVALID_CONNECTION_ID);
+	void Flush(ConnectionID destinationConnectionID); // Sends the messages held for the connection by Settings::UseMessageCoalescing without waiting for the next Update
 	void Receive(std::vector<Message*>& outMessages, std::vector<ConnectionID>* outSenderIDs = nullptr);
+	void ReceiveViews(std::vector<MessageView>& outViews, std::vector<ConnectionID>* outSenderIDs = nullptr); // Receives without deserializing or copying. The views are valid until the next call to Receive or ReceiveViews. Not available when Settings::UseNetworkThread is enabled
 
 	void RequestConnection(const std::string& address, uint16_t port);
 	bool StartListener(uint16_t port);
@@ -38,6 +46,9 @@ namespace Tubes // TODOD: Remove redundant "connection" from connectionID parame
 	ConnectionInfo GetConnectionInfo(ConnectionID id);
 	std::string GetAddressOfConnection(ConnectionID id);
 	uint16_t GetPortOfConnection(ConnectionID id);
+	uint64_t GetQueuedByteCount(ConnectionID id); // Bytes that are waiting to be sent to the connection
+	bool IsBackpressured(ConnectionID id); // True from when the queued bytes reach the high watermark until they have drained below the low watermark. Check before sending bulk data to a peer that may not keep up. See Settings::SendQueueHighWatermark
+	void SetSendQueueWatermarks(ConnectionID id, uint32_t highWatermark, uint32_t lowWatermark); // Overrides Settings::SendQueueHighWatermark and Settings::SendQueueLowWatermark for one connection
 
 	bool IsValidIPv4Address(const char* ipv4String);
 };
\ No newline at end of file
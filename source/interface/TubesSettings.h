@@ -1,9 +1,29 @@
 #pragma once
+#include "TubesTypes.h"
+#include <stdint.h>
 
 namespace Tubes
 {
 	namespace Settings
 	{
-		static bool AllowDuplicateConnections = false;
+		extern bool AllowDuplicateConnections;
+		extern bool UseReadinessPolling; // Only receive from connections that the OS reports as readable (epoll on Linux, poll elsewhere) instead of calling recv on every connection each frame
+		extern bool UseNetworkThread; // Perform all socket I/O on a dedicated thread. Update() then only dispatches callbacks. Must be set before Initialize() is called
+		extern uint32_t NetworkThreadCount; // Number of network threads used when UseNetworkThread is enabled. Connections are sharded across the threads by connection ID. Must be set before Initialize() is called
+		extern uint32_t ListenBacklog; // Number of connections that the OS queues for each listener until they are accepted. The OS may cap it (E.g. net.core.somaxconn on Linux). Used by listeners started after it is set
+		extern bool UseReusePortListeners; // Give each network thread its own SO_REUSEPORT listening socket so that the OS spreads incoming connections across the threads. Linux only. Must be set before Initialize() is called
+		extern bool UseCompactWireFormat; // Offer and accept the compact frame header (varint size and type) when connecting. Each connection only switches once both ends have agreed, so peers without support keep using the standard format
+		extern bool UseDeltaCompression; // Offer and accept delta compression of messages sent through SendDeltaToConnection. Without agreement from the peer those messages are sent in full
+		extern bool UseCompression; // Offer and accept LZ4 compression of outgoing data. Queued messages are compressed together once they add up to CompressionThreshold bytes, so small messages that can be sent right away are never compressed
+		extern uint32_t CompressionThreshold; // Minimum number of bytes in a batch of queued messages before it is compressed
+		extern bool UseMessageCoalescing; // Hold messages sent during a frame and write them together when Update or Flush is called, or once CoalescingFlushThreshold bytes are held, instead of sending each message right away. MessagePriority::CRITICAL messages flush right away
+		extern uint32_t CoalescingFlushThreshold; // Bytes held for a connection before it is flushed without waiting for the end of the frame
+		extern uint32_t ConnectionBandwidthLimit; // Bytes per second that each connection may send before messages below MessagePriority::CRITICAL are held back. 0 means unlimited
+		extern uint32_t SendQueueHighWatermark; // Bytes that may be queued for a connection whose peer doesn't read fast enough before SendQueuePolicy is applied. CRITICAL messages are always queued. 0 means unbounded
+		extern uint32_t SendQueueLowWatermark; // A connection stops reporting backpressure once its send queue has drained below this many bytes
+		extern SlowConsumerPolicy SendQueuePolicy;
+		extern bool UseDatagramChannel; // Open a UDP channel next to each connection for messages sent with an unreliable DeliveryMode. Without a channel agreed with the peer those messages are sent reliably. Must be set before Initialize() is called
+		extern float DatagramLossRate; // Fraction (0 - 1) of outgoing datagrams that are dropped on purpose. For testing how the application copes with a bad network
+		extern uint32_t DatagramLatencyMilliseconds; // Delay added to outgoing datagrams. For testing how the application copes with a bad network
 	}
 }
\ No newline at end of file
@@ -11,6 +11,7 @@
 namespace Tubes // TODODB: Replace the callback handles so that Tubes doesn't rely on external code for this
 {
 	typedef int32_t	ConnectionID; // TODODB: Switch to a strongID type
+	typedef uint32_t	DeltaKey; // Identifies a stream of state messages that are delta compressed against each other (E.g. one key per replicated entity)
 
 	enum class ConnectionAttemptResult : uint32_t
 	{
@@ -25,6 +26,37 @@ namespace Tubes // TODODB: Replace the callback handles so that Tubes doesn't re
 		INVALID
 	};
 
+	enum class DeliveryMode : uint32_t
+	{
+		RELIABLE_ORDERED,		// Sent over the connection's stream
+		UNRELIABLE,				// Sent as a datagram that may be lost, duplicated or arrive out of order
+		UNRELIABLE_SEQUENCED,	// Like UNRELIABLE but datagrams older than the newest one received are dropped
+
+		COUNT,
+		INVALID,
+	};
+
+	enum class MessagePriority : uint32_t
+	{
+		CRITICAL,	// Sent before anything else and never deferred by Settings::ConnectionBandwidthLimit. Meant for small urgent messages such as input and acknowledgements
+		HIGH,		// HIGH, NORMAL and LOW share a saturated connection 4:2:1
+		NORMAL,
+		LOW,
+
+		COUNT,
+		INVALID,
+	};
+
+	enum class SlowConsumerPolicy : uint32_t
+	{
+		DROP_OLDEST,	// Drop the oldest queued messages, starting with the lowest priority
+		DROP_NEWEST,	// Drop the message that didn't fit
+		DISCONNECT,		// Disconnect the peer
+
+		COUNT,
+		INVALID,
+	};
+
 	enum class DisconnectionType : uint32_t
 	{
 		LOCAL,
@@ -50,6 +82,7 @@ namespace Tubes // TODODB: Replace the callback handles so that Tubes doesn't re
 
 	struct DisconnectionData 
 	{
+		DisconnectionData() {};
 		DisconnectionData(DisconnectionType type) : Type(type) {}
 		DisconnectionData(DisconnectionType type, const std::string& address, uint16_t port, ConnectionID id) : Type(type), Address(address), Port(port), ID(id) {}
 
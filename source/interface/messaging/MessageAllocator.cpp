@@ -0,0 +1,247 @@
+#include "MessageAllocator.h"
+#include <MUtilityPlatformDefinitions.h>
+#include <atomic>
+#include <mutex>
+#include <stdlib.h>
+
+#if PLATFORM == PLATFORM_WINDOWS
+#include <MUtilityWindowsInclude.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	constexpr int32_t	SIZE_CLASS_COUNT			= 10;		// 32, 64, ..., 16384 bytes
+	constexpr size_t	SMALLEST_SIZE_CLASS_SHIFT	= 5;		// The smallest size class is 2^5 = 32 bytes
+	constexpr size_t	SLAB_BYTE_SIZE				= 64 * 1024;
+	constexpr size_t	ARENA_BYTE_SIZE				= 1024 * 1024 * 1024;	// Address space reserved for slabs. Only the slabs that have been carved are backed by memory
+	constexpr uint32_t	THREAD_CACHE_BATCH_SIZE		= 32;		// Number of blocks moved between a thread cache and the shared pool at a time
+	constexpr uint32_t	THREAD_CACHE_MAX_BLOCKS		= THREAD_CACHE_BATCH_SIZE * 2;
+	constexpr uint32_t	LARGE_ALLOCATION			= UINT32_MAX;
+
+	struct alignas(16) BlockHeader // Keeps the memory handed out 16 byte aligned
+	{
+		uint32_t SizeClass;
+	};
+
+	struct FreeBlock
+	{
+		FreeBlock* Next;
+	};
+
+	struct SizeClassPool
+	{
+		std::mutex	Lock;
+		FreeBlock*	FreeList	= nullptr;
+		uint32_t	FreeCount	= 0;
+	};
+
+	SizeClassPool			g_Pools[SIZE_CLASS_COUNT];
+	std::once_flag			g_ArenaReservation;
+	std::atomic<char*>		g_Arena				= { nullptr }; // Every pooled block lies within the arena, which is how Free tells them apart from heap memory
+	std::atomic<size_t>		g_ArenaUsage		= { 0 }; // Bytes of the arena handed out to slabs
+	std::atomic<uint64_t>	g_Hits				= { 0 };
+	std::atomic<uint64_t>	g_Misses			= { 0 };
+	std::atomic<uint64_t>	g_BytesHeld			= { 0 };
+	std::atomic<uint64_t>	g_LargeAllocations	= { 0 };
+
+	size_t GetBlockSize(uint32_t sizeClass)
+	{
+		return static_cast<size_t>(1) << (sizeClass + SMALLEST_SIZE_CLASS_SHIFT);
+	}
+
+	uint32_t GetSizeClass(size_t totalByteSize)
+	{
+		for (uint32_t sizeClass = 0; sizeClass < SIZE_CLASS_COUNT; ++sizeClass)
+		{
+			if (totalByteSize <= GetBlockSize(sizeClass))
+				return sizeClass;
+		}
+		return LARGE_ALLOCATION;
+	}
+
+	void ReserveArena()
+	{
+#if PLATFORM == PLATFORM_WINDOWS
+		void* arena = VirtualAlloc(nullptr, ARENA_BYTE_SIZE, MEM_RESERVE, PAGE_NOACCESS);
+#else
+		void* arena = mmap(nullptr, ARENA_BYTE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (arena == MAP_FAILED)
+			arena = nullptr;
+#endif
+		g_Arena.store(static_cast<char*>(arena), std::memory_order_release);
+	}
+
+	char* CreateSlab(size_t slabSize) // Returns nullptr once the arena is used up, which makes Allocate fall back to the heap
+	{
+		std::call_once(g_ArenaReservation, ReserveArena);
+		char* arena = g_Arena.load(std::memory_order_acquire);
+		size_t offset = g_ArenaUsage.fetch_add(slabSize, std::memory_order_relaxed);
+		if (arena == nullptr || offset + slabSize > ARENA_BYTE_SIZE)
+			return nullptr;
+
+		char* slab = arena + offset;
+#if PLATFORM == PLATFORM_WINDOWS
+		bool committed = VirtualAlloc(slab, slabSize, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+		bool committed = mprotect(slab, slabSize, PROT_READ | PROT_WRITE) == 0;
+#endif
+		return committed ? slab : nullptr;
+	}
+
+	bool IsPooled(const void* memory)
+	{
+		uintptr_t arena = reinterpret_cast<uintptr_t>(g_Arena.load(std::memory_order_acquire));
+		uintptr_t address = reinterpret_cast<uintptr_t>(memory);
+		return arena != 0 && address >= arena && address < arena + ARENA_BYTE_SIZE;
+	}
+
+	// Moves up to THREAD_CACHE_BATCH_SIZE blocks from the shared pool into outList. A new slab is carved up if the pool is empty.
+	// Slabs are kept for the lifetime of the process.
+	uint32_t FetchBlocks(uint32_t sizeClass, FreeBlock*& outList, bool& outCreatedSlab)
+	{
+		SizeClassPool& pool = g_Pools[sizeClass];
+		std::lock_guard<std::mutex> lock(pool.Lock);
+
+		outCreatedSlab = pool.FreeList == nullptr;
+		if (outCreatedSlab)
+		{
+			size_t blockSize	= GetBlockSize(sizeClass);
+			size_t slabSize		= blockSize * THREAD_CACHE_BATCH_SIZE > SLAB_BYTE_SIZE ? blockSize * THREAD_CACHE_BATCH_SIZE : SLAB_BYTE_SIZE;
+			char* slab			= CreateSlab(slabSize);
+			if (slab == nullptr)
+				return 0;
+
+			for (size_t offset = 0; offset + blockSize <= slabSize; offset += blockSize)
+			{
+				FreeBlock* block	= reinterpret_cast<FreeBlock*>(slab + offset);
+				block->Next			= pool.FreeList;
+				pool.FreeList		= block;
+				++pool.FreeCount;
+			}
+
+			g_BytesHeld.fetch_add(slabSize, std::memory_order_relaxed);
+		}
+
+		uint32_t fetchedCount = 0;
+		while (pool.FreeList != nullptr && fetchedCount < THREAD_CACHE_BATCH_SIZE)
+		{
+			FreeBlock* block	= pool.FreeList;
+			pool.FreeList		= block->Next;
+			block->Next			= outList;
+			outList				= block;
+			++fetchedCount;
+		}
+		pool.FreeCount -= fetchedCount;
+
+		return fetchedCount;
+	}
+
+	void ReturnBlocks(uint32_t sizeClass, FreeBlock* list, uint32_t count)
+	{
+		if (list == nullptr)
+			return;
+
+		FreeBlock* last = list;
+		while (last->Next != nullptr)
+		{
+			last = last->Next;
+		}
+
+		SizeClassPool& pool = g_Pools[sizeClass];
+		std::lock_guard<std::mutex> lock(pool.Lock);
+		last->Next		= pool.FreeList;
+		pool.FreeList	= list;
+		pool.FreeCount	+= count;
+	}
+
+	struct ThreadCache
+	{
+		~ThreadCache() // Give the cached blocks back to the shared pool when the thread exits
+		{
+			for (uint32_t sizeClass = 0; sizeClass < SIZE_CLASS_COUNT; ++sizeClass)
+			{
+				ReturnBlocks(sizeClass, FreeLists[sizeClass], Counts[sizeClass]);
+			}
+		}
+
+		FreeBlock*	FreeLists[SIZE_CLASS_COUNT]	= {};
+		uint32_t	Counts[SIZE_CLASS_COUNT]	= {};
+	};
+
+	thread_local ThreadCache t_Cache;
+}
+
+void* MessageAllocator::Allocate(size_t byteSize)
+{
+	uint32_t sizeClass = GetSizeClass(byteSize + sizeof(BlockHeader));
+	if (sizeClass == LARGE_ALLOCATION)
+	{
+		g_Misses.fetch_add(1, std::memory_order_relaxed);
+		g_LargeAllocations.fetch_add(1, std::memory_order_relaxed);
+		return malloc(byteSize); // Freed like any other heap memory
+	}
+
+	bool createdSlab = false;
+	FreeBlock*& freeList = t_Cache.FreeLists[sizeClass];
+	if (freeList == nullptr)
+	{
+		t_Cache.Counts[sizeClass] += FetchBlocks(sizeClass, freeList, createdSlab);
+		if (freeList == nullptr) // The arena is used up or couldn't be reserved
+		{
+			g_Misses.fetch_add(1, std::memory_order_relaxed);
+			return malloc(byteSize);
+		}
+	}
+
+	FreeBlock* block = freeList;
+	freeList = block->Next;
+	--t_Cache.Counts[sizeClass];
+
+	BlockHeader* header = reinterpret_cast<BlockHeader*>(block);
+	header->SizeClass = sizeClass;
+	(createdSlab ? g_Misses : g_Hits).fetch_add(1, std::memory_order_relaxed);
+	return header + 1;
+}
+
+void MessageAllocator::Free(void* memory)
+{
+	if (!IsPooled(memory)) // Also covers nullptr
+	{
+		free(memory);
+		return;
+	}
+
+	BlockHeader* header = static_cast<BlockHeader*>(memory) - 1;
+	uint32_t sizeClass = header->SizeClass;
+	FreeBlock* block = reinterpret_cast<FreeBlock*>(header);
+	block->Next = t_Cache.FreeLists[sizeClass];
+	t_Cache.FreeLists[sizeClass] = block;
+
+	// Hand half of the cached blocks back to the shared pool if this thread frees more than it allocates (E.g. messages allocated on a network thread and freed on the game thread)
+	if (++t_Cache.Counts[sizeClass] > THREAD_CACHE_MAX_BLOCKS)
+	{
+		FreeBlock* toReturn = t_Cache.FreeLists[sizeClass];
+		FreeBlock* last = toReturn;
+		for (uint32_t i = 1; i < THREAD_CACHE_BATCH_SIZE; ++i)
+		{
+			last = last->Next;
+		}
+		t_Cache.FreeLists[sizeClass] = last->Next;
+		last->Next = nullptr;
+		t_Cache.Counts[sizeClass] -= THREAD_CACHE_BATCH_SIZE;
+
+		ReturnBlocks(sizeClass, toReturn, THREAD_CACHE_BATCH_SIZE);
+	}
+}
+
+MessageAllocator::Statistics MessageAllocator::GetStatistics()
+{
+	Statistics statistics;
+	statistics.Hits				= g_Hits.load(std::memory_order_relaxed);
+	statistics.Misses			= g_Misses.load(std::memory_order_relaxed);
+	statistics.BytesHeld		= g_BytesHeld.load(std::memory_order_relaxed);
+	statistics.LargeAllocations	= g_LargeAllocations.load(std::memory_order_relaxed);
+	return statistics;
+}
\ No newline at end of file
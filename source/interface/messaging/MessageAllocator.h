@@ -0,0 +1,22 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Pooled allocator used for all messages and serialized message buffers.
+// Small allocations are served from per thread caches backed by fixed size slabs so that steady state traffic doesn't touch the heap.
+// Memory returned by Allocate must be released using Free (Never using free or delete). Free also takes memory from malloc, so replicators that still allocate with malloc keep working.
+namespace MessageAllocator
+{
+	struct Statistics
+	{
+		uint64_t Hits				= 0; // Allocations served from already pooled memory
+		uint64_t Misses				= 0; // Allocations that required a new slab or a direct heap allocation
+		uint64_t BytesHeld			= 0; // Bytes held in slabs by the pool
+		uint64_t LargeAllocations	= 0; // Allocations too large for any size class; these always go straight to the heap
+	};
+
+	void*		Allocate(size_t byteSize);
+	void		Free(void* memory);
+
+	Statistics	GetStatistics();
+}
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "MessageManager.h"
+#include "MessageAllocator.h"
 #include "Subscriber.h"
 #include "UserMessage.h"
 #include "SimulationMessage.h"
@@ -18,25 +19,25 @@ MessageManager::~MessageManager()
 	for (int i = 0; i < m_DeliveredUserMessages.size(); ++i)
 	{
 		m_DeliveredUserMessages[i]->Destroy();
-		free(m_DeliveredUserMessages[i]);
+		MessageAllocator::Free(m_DeliveredUserMessages[i]);
 	}
 
 	for (int i = 0; i < m_DeliveredSimulationMessages.size(); ++i)
 	{
 		m_DeliveredSimulationMessages[i]->Destroy();
-		free(m_DeliveredSimulationMessages[i]);
+		MessageAllocator::Free(m_DeliveredSimulationMessages[i]);
 	}
 
 	for (int i = 0; i < m_UserMessages.size(); ++i)
 	{
 		m_UserMessages[i]->Destroy();
-		free(m_UserMessages[i]);
+		MessageAllocator::Free(m_UserMessages[i]);
 	}
 
 	for (int i = 0; i < m_SimulationMessages.size(); ++i)
 	{
 		m_SimulationMessages[i]->Destroy();
-		free(m_SimulationMessages[i]);
+		MessageAllocator::Free(m_SimulationMessages[i]);
 	}
 	m_SimulationMessages.clear();
 
@@ -114,7 +115,7 @@ void MessageManager::SendImmediateUserMessage(UserMessage* message)
 		else
 		{
 			message->Destroy();
-			free(message);
+			MessageAllocator::Free(message);
 		}
 	}
 
@@ -142,7 +143,7 @@ void MessageManager::SendImmediateSimulationMessage(SimulationMessage* message)
 	else
 	{
 		message->Destroy();
-		free(message);
+		MessageAllocator::Free(message);
 	}
 
 
@@ -160,7 +161,7 @@ void MessageManager::EnqueueUserMessage(UserMessage* message)
 	else
 	{
 		message->Destroy();
-		free(message);
+		MessageAllocator::Free(message);
 	}
 
 	UnlockMutexes( { &m_SubscriberLock, &m_UserMsgQueueLock } );
@@ -177,7 +178,7 @@ void MessageManager::EnqueueSimulationMessage(SimulationMessage* message)
 	else
 	{
 		message->Destroy();
-		free(message);
+		MessageAllocator::Free(message);
 	}
 
 	UnlockMutexes({ &m_SubscriberLock, &m_SimMsgQueueLock });
@@ -206,7 +207,7 @@ void MessageManager::DeliverQueuedUserMessages()
 		else
 		{
 			m_UserMessages[i]->Destroy();
-			free(m_UserMessages[i]);
+			MessageAllocator::Free(m_UserMessages[i]);
 		}
 	}
 
@@ -239,7 +240,7 @@ void MessageManager::DeliverQueuedSimulationMessages( uint64_t currentFrame )
 			else
 			{
 				m_SimulationMessages[i]->Destroy();
-				free(m_SimulationMessages[i]);
+				MessageAllocator::Free(m_SimulationMessages[i]);
 			}
 
 			m_SimulationMessages.erase(m_SimulationMessages.begin() + i);
@@ -261,7 +262,7 @@ void MessageManager::ClearDeliveredUserMessages()
 	for (int i = 0; i < m_DeliveredUserMessages.size(); ++i)
 	{
 		m_DeliveredUserMessages[i]->Destroy();
-		free(m_DeliveredUserMessages[i]);
+		MessageAllocator::Free(m_DeliveredUserMessages[i]);
 	}
 
 	m_DeliveredUserMessages.clear();
@@ -281,7 +282,7 @@ void MessageManager::ClearDeliveredSimulationMessages()
 	for (int i = 0; i < m_DeliveredSimulationMessages.size(); ++i)
 	{
 		m_DeliveredSimulationMessages[i]->Destroy();
-		free(m_DeliveredSimulationMessages[i]);
+		MessageAllocator::Free(m_DeliveredSimulationMessages[i]);
 	}
 
 	m_DeliveredSimulationMessages.clear();
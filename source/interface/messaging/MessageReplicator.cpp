@@ -1,5 +1,7 @@
 #include "MessageReplicator.h"
-#include <MUtilitySerialization.h>
+
+thread_local WriteCursor	MessageReplicator::t_Writer;
+thread_local ReadCursor	MessageReplicator::t_Reader;
 
 MessageReplicator::MessageReplicator(ReplicatorID id)
 {
@@ -11,112 +13,43 @@ ReplicatorID MessageReplicator::GetID() const
 	return m_ID;
 }
 
-void MessageReplicator::WriteMemory(const void* value, uint32_t byteSize)
-{
-	MUtility::Serialization::CopyAndIncrementDestination(m_WritingWalker, value, byteSize);
-}
-
-void MessageReplicator::WriteInt16(int16_t value)
-{
-	MUtility::Serialization::WriteInt16(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteInt32(int32_t value)
-{
-	MUtility::Serialization::WriteInt32(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteInt64(int64_t value)
-{
-	MUtility::Serialization::WriteInt64(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteUint16(uint16_t value)
-{
-	MUtility::Serialization::WriteUint16(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteUint32(uint32_t value)
-{
-	MUtility::Serialization::WriteUint32(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteUint64(uint64_t value)
-{
-	MUtility::Serialization::WriteUint64(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteFloat(float value)
-{
-	MUtility::Serialization::WriteFloat(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteDouble(double value)
-{
-	MUtility::Serialization::WriteDouble(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteBool(bool value)
-{
-	MUtility::Serialization::WriteBool(value, m_WritingWalker);
-}
-
-void MessageReplicator::WriteString(const std::string& value)
-{
-	MUtility::Serialization::WriteString(value, m_WritingWalker);
-}
-
-void MessageReplicator::ReadMemory(void* value, uint32_t byteSize)
-{
-	MUtility::Serialization::CopyAndIncrementSource(value, m_ReadingWalker, byteSize);
-}
-	 
-void MessageReplicator::ReadInt16(int16_t& value)
-{
-	MUtility::Serialization::ReadInt16( value, m_ReadingWalker );
-}
-
-void MessageReplicator::ReadInt32(int32_t& value)
-{
-	MUtility::Serialization::ReadInt32(value, m_ReadingWalker);
-}
-
-void MessageReplicator::ReadInt64(int64_t&	value)
+void MessageReplicator::BeginWrite(MessageSize initialCapacity)
 {
-	MUtility::Serialization::ReadInt64(value, m_ReadingWalker);
+	t_Writer.BeginGrowable(initialCapacity);
 }
 
-void MessageReplicator::ReadUint16(uint16_t& value)
+void MessageReplicator::BeginWrite(MUtility::Byte* buffer, MessageSize capacity)
 {
-	MUtility::Serialization::ReadUInt16(value, m_ReadingWalker);
+	t_Writer.BeginFixed(buffer, capacity);
 }
 
-void MessageReplicator::ReadUint32(uint32_t& value)
+MUtility::Byte* MessageReplicator::EndWrite(MessageSize* outWrittenByteCount)
 {
-	MUtility::Serialization::ReadUint32(value, m_ReadingWalker);
+	return t_Writer.Release(outWrittenByteCount);
 }
 
-void MessageReplicator::ReadUint64(uint64_t& value)
+void MessageReplicator::BeginRead(const MUtility::Byte* serializedMessage)
 {
-	MUtility::Serialization::ReadUint64(value, m_ReadingWalker);
-}
-
-void MessageReplicator::ReadFloat(float& value)
-{
-	MUtility::Serialization::ReadFloat(value, m_ReadingWalker);
-}
+	if (serializedMessage == nullptr)
+	{
+		t_Reader.Reset();
+		return;
+	}
 
-void MessageReplicator::ReadDouble(double& value)
-{
-	MUtility::Serialization::ReadDouble(value, m_ReadingWalker);
+	// The size at the start of the header covers the whole message; Tubes has already verified that this many bytes were received
+	MessageSize messageSize;
+	memcpy(&messageSize, serializedMessage, sizeof(MessageSize));
+	t_Reader.Begin(serializedMessage, serializedMessage + (messageSize > 0 ? messageSize : 0));
 }
 
-void MessageReplicator::ReadBool(bool&	value)
+void MessageReplicator::BeginRead(const MessageView& view)
 {
-	MUtility::Serialization::ReadBool(value, m_ReadingWalker);
+	t_Reader.Begin(view.Payload, view.Payload + view.PayloadSize);
 }
 
-void MessageReplicator::ReadString(std::string& value)
+bool MessageReplicator::EndRead()
 {
-	MUtility::Serialization::ReadString(value, m_ReadingWalker);
-}
+	bool succeeded = !t_Reader.HasFailed();
+	t_Reader.Reset();
+	return succeeded;
+}
\ No newline at end of file
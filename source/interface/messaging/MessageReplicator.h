@@ -1,6 +1,9 @@
 #pragma once
 #include "MessagingTypes.h"
 #include "Message.h"
+#include "MessageAllocator.h"
+#include "MessageView.h"
+#include "SerializationCursor.h"
 #include <MUtilityByte.h>
 #include <string>
 
@@ -8,40 +11,75 @@ class MessageReplicator
 {
 public:
 	MessageReplicator(ReplicatorID id);
+	virtual ~MessageReplicator() = default; // Tubes deletes the registered replicators through this base class on shutdown
 
+	// Tubes releases both the returned serialized buffers and the deserialized messages through MessageAllocator::Free. They should be allocated using MessageAllocator::Allocate, though malloc works as well
 	virtual MUtility::Byte*	SerializeMessage(const Message* message, MessageSize* outMessageSize = nullptr, MUtility::Byte* optionalWritingBuffer = nullptr) = 0;
 	virtual Message*		DeserializeMessage(const MUtility::Byte* const buffer) = 0; // TODODB: Return how many bytes were read instead // TODODB: Take optionalwritingbuffer as parameter
 	virtual MessageSize		CalculateMessageSize(const Message& message) const = 0;
 	
 	ReplicatorID		GetID() const;
+
+	// Writing. Growable writes don't need the message size up front; EndWrite returns nullptr if a write failed
+	void				BeginWrite(MessageSize initialCapacity = DEFAULT_WRITE_CAPACITY);
+	void				BeginWrite(MUtility::Byte* buffer, MessageSize capacity);
+	MUtility::Byte*		EndWrite(MessageSize* outWrittenByteCount = nullptr);
+
+	// Reading. Reads are bounded by the size embedded in the message header (Or the payload size of a view) and fail instead of reading past it
+	void				BeginRead(const MUtility::Byte* serializedMessage);
+	void				BeginRead(const MessageView& view); // Lets the Read functions read the payload of a view without deserializing the message
+	bool				EndRead(); // Returns false if any read failed
 	
-	void				WriteMemory(const	void*			value, uint32_t byteSize);
-	void				WriteInt16(			int16_t			value);
-	void				WriteInt32(			int32_t			value);
-	void				WriteInt64(			int64_t			value);
-	void				WriteUint16(		uint16_t		value);
-	void				WriteUint32(		uint32_t		value);
-	void				WriteUint64(		uint64_t		value);
-	void				WriteFloat(			float			value);
-	void				WriteDouble(		double			value);
-	void				WriteBool(			bool			value);
-	void				WriteString(const	std::string&	value);
+	bool				WriteMemory(const	void*			value, uint32_t byteSize)	{ return t_Writer.WriteMemory(value, byteSize); }
+	bool				WriteInt16(			int16_t			value)						{ return t_Writer.Write(value); }
+	bool				WriteInt32(			int32_t			value)						{ return t_Writer.Write(value); }
+	bool				WriteInt64(			int64_t			value)						{ return t_Writer.Write(value); }
+	bool				WriteUint16(		uint16_t		value)						{ return t_Writer.Write(value); }
+	bool				WriteUint32(		uint32_t		value)						{ return t_Writer.Write(value); }
+	bool				WriteUint64(		uint64_t		value)						{ return t_Writer.Write(value); }
+	bool				WriteFloat(			float			value)						{ return t_Writer.Write(value); }
+	bool				WriteDouble(		double			value)						{ return t_Writer.Write(value); }
+	bool				WriteBool(			bool			value)						{ return t_Writer.Write(value); }
+	bool				WriteString(const	std::string&	value)						{ return t_Writer.WriteString(value); }
+
+	// Compact encodings. Smaller on the wire than the fixed width functions for values that are usually small
+	bool				WriteVarInt32(		int32_t			value)						{ return t_Writer.WriteVarInt(value); }
+	bool				WriteVarInt64(		int64_t			value)						{ return t_Writer.WriteVarInt(value); }
+	bool				WriteVarUint32(		uint32_t		value)						{ return t_Writer.WriteVarUint(value); }
+	bool				WriteVarUint64(		uint64_t		value)						{ return t_Writer.WriteVarUint(value); }
+	bool				WritePackedBools(const bool*		values, uint32_t count)		{ return t_Writer.WritePackedBools(values, count); }
+	bool				WriteQuantizedFloat(float			value, float min, float max, uint32_t bitCount) { return t_Writer.WriteQuantizedFloat(value, min, max, bitCount); }
 	
-	void				ReadMemory(			void*			value, uint32_t byteSize);
-	void				ReadInt16(			int16_t&		value);
-	void				ReadInt32(			int32_t&		value);
-	void				ReadInt64(			int64_t&		value);
-	void				ReadUint16(			uint16_t&		value);
-	void				ReadUint32(			uint32_t&		value);
-	void				ReadUint64(			uint64_t&		value);
-	void				ReadFloat(			float&			value);
-	void				ReadDouble(			double&			value);
-	void				ReadBool(			bool&			value);
-	void				ReadString(			std::string&	value);
+	bool				ReadMemory(			void*			value, uint32_t byteSize)	{ return t_Reader.ReadMemory(value, byteSize); }
+	bool				ReadInt16(			int16_t&		value)						{ return t_Reader.Read(value); }
+	bool				ReadInt32(			int32_t&		value)						{ return t_Reader.Read(value); }
+	bool				ReadInt64(			int64_t&		value)						{ return t_Reader.Read(value); }
+	bool				ReadUint16(			uint16_t&		value)						{ return t_Reader.Read(value); }
+	bool				ReadUint32(			uint32_t&		value)						{ return t_Reader.Read(value); }
+	bool				ReadUint64(			uint64_t&		value)						{ return t_Reader.Read(value); }
+	bool				ReadFloat(			float&			value)						{ return t_Reader.Read(value); }
+	bool				ReadDouble(			double&			value)						{ return t_Reader.Read(value); }
+	bool				ReadBool(			bool&			value)						{ return t_Reader.Read(value); }
+	bool				ReadString(			std::string&	value)						{ return t_Reader.ReadString(value); }
+
+	bool				ReadVarInt32(		int32_t&		value)						{ return t_Reader.ReadVarInt(value); }
+	bool				ReadVarInt64(		int64_t&		value)						{ return t_Reader.ReadVarInt(value); }
+	bool				ReadVarUint32(		uint32_t&		value)						{ return t_Reader.ReadVarUint(value); }
+	bool				ReadVarUint64(		uint64_t&		value)						{ return t_Reader.ReadVarUint(value); }
+	bool				ReadPackedBools(	bool*			values, uint32_t count)		{ return t_Reader.ReadPackedBools(values, count); }
+	bool				ReadQuantizedFloat(	float&			value, float min, float max, uint32_t bitCount) { return t_Reader.ReadQuantizedFloat(value, min, max, bitCount); }
+
+	static constexpr MessageSize DEFAULT_WRITE_CAPACITY = 64;
 
 protected:
-	MUtility::Byte*			m_WritingWalker		= nullptr;
-	const MUtility::Byte*	m_ReadingWalker		= nullptr;
+	// Generated implementations of the replicator functions for schema messages. Defined in MessageSchema.h
+	template<typename... MessageTypes> MUtility::Byte*	SerializeWithSchemas(const Message* message, MessageSize* outMessageSize, MUtility::Byte* optionalWritingBuffer);
+	template<typename... MessageTypes> Message*			DeserializeWithSchemas(const MUtility::Byte* const buffer);
+	template<typename... MessageTypes> MessageSize		CalculateSizeWithSchemas(const Message& message) const;
+
+	// Per thread since network threads serving different shards may replicate messages through the same replicator at the same time
+	static thread_local WriteCursor	t_Writer;
+	static thread_local ReadCursor	t_Reader;
 
 private:
 	ReplicatorID m_ID;
@@ -0,0 +1,355 @@
+#pragma once
+#include "Message.h"
+#include "MessageAllocator.h"
+#include "MessageReplicator.h"
+#include "SerializationCursor.h"
+#include <MUtilityByte.h>
+#include <initializer_list>
+#include <new>
+#include <string>
+#include <type_traits>
+
+// Compile time message schemas. A message declares its fields once and the serialization, deserialization and size calculation are generated from that declaration.
+//
+// Example:
+//	struct PositionMessage : UserMessage
+//	{
+//		PositionMessage() : UserMessage(POSITION, MY_REPLICATOR_ID) {}
+//
+//		float X;
+//		float Y;
+//
+//		using Schema = MessageSchema<POSITION, SCHEMA_FIELD(PositionMessage, X), SCHEMA_FIELD(PositionMessage, Y)>;
+//	};
+//
+//	class MyReplicator : public SchemaReplicator<PositionMessage, ...> { ... };
+//
+// Schema messages must be default constructible. Messages whose fields all have a fixed size get a constexpr size and are copied field by field without per field bounds checks.
+
+#define SCHEMA_FIELD(Class, Member)			SchemaField<Class, decltype(Class::Member), &Class::Member>
+#define SCHEMA_VARINT_FIELD(Class, Member)	SchemaField<Class, decltype(Class::Member), &Class::Member, SchemaVarintTraits<decltype(Class::Member)>> // Integer fields written as (zigzag) varints
+
+template<typename T, typename Enable = void>
+struct SchemaFieldTraits // Trivially copyable types are written as their raw bytes
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Schema fields must be trivially copyable or have a SchemaFieldTraits specialization");
+
+	static constexpr bool			IS_FIXED_SIZE	= true;
+	static constexpr MessageSize	FIXED_SIZE		= sizeof(T);
+
+	static bool			Write(WriteCursor& cursor, const T& value)	{ return cursor.Write(value); }
+	static bool			Read(ReadCursor& cursor, T& outValue)		{ return cursor.Read(outValue); }
+	static MessageSize	CalculateSize(const T&)						{ return sizeof(T); }
+};
+
+template<>
+struct SchemaFieldTraits<std::string> // Written as a uint32 length followed by the characters
+{
+	static constexpr bool			IS_FIXED_SIZE	= false;
+	static constexpr MessageSize	FIXED_SIZE		= 0;
+
+	static bool			Write(WriteCursor& cursor, const std::string& value)	{ return cursor.WriteString(value); }
+	static bool			Read(ReadCursor& cursor, std::string& outValue)			{ return cursor.ReadString(outValue); }
+	static MessageSize	CalculateSize(const std::string& value)					{ return static_cast<MessageSize>(sizeof(uint32_t) + value.size()); }
+};
+
+template<typename T>
+struct SchemaVarintTraits
+{
+	static_assert(std::is_integral<T>::value && (sizeof(T) == 4 || sizeof(T) == 8), "Varint schema fields must be 32 or 64 bit integers");
+
+	typedef typename std::conditional<sizeof(T) == 4,
+		typename std::conditional<std::is_signed<T>::value, int32_t, uint32_t>::type,
+		typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type>::type WireType; // The cursor overload that range checks for T
+
+	static constexpr bool			IS_FIXED_SIZE	= false;
+	static constexpr MessageSize	FIXED_SIZE		= 0;
+
+	static bool Write(WriteCursor& cursor, const T& value)
+	{
+		return std::is_signed<T>::value ? cursor.WriteVarInt(static_cast<int64_t>(value)) : cursor.WriteVarUint(static_cast<uint64_t>(value));
+	}
+
+	static bool Read(ReadCursor& cursor, T& outValue)
+	{
+		WireType value;
+		bool result = ReadWireType(cursor, value);
+		outValue = static_cast<T>(value);
+		return result;
+	}
+
+	static MessageSize CalculateSize(const T& value)
+	{
+		return CompactEncoding::GetVarintByteSize(std::is_signed<T>::value ? CompactEncoding::ZigZagEncode(static_cast<int64_t>(value)) : static_cast<uint64_t>(value));
+	}
+
+private:
+	static bool ReadWireType(ReadCursor& cursor, int32_t& outValue)		{ return cursor.ReadVarInt(outValue); }
+	static bool ReadWireType(ReadCursor& cursor, int64_t& outValue)		{ return cursor.ReadVarInt(outValue); }
+	static bool ReadWireType(ReadCursor& cursor, uint32_t& outValue)	{ return cursor.ReadVarUint(outValue); }
+	static bool ReadWireType(ReadCursor& cursor, uint64_t& outValue)	{ return cursor.ReadVarUint(outValue); }
+};
+
+template<typename Class, typename T, T Class::* Member, typename FieldTraits = SchemaFieldTraits<T>>
+struct SchemaField
+{
+	typedef FieldTraits Traits;
+
+	static constexpr bool			IS_FIXED_SIZE	= Traits::IS_FIXED_SIZE;
+	static constexpr MessageSize	FIXED_SIZE		= Traits::FIXED_SIZE;
+
+	static bool			Write(WriteCursor& cursor, const Class& message)	{ return Traits::Write(cursor, message.*Member); }
+	static bool			Read(ReadCursor& cursor, Class& message)			{ return Traits::Read(cursor, message.*Member); }
+	static MessageSize	CalculateSize(const Class& message)				{ return Traits::CalculateSize(message.*Member); }
+
+	static void			CopyTo(MUtility::Byte*& destination, const Class& message) // Only used for fixed size schemas where the space has already been claimed
+	{
+		memcpy(destination, &(message.*Member), sizeof(T));
+		destination += sizeof(T);
+	}
+
+	static void			CopyFrom(const MUtility::Byte*& source, Class& message)
+	{
+		memcpy(&(message.*Member), source, sizeof(T));
+		source += sizeof(T);
+	}
+};
+
+namespace MessageSchemaUtility
+{
+	constexpr bool AllTrue() { return true; }
+	template<typename... Rest>
+	constexpr bool AllTrue(bool first, Rest... rest) { return first && AllTrue(rest...); }
+
+	constexpr MessageSize Sum() { return 0; }
+	template<typename... Rest>
+	constexpr MessageSize Sum(MessageSize first, Rest... rest) { return first + Sum(rest...); }
+
+	inline bool AllSucceeded(std::initializer_list<bool> results)
+	{
+		for (bool result : results)
+		{
+			if (!result)
+				return false;
+		}
+		return true;
+	}
+}
+
+template<MESSAGE_TYPE_ENUM_UNDELYING_TYPE Type, typename... Fields>
+struct MessageSchema
+{
+	static constexpr MESSAGE_TYPE_ENUM_UNDELYING_TYPE	TYPE				= Type;
+	static constexpr bool								IS_FIXED_SIZE		= MessageSchemaUtility::AllTrue(Fields::IS_FIXED_SIZE...);
+	static constexpr MessageSize						FIXED_PAYLOAD_SIZE	= IS_FIXED_SIZE ? MessageSchemaUtility::Sum(Fields::FIXED_SIZE...) : 0;
+
+	template<typename Class>
+	static MessageSize CalculatePayloadSize(const Class& message)
+	{
+		return IS_FIXED_SIZE ? FIXED_PAYLOAD_SIZE : MessageSchemaUtility::Sum(Fields::CalculateSize(message)...);
+	}
+
+	template<typename Class>
+	static bool WritePayload(WriteCursor& cursor, const Class& message)
+	{
+		return WritePayload(cursor, message, std::integral_constant<bool, IS_FIXED_SIZE>());
+	}
+
+	template<typename Class>
+	static bool ReadPayload(ReadCursor& cursor, Class& message)
+	{
+		return ReadPayload(cursor, message, std::integral_constant<bool, IS_FIXED_SIZE>());
+	}
+
+private:
+	template<typename Class>
+	static bool WritePayload(WriteCursor& cursor, const Class& message, std::true_type) // Fixed size; check the bounds once and copy every field
+	{
+		MUtility::Byte* destination = cursor.Claim(FIXED_PAYLOAD_SIZE);
+		if (destination == nullptr)
+			return false;
+
+		(void)message;
+		(void)destination;
+		int expansion[] = { 0, (Fields::CopyTo(destination, message), 0)... }; // Braced initializers are evaluated in order
+		(void)expansion;
+		return true;
+	}
+
+	template<typename Class>
+	static bool WritePayload(WriteCursor& cursor, const Class& message, std::false_type)
+	{
+		return MessageSchemaUtility::AllSucceeded({ true, Fields::Write(cursor, message)... });
+	}
+
+	template<typename Class>
+	static bool ReadPayload(ReadCursor& cursor, Class& message, std::true_type)
+	{
+		const MUtility::Byte* source = cursor.Claim(FIXED_PAYLOAD_SIZE);
+		if (source == nullptr)
+			return false;
+
+		(void)message;
+		(void)source;
+		int expansion[] = { 0, (Fields::CopyFrom(source, message), 0)... };
+		(void)expansion;
+		return true;
+	}
+
+	template<typename Class>
+	static bool ReadPayload(ReadCursor& cursor, Class& message, std::false_type)
+	{
+		return MessageSchemaUtility::AllSucceeded({ true, Fields::Read(cursor, message)... });
+	}
+};
+
+// Type erased entry points for one schema message type. Used to build the dispatch tables of schema replicators
+template<typename MessageType>
+struct SchemaMessageFunctions
+{
+	typedef typename MessageType::Schema Schema;
+
+	static MessageSize CalculateSize(const Message& message)
+	{
+		return MESSAGE_HEADER_SIZE + Schema::CalculatePayloadSize(static_cast<const MessageType&>(message));
+	}
+
+	static bool WritePayload(WriteCursor& cursor, const Message& message)
+	{
+		return Schema::WritePayload(cursor, static_cast<const MessageType&>(message));
+	}
+
+	static Message* Read(ReadCursor& cursor)
+	{
+		MessageType* message = new (MessageAllocator::Allocate(sizeof(MessageType))) MessageType();
+		if (!Schema::ReadPayload(cursor, *message))
+		{
+			message->Destroy();
+			MessageAllocator::Free(message);
+			return nullptr;
+		}
+		return message;
+	}
+};
+
+struct SchemaDispatchEntry
+{
+	MESSAGE_TYPE_ENUM_UNDELYING_TYPE	Type;
+	bool								IsFixedSize;
+	MessageSize							FixedSize; // Including the header
+	MessageSize							(*CalculateSize)(const Message& message);
+	bool								(*WritePayload)(WriteCursor& cursor, const Message& message);
+	Message*							(*Read)(ReadCursor& cursor);
+};
+
+template<typename... MessageTypes>
+struct SchemaDispatchTable
+{
+	static const SchemaDispatchEntry* Find(MESSAGE_TYPE_ENUM_UNDELYING_TYPE type)
+	{
+		static const SchemaDispatchEntry entries[] =
+		{
+			{
+				MessageTypes::Schema::TYPE,
+				MessageTypes::Schema::IS_FIXED_SIZE,
+				MESSAGE_HEADER_SIZE + MessageTypes::Schema::FIXED_PAYLOAD_SIZE,
+				&SchemaMessageFunctions<MessageTypes>::CalculateSize,
+				&SchemaMessageFunctions<MessageTypes>::WritePayload,
+				&SchemaMessageFunctions<MessageTypes>::Read
+			}...
+		};
+		constexpr size_t entryCount = sizeof...(MessageTypes);
+
+		// Message types are usually enumerated from 0 so the entry can almost always be indexed directly
+		if (type < entryCount && entries[type].Type == type)
+			return &entries[type];
+
+		for (size_t i = 0; i < entryCount; ++i)
+		{
+			if (entries[i].Type == type)
+				return &entries[i];
+		}
+		return nullptr;
+	}
+};
+
+template<typename... MessageTypes>
+MUtility::Byte* MessageReplicator::SerializeWithSchemas(const Message* message, MessageSize* outMessageSize, MUtility::Byte* optionalWritingBuffer)
+{
+	const SchemaDispatchEntry* entry = SchemaDispatchTable<MessageTypes...>::Find(message->Type);
+	if (entry == nullptr)
+		return nullptr;
+
+	// Fixed size messages are written into an exactly sized buffer; others grow the buffer as needed and patch the size afterwards
+	MessageSize knownSize = entry->IsFixedSize ? entry->FixedSize : 0;
+	if (optionalWritingBuffer != nullptr)
+		BeginWrite(optionalWritingBuffer, knownSize > 0 ? knownSize : entry->CalculateSize(*message));
+	else
+		BeginWrite(knownSize > 0 ? knownSize : DEFAULT_WRITE_CAPACITY);
+
+	t_Writer.Write(knownSize);
+	t_Writer.Write(message->Replicator_ID);
+	t_Writer.Write(message->Type);
+	entry->WritePayload(t_Writer, *message);
+
+	if (!entry->IsFixedSize)
+	{
+		MessageSize messageSize = t_Writer.GetWrittenByteCount();
+		t_Writer.WriteAt(0, &messageSize, sizeof(MessageSize));
+	}
+
+	return EndWrite(outMessageSize);
+}
+
+template<typename... MessageTypes>
+Message* MessageReplicator::DeserializeWithSchemas(const MUtility::Byte* const buffer)
+{
+	BeginRead(buffer);
+
+	MESSAGE_TYPE_ENUM_UNDELYING_TYPE type = 0;
+	t_Reader.Skip(sizeof(MessageSize) + sizeof(ReplicatorID));
+	t_Reader.Read(type);
+
+	Message* message = nullptr;
+	const SchemaDispatchEntry* entry = SchemaDispatchTable<MessageTypes...>::Find(type);
+	if (entry != nullptr)
+		message = entry->Read(t_Reader);
+
+	if (!EndRead() && message != nullptr) // The header may have been cut short even if the payload read succeeded
+	{
+		message->Destroy();
+		MessageAllocator::Free(message);
+		message = nullptr;
+	}
+	return message;
+}
+
+template<typename... MessageTypes>
+MessageSize MessageReplicator::CalculateSizeWithSchemas(const Message& message) const
+{
+	const SchemaDispatchEntry* entry = SchemaDispatchTable<MessageTypes...>::Find(message.Type);
+	return entry != nullptr ? entry->CalculateSize(message) : 0;
+}
+
+// Replicator for a set of schema messages. All three replicator functions are generated from the schemas
+template<typename... MessageTypes>
+class SchemaReplicator : public MessageReplicator
+{
+public:
+	SchemaReplicator(ReplicatorID id) : MessageReplicator(id) {}
+
+	MUtility::Byte* SerializeMessage(const Message* message, MessageSize* outMessageSize = nullptr, MUtility::Byte* optionalWritingBuffer = nullptr) override
+	{
+		return SerializeWithSchemas<MessageTypes...>(message, outMessageSize, optionalWritingBuffer);
+	}
+
+	Message* DeserializeMessage(const MUtility::Byte* const buffer) override
+	{
+		return DeserializeWithSchemas<MessageTypes...>(buffer);
+	}
+
+	MessageSize CalculateMessageSize(const Message& message) const override
+	{
+		return CalculateSizeWithSchemas<MessageTypes...>(message);
+	}
+};
\ No newline at end of file
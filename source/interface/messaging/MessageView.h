@@ -0,0 +1,16 @@
+#pragma once
+#include "MessagingTypes.h"
+#include "Message.h"
+#include <MUtilityByte.h>
+
+// Non owning view of a received message that points straight into the receive buffer of the connection it arrived on.
+// A view is only valid until the next call to Tubes::Receive or Tubes::ReceiveViews.
+struct MessageView
+{
+	const MUtility::Byte*				Data			= nullptr;	// Start of the serialized message (Including the header). Can be passed to MessageReplicator::DeserializeMessage
+	MessageSize							Size			= 0;
+	const MUtility::Byte*				Payload			= nullptr;	// The bytes following the header. Can be read using MessageReplicator::BeginRead
+	MessageSize							PayloadSize		= 0;
+	ReplicatorID						Replicator_ID	= INVALID_REPLICATOR_ID;
+	MESSAGE_TYPE_ENUM_UNDELYING_TYPE	Type			= 0;
+};
\ No newline at end of file
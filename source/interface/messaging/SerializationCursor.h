@@ -0,0 +1,436 @@
+#pragma once
+#include "MessagingTypes.h"
+#include "MessageAllocator.h"
+#include <MUtilityByte.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <type_traits>
+
+// Bounds checked replacements for raw serialization walkers. Both cursors know where their buffer ends;
+// a write that doesn't fit either grows the buffer (Growable cursors) or fails, and a read past the end fails instead of reading out of bounds.
+// Once a cursor has failed every following operation fails as well, so the result only needs to be checked once at the end.
+// Everything is defined in this header so that the common case compiles down to a bounds check and a memcpy.
+// The compact encodings (Varints, zigzag, packed bools and quantized floats) trade a little CPU for fewer bytes on the wire.
+
+namespace CompactEncoding
+{
+	constexpr int32_t	MAX_VARINT_BYTE_SIZE		= 10; // A 64 bit value needs at most 10 groups of 7 bits
+	constexpr uint32_t	MAX_QUANTIZED_BIT_COUNT		= 32; // Quantized floats are stored in a uint32
+
+	inline uint64_t	ZigZagEncode(int64_t value)		{ return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); } // Maps small negative values to small positive ones
+	inline int64_t	ZigZagDecode(uint64_t value)	{ return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+	inline int32_t GetVarintByteSize(uint64_t value)
+	{
+		int32_t byteSize = 1;
+		while (value >= 0x80)
+		{
+			value >>= 7;
+			++byteSize;
+		}
+		return byteSize;
+	}
+
+	inline int32_t EncodeVarint(uint64_t value, MUtility::Byte* destination) // Returns the number of bytes written. The destination must have room for MAX_VARINT_BYTE_SIZE bytes
+	{
+		int32_t byteSize = 0;
+		while (value >= 0x80)
+		{
+			destination[byteSize++] = static_cast<MUtility::Byte>(value | 0x80);
+			value >>= 7;
+		}
+		destination[byteSize++] = static_cast<MUtility::Byte>(value);
+		return byteSize;
+	}
+
+	inline int32_t DecodeVarint(const MUtility::Byte* source, size_t availableByteCount, uint64_t& outValue) // Returns the number of bytes read, 0 if the varint is incomplete and -1 if it is malformed
+	{
+		outValue = 0;
+		for (int32_t i = 0; i < MAX_VARINT_BYTE_SIZE; ++i)
+		{
+			if (static_cast<size_t>(i) >= availableByteCount)
+				return 0;
+
+			outValue |= static_cast<uint64_t>(source[i] & 0x7F) << (7 * i);
+			if ((source[i] & 0x80) == 0)
+				return i + 1;
+		}
+		return -1;
+	}
+
+	inline bool IsValidQuantization(float min, float max, uint32_t bitCount) // Quantization needs between 1 and 32 bits and a non empty range
+	{
+		return bitCount >= 1 && bitCount <= MAX_QUANTIZED_BIT_COUNT && min < max;
+	}
+
+	inline uint32_t QuantizeFloat(float value, float min, float max, uint32_t bitCount) // Returns 0 if the quantization is invalid
+	{
+		if (!IsValidQuantization(min, max, bitCount))
+			return 0;
+
+		uint32_t maxQuantized = bitCount == MAX_QUANTIZED_BIT_COUNT ? UINT32_MAX : (1U << bitCount) - 1;
+		float clamped = value > min ? (value < max ? value : max) : min; // NaN clamps to min
+		return static_cast<uint32_t>(static_cast<double>(clamped - min) / (max - min) * maxQuantized + 0.5);
+	}
+
+	inline float DequantizeFloat(uint32_t quantized, float min, float max, uint32_t bitCount) // Returns min if the quantization is invalid
+	{
+		if (!IsValidQuantization(min, max, bitCount))
+			return min;
+
+		uint32_t maxQuantized = bitCount == MAX_QUANTIZED_BIT_COUNT ? UINT32_MAX : (1U << bitCount) - 1;
+		return static_cast<float>(min + static_cast<double>(quantized) / maxQuantized * (max - min));
+	}
+}
+
+class WriteCursor
+{
+public:
+	WriteCursor() {}
+	~WriteCursor() { Reset(); }
+
+	WriteCursor(const WriteCursor& other) = delete;
+	WriteCursor& operator=(const WriteCursor& other) = delete;
+
+	void BeginFixed(MUtility::Byte* buffer, MessageSize capacity); // Writes into a caller owned buffer
+	void BeginGrowable(MessageSize initialCapacity); // Writes into a buffer allocated through MessageAllocator that grows as needed
+	void Reset();
+
+	bool WriteMemory(const void* source, size_t byteSize)
+	{
+		if (static_cast<size_t>(m_End - m_Position) < byteSize && !Grow(byteSize))
+			return false;
+
+		memcpy(m_Position, source, byteSize);
+		m_Position += byteSize;
+		return true;
+	}
+
+	template<typename T>
+	bool Write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be written directly");
+		return WriteMemory(&value, sizeof(T));
+	}
+
+	bool WriteString(const std::string& value)
+	{
+		uint32_t length = static_cast<uint32_t>(value.size());
+		return Write(length) && WriteMemory(value.data(), length);
+	}
+
+	MUtility::Byte* Claim(size_t byteSize) // Reserves byteSize bytes and returns where to write them so that a known amount of data can be written without further checks. Returns nullptr on failure
+	{
+		if (static_cast<size_t>(m_End - m_Position) < byteSize && !Grow(byteSize))
+			return nullptr;
+
+		MUtility::Byte* claimed = m_Position;
+		m_Position += byteSize;
+		return claimed;
+	}
+
+	bool WriteVarUint(uint64_t value)
+	{
+		MUtility::Byte encoded[CompactEncoding::MAX_VARINT_BYTE_SIZE];
+		return WriteMemory(encoded, CompactEncoding::EncodeVarint(value, encoded));
+	}
+
+	bool WriteVarInt(int64_t value) { return WriteVarUint(CompactEncoding::ZigZagEncode(value)); }
+
+	bool WritePackedBools(const bool* values, uint32_t count) // Eight bools per byte
+	{
+		MUtility::Byte* destination = Claim((count + 7) / 8);
+		if (destination == nullptr)
+			return false;
+
+		memset(destination, 0, (count + 7) / 8);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			destination[i / 8] |= static_cast<MUtility::Byte>(values[i]) << (i % 8);
+		}
+		return true;
+	}
+
+	bool WriteQuantizedFloat(float value, float min, float max, uint32_t bitCount) // Uses the smallest whole number of bytes that fits bitCount bits. Fails unless 1 <= bitCount <= 32 and min < max
+	{
+		if (!CompactEncoding::IsValidQuantization(min, max, bitCount))
+		{
+			Fail();
+			return false;
+		}
+
+		uint32_t quantized = CompactEncoding::QuantizeFloat(value, min, max, bitCount);
+		return WriteMemory(&quantized, (bitCount + 7) / 8); // Little endian so the low bytes come first
+	}
+
+	bool WriteAt(MessageSize offset, const void* source, size_t byteSize) // Overwrites already written bytes (E.g. a size field that wasn't known up front)
+	{
+		if (m_Failed || offset < 0 || offset > GetWrittenByteCount() || static_cast<size_t>(GetWrittenByteCount() - offset) < byteSize)
+			return false;
+
+		memcpy(m_Begin + offset, source, byteSize);
+		return true;
+	}
+
+	MUtility::Byte*	Release(MessageSize* outWrittenByteCount = nullptr); // Hands the written buffer over to the caller. Returns nullptr if a write failed
+
+	MUtility::Byte*	GetBegin() const				{ return m_Begin; }
+	MessageSize		GetWrittenByteCount() const	{ return static_cast<MessageSize>(m_Position - m_Begin); }
+	bool			HasFailed() const				{ return m_Failed; }
+
+private:
+	bool Grow(size_t requiredByteCount);
+
+	void Fail()
+	{
+		m_Failed	= true;
+		m_End		= m_Position; // Make sure that no later write fits either
+	}
+
+	MUtility::Byte*	m_Begin		= nullptr;
+	MUtility::Byte*	m_Position	= nullptr;
+	MUtility::Byte*	m_End		= nullptr;
+	bool			m_Growable	= false;
+	bool			m_Failed	= false;
+};
+
+class ReadCursor
+{
+public:
+	ReadCursor() {}
+	ReadCursor(const MUtility::Byte* begin, const MUtility::Byte* end) { Begin(begin, end); }
+
+	void Begin(const MUtility::Byte* begin, const MUtility::Byte* end)
+	{
+		m_Position	= begin;
+		m_End		= end;
+		m_Failed	= begin == nullptr || end < begin;
+	}
+
+	void Reset() { Begin(nullptr, nullptr); }
+
+	bool ReadMemory(void* destination, size_t byteSize)
+	{
+		if (m_Failed || static_cast<size_t>(m_End - m_Position) < byteSize)
+		{
+			Fail();
+			memset(destination, 0, byteSize); // Never leave the destination uninitialized
+			return false;
+		}
+
+		memcpy(destination, m_Position, byteSize);
+		m_Position += byteSize;
+		return true;
+	}
+
+	template<typename T>
+	bool Read(T& outValue)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable types can be read directly");
+		return ReadMemory(&outValue, sizeof(T));
+	}
+
+	bool ReadString(std::string& outValue)
+	{
+		uint32_t length = 0;
+		if (!Read(length) || GetRemainingByteCount() < length) // Check the length before allocating so that a corrupt length can't trigger a huge allocation
+		{
+			Fail();
+			outValue.clear();
+			return false;
+		}
+
+		outValue.assign(reinterpret_cast<const char*>(m_Position), length);
+		m_Position += length;
+		return true;
+	}
+
+	const MUtility::Byte* Claim(size_t byteSize) // Returns where the next byteSize bytes are and skips past them so that a known amount of data can be read without further checks. Returns nullptr on failure
+	{
+		if (m_Failed || static_cast<size_t>(m_End - m_Position) < byteSize)
+		{
+			Fail();
+			return nullptr;
+		}
+
+		const MUtility::Byte* claimed = m_Position;
+		m_Position += byteSize;
+		return claimed;
+	}
+
+	bool ReadVarUint(uint64_t& outValue)
+	{
+		int32_t byteSize = m_Failed ? -1 : CompactEncoding::DecodeVarint(m_Position, static_cast<size_t>(m_End - m_Position), outValue);
+		if (byteSize <= 0)
+		{
+			Fail();
+			outValue = 0;
+			return false;
+		}
+
+		m_Position += byteSize;
+		return true;
+	}
+
+	bool ReadVarInt(int64_t& outValue)
+	{
+		uint64_t encoded;
+		bool result = ReadVarUint(encoded);
+		outValue = CompactEncoding::ZigZagDecode(encoded);
+		return result;
+	}
+
+	bool ReadVarUint(uint32_t& outValue) // Fails if the value doesn't fit in 32 bits
+	{
+		uint64_t wide;
+		if (!ReadVarUint(wide) || wide > UINT32_MAX)
+		{
+			Fail();
+			outValue = 0;
+			return false;
+		}
+		outValue = static_cast<uint32_t>(wide);
+		return true;
+	}
+
+	bool ReadVarInt(int32_t& outValue) // Fails if the value doesn't fit in 32 bits
+	{
+		int64_t wide;
+		if (!ReadVarInt(wide) || wide < INT32_MIN || wide > INT32_MAX)
+		{
+			Fail();
+			outValue = 0;
+			return false;
+		}
+		outValue = static_cast<int32_t>(wide);
+		return true;
+	}
+
+	bool ReadPackedBools(bool* outValues, uint32_t count)
+	{
+		const MUtility::Byte* source = Claim((count + 7) / 8);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			outValues[i] = source != nullptr && ((source[i / 8] >> (i % 8)) & 1) != 0;
+		}
+		return source != nullptr;
+	}
+
+	bool ReadQuantizedFloat(float& outValue, float min, float max, uint32_t bitCount) // Fails unless 1 <= bitCount <= 32 and min < max
+	{
+		if (!CompactEncoding::IsValidQuantization(min, max, bitCount))
+		{
+			Fail();
+			outValue = 0.0f;
+			return false;
+		}
+
+		uint32_t quantized = 0;
+		bool result = ReadMemory(&quantized, (bitCount + 7) / 8);
+		outValue = result ? CompactEncoding::DequantizeFloat(quantized, min, max, bitCount) : 0.0f;
+		return result;
+	}
+
+	bool Skip(size_t byteCount)
+	{
+		if (m_Failed || GetRemainingByteCount() < byteCount)
+		{
+			Fail();
+			return false;
+		}
+
+		m_Position += byteCount;
+		return true;
+	}
+
+	const MUtility::Byte*	GetPosition() const				{ return m_Position; }
+	size_t					GetRemainingByteCount() const	{ return m_Failed ? 0 : static_cast<size_t>(m_End - m_Position); }
+	bool					HasFailed() const				{ return m_Failed; }
+
+private:
+	void Fail()
+	{
+		m_Failed	= true;
+		m_Position	= m_End;
+	}
+
+	const MUtility::Byte*	m_Position	= nullptr;
+	const MUtility::Byte*	m_End		= nullptr;
+	bool					m_Failed	= true; // Reading without a buffer fails
+};
+
+inline void WriteCursor::BeginFixed(MUtility::Byte* buffer, MessageSize capacity)
+{
+	Reset();
+	m_Begin		= buffer;
+	m_Position	= buffer;
+	m_End		= buffer + capacity;
+	m_Failed	= buffer == nullptr;
+}
+
+inline void WriteCursor::BeginGrowable(MessageSize initialCapacity)
+{
+	Reset();
+	m_Growable = true;
+	Grow(initialCapacity > 0 ? initialCapacity : 1);
+}
+
+inline void WriteCursor::Reset()
+{
+	if (m_Growable && m_Begin != nullptr)
+		MessageAllocator::Free(m_Begin);
+
+	m_Begin		= nullptr;
+	m_Position	= nullptr;
+	m_End		= nullptr;
+	m_Growable	= false;
+	m_Failed	= false;
+}
+
+inline MUtility::Byte* WriteCursor::Release(MessageSize* outWrittenByteCount)
+{
+	MUtility::Byte* toReturn = m_Failed ? nullptr : m_Begin;
+	if (outWrittenByteCount != nullptr)
+		*outWrittenByteCount = m_Failed ? 0 : GetWrittenByteCount();
+
+	if (!m_Failed)
+		m_Begin = nullptr; // The caller owns the buffer now
+	Reset();
+	return toReturn;
+}
+
+inline bool WriteCursor::Grow(size_t requiredByteCount)
+{
+	if (m_Failed || !m_Growable)
+	{
+		Fail();
+		return false;
+	}
+
+	size_t writtenByteCount	= static_cast<size_t>(m_Position - m_Begin);
+	size_t capacity			= static_cast<size_t>(m_End - m_Begin);
+	size_t newCapacity		= capacity > 0 ? capacity * 2 : requiredByteCount;
+	while (newCapacity - writtenByteCount < requiredByteCount)
+	{
+		newCapacity *= 2;
+	}
+
+	MUtility::Byte* newBuffer = static_cast<MUtility::Byte*>(MessageAllocator::Allocate(newCapacity));
+	if (newBuffer == nullptr)
+	{
+		Fail();
+		return false;
+	}
+
+	if (m_Begin != nullptr)
+	{
+		memcpy(newBuffer, m_Begin, writtenByteCount);
+		MessageAllocator::Free(m_Begin);
+	}
+
+	m_Begin		= newBuffer;
+	m_Position	= newBuffer + writtenByteCount;
+	m_End		= newBuffer + newCapacity;
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures how long it takes until a storm of connections to self, all requested at once, has been accepted and verified.
+// Compares accepting on the update loop with accepting on network threads that share one listening socket or each have their own SO_REUSEPORT socket
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT					= 19490;
+	const uint32_t	CONNECTION_COUNT			= 1000; // Both ends are in this process, so this is twice as many sockets
+	const uint32_t	LISTEN_BACKLOG				= 1024;
+	const uint32_t	NETWORK_THREAD_COUNT		= 4;
+	const uint32_t	RUN_TIMEOUT_MILLISECONDS	= 20 * 1000;
+
+	void MeasureStorm(bool useNetworkThreads, bool useReusePortListeners, const std::string& modeName, uint16_t port)
+	{
+		Settings::ListenBacklog				= LISTEN_BACKLOG;
+		Settings::UseNetworkThread			= useNetworkThreads;
+		Settings::NetworkThreadCount		= NETWORK_THREAD_COUNT;
+		Settings::UseReusePortListeners		= useReusePortListeners;
+		if (!StartTubes())
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		uint32_t outgoingCount	= 0;
+		uint32_t incomingCount	= 0;
+		uint32_t failedCount	= 0;
+		ConnectionCallbackHandle handle = RegisterConnectionCallback([&](const ConnectionAttemptResultData& result)
+		{
+			if (result.Result == ConnectionAttemptResult::SUCCESS_OUTGOING)
+				++outgoingCount;
+			else if (result.Result == ConnectionAttemptResult::SUCCESS_INCOMING)
+				++incomingCount;
+			else
+				++failedCount;
+		});
+
+		if (StartListener(port))
+		{
+			uint64_t start = GetMicroseconds();
+			for (uint32_t i = 0; i < CONNECTION_COUNT; ++i)
+			{
+				RequestConnection(LOCALHOST_IP, port);
+			}
+			UpdateUntil([&]() { return outgoingCount + failedCount == CONNECTION_COUNT && incomingCount == outgoingCount; }, RUN_TIMEOUT_MILLISECONDS);
+			double milliseconds = (GetMicroseconds() - start) / 1000.0;
+
+			TEST_CHECK(incomingCount == CONNECTION_COUNT, modeName << " accepted " << incomingCount << " of " << CONNECTION_COUNT << " connections");
+			Report(modeName + ", " + std::to_string(CONNECTION_COUNT) + " connections accepted and verified", milliseconds, "ms");
+		}
+		else
+			TEST_CHECK(false, "Failed to listen on port " << port);
+
+		UnregisterConnectionCallback(handle);
+		StopTubes();
+	}
+}
+
+int main()
+{
+	MeasureStorm(false, false, "Update loop", FIRST_PORT);
+	MeasureStorm(true, false, std::to_string(NETWORK_THREAD_COUNT) + " network threads, one listening socket", FIRST_PORT + 1);
+	MeasureStorm(true, true, std::to_string(NETWORK_THREAD_COUNT) + " network threads, SO_REUSEPORT sockets", FIRST_PORT + 2);
+
+	return Finish("AcceptStormBenchmark");
+}
\ No newline at end of file
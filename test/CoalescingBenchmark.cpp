@@ -0,0 +1,116 @@
+#include "TestUtility.h"
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+// Measures what coalescing the messages of a frame saves. Every frame sends a few dozen small messages through a connection to self and ends with Update.
+// Reports the sender time per message and, on Linux, the TCP segments the host sent during the run, with and without Settings::UseMessageCoalescing
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT					= 19480;
+	const uint32_t	FRAME_COUNT					= 5000;
+	const uint32_t	MESSAGES_PER_FRAME			= 50;
+	const uint32_t	PAYLOAD_SIZE				= 16;
+	const uint32_t	RUN_TIMEOUT_MILLISECONDS	= 60 * 1000;
+
+	int64_t GetSentSegmentCount() // Counts every TCP segment the host sent, ACKs included. Returns -1 where the count isn't available
+	{
+#if PLATFORM == PLATFORM_WINDOWS
+		return -1;
+#else
+		std::ifstream snmp("/proc/net/snmp");
+		std::string header;
+		std::string values;
+		while (std::getline(snmp, header) && std::getline(snmp, values))
+		{
+			if (header.compare(0, 4, "Tcp:") != 0)
+				continue;
+
+			std::istringstream names(header);
+			std::istringstream counts(values);
+			std::string name;
+			std::string count;
+			while (names >> name && counts >> count)
+			{
+				if (name == "OutSegs")
+					return std::stoll(count);
+			}
+		}
+		return -1;
+#endif
+	}
+
+	void MeasureFrames(bool useMessageCoalescing, uint16_t port)
+	{
+		Settings::UseMessageCoalescing = useMessageCoalescing;
+		ConnectionID outgoingID;
+		ConnectionID incomingID;
+		if (!StartLoopback(port, outgoingID, incomingID))
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		StampedMessage message;
+		message.Payload = std::string(PAYLOAD_SIZE, 'x');
+
+		uint32_t	receivedCount		= 0;
+		uint32_t	mismatchCount		= 0;
+		uint64_t	senderMicroseconds	= 0;
+		int64_t		firstSegmentCount	= GetSentSegmentCount();
+		std::vector<Message*> messages;
+		for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			uint64_t start = GetMicroseconds();
+			for (uint32_t i = 0; i < MESSAGES_PER_FRAME; ++i)
+			{
+				message.Sequence = frame * MESSAGES_PER_FRAME + i;
+				SendToConnection(&message, outgoingID);
+			}
+			Update(); // Ends the frame
+			senderMicroseconds += GetMicroseconds() - start;
+
+			Receive(messages);
+			for (Message* receivedMessage : messages)
+			{
+				if (static_cast<const StampedMessage*>(receivedMessage)->Sequence != receivedCount++)
+					++mismatchCount;
+			}
+			FreeMessages(messages);
+		}
+
+		const uint32_t messageCount = FRAME_COUNT * MESSAGES_PER_FRAME;
+		UpdateUntil([&]()
+		{
+			Receive(messages);
+			for (Message* receivedMessage : messages)
+			{
+				if (static_cast<const StampedMessage*>(receivedMessage)->Sequence != receivedCount++)
+					++mismatchCount;
+			}
+			FreeMessages(messages);
+			return receivedCount >= messageCount;
+		}, RUN_TIMEOUT_MILLISECONDS);
+		int64_t lastSegmentCount = GetSentSegmentCount();
+		TEST_CHECK(receivedCount == messageCount, receivedCount << " of " << messageCount << " messages were received");
+		TEST_CHECK(mismatchCount == 0, mismatchCount << " messages arrived out of order");
+
+		std::string name = useMessageCoalescing ? "Coalesced" : "Uncoalesced";
+		Report(name + ", sender time", static_cast<double>(senderMicroseconds) * 1000.0 / messageCount, "ns/message");
+		if (firstSegmentCount >= 0 && lastSegmentCount >= 0)
+			Report(name + ", TCP segments sent by the host", static_cast<double>(lastSegmentCount - firstSegmentCount), "segments");
+		StopTubes();
+	}
+}
+
+int main()
+{
+	MeasureFrames(false, FIRST_PORT);
+	MeasureFrames(true, FIRST_PORT + 1);
+
+	return Finish("CoalescingBenchmark");
+}
\ No newline at end of file
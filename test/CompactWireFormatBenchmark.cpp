@@ -0,0 +1,107 @@
+#include "TestUtility.h"
+#include "SerializedMessage.h"
+#include <cstdint>
+
+// Measures what the compact encodings save on the wire and what they cost. Compares the fixed size and varint schemas of a small message and the throughput of a connection to self with and without the compact frame header
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT					= 19450;
+	const uint32_t	PAYLOAD_SIZE				= 4;
+	const uint32_t	SERIALIZE_COUNT				= 200000;
+	const uint32_t	MESSAGE_COUNT				= 200000;
+	const uint32_t	MAX_MESSAGES_IN_FLIGHT		= 8192;
+	const uint32_t	RUN_TIMEOUT_MILLISECONDS	= 60 * 1000;
+
+	struct VarintStampedMessage : StampedMessage // The stream and sequence are small numbers so they usually fit in one or two bytes as varints
+	{
+		using Schema = MessageSchema<STAMPED, SCHEMA_FIELD(StampedMessage, SentTime), SCHEMA_VARINT_FIELD(StampedMessage, Stream), SCHEMA_VARINT_FIELD(StampedMessage, Sequence), SCHEMA_FIELD(StampedMessage, Payload)>;
+	};
+
+	class VarintReplicator : public SchemaReplicator<VarintStampedMessage>
+	{
+	public:
+		VarintReplicator(ReplicatorID id) : SchemaReplicator(id) {}
+	};
+
+	void MeasureEncoding(MessageReplicator& replicator, const std::string& schemaName)
+	{
+		VarintStampedMessage message; // Either replicator can serialize it
+		message.SentTime	= GetMicroseconds();
+		message.Stream		= 1;
+		message.Sequence	= 100;
+		message.Payload		= std::string(PAYLOAD_SIZE, 'x');
+
+		uint64_t start = GetMicroseconds();
+		for (uint32_t i = 0; i < SERIALIZE_COUNT; ++i)
+		{
+			MessageAllocator::Free(replicator.SerializeMessage(&message));
+		}
+		double serializeNanoseconds = (GetMicroseconds() - start) * 1000.0 / SERIALIZE_COUNT;
+
+		MUtility::Byte* data = replicator.SerializeMessage(&message);
+		MessageSize size;
+		memcpy(&size, data, sizeof(MessageSize));
+		SerializedMessage* serializedMessage = SerializedMessage::Create(data, size);
+
+		Report(schemaName + ", serialize", serializeNanoseconds, "ns/message");
+		Report(schemaName + ", standard frame", serializedMessage->GetWireSize(false), "bytes");
+		Report(schemaName + ", compact frame", serializedMessage->GetWireSize(true), "bytes");
+		serializedMessage->Release();
+	}
+
+	void MeasureThroughput(bool useCompactWireFormat, uint16_t port)
+	{
+		Settings::UseCompactWireFormat = useCompactWireFormat;
+		ConnectionID outgoingID;
+		ConnectionID incomingID;
+		if (!StartLoopback(port, outgoingID, incomingID))
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		StampedMessage message;
+		message.Payload = std::string(PAYLOAD_SIZE, 'x');
+
+		uint32_t sentCount		= 0;
+		uint32_t receivedCount	= 0;
+		std::vector<Message*> messages;
+		uint64_t start		= GetMicroseconds();
+		uint64_t deadline	= start + RUN_TIMEOUT_MILLISECONDS * 1000ull;
+		while (receivedCount < MESSAGE_COUNT && GetMicroseconds() < deadline)
+		{
+			while (sentCount < MESSAGE_COUNT && sentCount - receivedCount < MAX_MESSAGES_IN_FLIGHT)
+			{
+				message.Sequence = sentCount++;
+				SendToConnection(&message, outgoingID);
+			}
+			Update();
+
+			Receive(messages);
+			receivedCount += static_cast<uint32_t>(messages.size());
+			FreeMessages(messages);
+		}
+		double seconds = (GetMicroseconds() - start) / 1000000.0;
+		TEST_CHECK(receivedCount == MESSAGE_COUNT, receivedCount << " of " << MESSAGE_COUNT << " messages were received");
+
+		Report(std::string(useCompactWireFormat ? "Compact" : "Standard") + " frames, " + std::to_string(PAYLOAD_SIZE) + " byte payload", receivedCount / seconds, "messages/s");
+		StopTubes();
+	}
+}
+
+int main()
+{
+	TestReplicator fixedReplicator(TEST_REPLICATOR_ID);
+	VarintReplicator varintReplicator(TEST_REPLICATOR_ID);
+	MeasureEncoding(fixedReplicator, "Fixed size fields");
+	MeasureEncoding(varintReplicator, "Varint fields");
+
+	MeasureThroughput(false, FIRST_PORT);
+	MeasureThroughput(true, FIRST_PORT + 1);
+
+	return Finish("CompactWireFormatBenchmark");
+}
\ No newline at end of file
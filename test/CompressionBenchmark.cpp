@@ -0,0 +1,137 @@
+#include "TestUtility.h"
+#include "Compression.h"
+#include <cstdint>
+#include <random>
+
+// Measures the in-tree LZ4 compressor on a batch of serialized messages with text payloads and on random bytes,
+// and how long a connection to self takes to deliver a backlog that is queued faster than the socket accepts it, with and without compression
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT					= 19470;
+	const int32_t	BATCH_SIZE					= 256 * 1024;
+	const uint32_t	CODEC_REPEAT_COUNT			= 100;
+	const uint32_t	BACKLOG_MESSAGE_COUNT		= 20000;
+	const uint32_t	PAYLOAD_SIZE				= 256;
+	const uint32_t	RUN_TIMEOUT_MILLISECONDS	= 60 * 1000;
+
+	std::string GetPayload(uint32_t sequence) // Text made of a few repeated words, like chat or game events
+	{
+		static const char* words[] = { "player ", "moved ", "to ", "sector ", "north ", "east ", "picked ", "up ", "item " };
+		std::string payload;
+		while (payload.size() < PAYLOAD_SIZE)
+		{
+			payload += words[(sequence + payload.size()) % (sizeof(words) / sizeof(words[0]))];
+			payload += std::to_string(sequence % 100);
+		}
+		payload.resize(PAYLOAD_SIZE);
+		return payload;
+	}
+
+	void MeasureCodec(const std::vector<MUtility::Byte>& source, const std::string& sourceName)
+	{
+		std::vector<MUtility::Byte> compressed(Compression::GetMaxCompressedSize(static_cast<int32_t>(source.size())));
+		std::vector<MUtility::Byte> decompressed(source.size());
+
+		int32_t compressedSize = 0;
+		uint64_t start = GetMicroseconds();
+		for (uint32_t i = 0; i < CODEC_REPEAT_COUNT; ++i)
+		{
+			compressedSize = Compression::Compress(source.data(), static_cast<int32_t>(source.size()), compressed.data(), static_cast<int32_t>(compressed.size()));
+		}
+		double compressSeconds = (GetMicroseconds() - start) / 1000000.0;
+		TEST_CHECK(compressedSize > 0, sourceName << " didn't fit in the maximum compressed size");
+
+		bool allDecompressed = true;
+		start = GetMicroseconds();
+		for (uint32_t i = 0; i < CODEC_REPEAT_COUNT; ++i)
+		{
+			allDecompressed &= Compression::Decompress(compressed.data(), compressedSize, decompressed.data(), static_cast<int32_t>(decompressed.size()));
+		}
+		double decompressSeconds = (GetMicroseconds() - start) / 1000000.0;
+		TEST_CHECK(allDecompressed && decompressed == source, sourceName << " didn't survive the round trip");
+
+		double megabytes = static_cast<double>(source.size()) * CODEC_REPEAT_COUNT / (1024.0 * 1024.0);
+		Report(sourceName + ", compression ratio", static_cast<double>(source.size()) / std::max(compressedSize, 1), "x");
+		Report(sourceName + ", compress", megabytes / compressSeconds, "MiB/s");
+		Report(sourceName + ", decompress", megabytes / decompressSeconds, "MiB/s");
+	}
+
+	void MeasureBacklog(bool useCompression, uint16_t port)
+	{
+		Settings::UseCompression = useCompression;
+		ConnectionID outgoingID;
+		ConnectionID incomingID;
+		if (!StartLoopback(port, outgoingID, incomingID))
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		uint64_t start = GetMicroseconds();
+		StampedMessage message;
+		for (uint32_t i = 0; i < BACKLOG_MESSAGE_COUNT; ++i)
+		{
+			message.Sequence	= i;
+			message.Payload		= GetPayload(i);
+			SendToConnection(&message, outgoingID);
+		}
+
+		uint32_t receivedCount	= 0;
+		uint32_t mismatchCount	= 0;
+		std::vector<Message*> messages;
+		UpdateUntil([&]()
+		{
+			Receive(messages);
+			for (Message* receivedMessage : messages)
+			{
+				const StampedMessage* stampedMessage = static_cast<const StampedMessage*>(receivedMessage);
+				if (stampedMessage->Sequence != receivedCount++ || stampedMessage->Payload != GetPayload(stampedMessage->Sequence))
+					++mismatchCount;
+			}
+			FreeMessages(messages);
+			return receivedCount >= BACKLOG_MESSAGE_COUNT;
+		}, RUN_TIMEOUT_MILLISECONDS);
+		double milliseconds = (GetMicroseconds() - start) / 1000.0;
+		TEST_CHECK(receivedCount == BACKLOG_MESSAGE_COUNT, receivedCount << " of " << BACKLOG_MESSAGE_COUNT << " messages were received");
+		TEST_CHECK(mismatchCount == 0, mismatchCount << " messages arrived out of order or altered");
+
+		Report(std::string(useCompression ? "Compressed" : "Uncompressed") + " backlog of " + std::to_string(BACKLOG_MESSAGE_COUNT) + " messages", milliseconds, "ms");
+		StopTubes();
+	}
+}
+
+int main()
+{
+	TestReplicator replicator(TEST_REPLICATOR_ID);
+	std::vector<MUtility::Byte> messageBatch;
+	StampedMessage message;
+	for (uint32_t i = 0; static_cast<int32_t>(messageBatch.size()) < BATCH_SIZE; ++i)
+	{
+		message.Sequence	= i;
+		message.Payload		= GetPayload(i);
+		MessageSize size;
+		MUtility::Byte* data = replicator.SerializeMessage(&message, &size);
+		messageBatch.insert(messageBatch.end(), data, data + size);
+		MessageAllocator::Free(data);
+	}
+	messageBatch.resize(BATCH_SIZE);
+
+	std::mt19937 random(1);
+	std::vector<MUtility::Byte> randomBytes(BATCH_SIZE);
+	for (MUtility::Byte& byte : randomBytes)
+	{
+		byte = static_cast<MUtility::Byte>(random());
+	}
+
+	MeasureCodec(messageBatch, "Serialized messages");
+	MeasureCodec(randomBytes, "Random bytes");
+
+	MeasureBacklog(false, FIRST_PORT);
+	MeasureBacklog(true, FIRST_PORT + 1);
+
+	return Finish("CompressionBenchmark");
+}
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "TestUtility.h"
+#include "ConnectionTable.h"
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+
+// Measures lookups and iteration in the connection table of a shard against the unordered_map it replaced, after half of the connections have been replaced by new ones.
+// Also checks that the IDs of disconnected connections stay stale while their slots are reused
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint32_t	SHARD_COUNT			= 4;
+	const uint32_t	CONNECTION_COUNT	= 10000;
+	const uint32_t	LOOKUP_COUNT		= 1000000;
+	const uint32_t	ITERATION_COUNT		= 200;
+	const uint32_t	CHURN_COUNT			= 100000;
+
+	Connection* ToConnection(uint32_t value) // The table never dereferences the connections so any distinct non null pointer will do
+	{
+		return reinterpret_cast<Connection*>(static_cast<uintptr_t>(value + 1) * 64);
+	}
+
+	void Churn(ConnectionTable& table, std::unordered_map<ConnectionID, Connection*>& map, std::vector<ConnectionID>& IDs, std::mt19937& random)
+	{
+		for (uint32_t i = 0; i < IDs.size(); i += 2)
+		{
+			table.Remove(IDs[i]);
+			map.erase(IDs[i]);
+		}
+		for (uint32_t i = 0; i < IDs.size(); i += 2)
+		{
+			IDs[i] = table.Reserve();
+			table.Insert(IDs[i], ToConnection(random()));
+			map[IDs[i]] = table.Find(IDs[i]);
+		}
+	}
+
+	void MeasureLookupsAndIteration()
+	{
+		ConnectionTable table;
+		table.SetSlotLayout(1, 2); // The second of SHARD_COUNT shards
+		std::unordered_map<ConnectionID, Connection*> map;
+		std::vector<ConnectionID> IDs;
+		std::mt19937 random(1);
+		for (uint32_t i = 0; i < CONNECTION_COUNT / SHARD_COUNT; ++i)
+		{
+			ConnectionID ID = table.Reserve();
+			table.Insert(ID, ToConnection(i));
+			map[ID] = ToConnection(i);
+			IDs.push_back(ID);
+		}
+		Churn(table, map, IDs, random);
+
+		std::vector<ConnectionID> lookups(LOOKUP_COUNT);
+		for (ConnectionID& ID : lookups)
+		{
+			ID = IDs[random() % IDs.size()];
+		}
+
+		uintptr_t checksum = 0;
+		uint64_t start = GetMicroseconds();
+		for (ConnectionID ID : lookups)
+		{
+			checksum += reinterpret_cast<uintptr_t>(table.Find(ID));
+		}
+		double tableLookupNanoseconds = (GetMicroseconds() - start) * 1000.0 / LOOKUP_COUNT;
+
+		start = GetMicroseconds();
+		for (ConnectionID ID : lookups)
+		{
+			checksum -= reinterpret_cast<uintptr_t>(map.find(ID)->second);
+		}
+		double mapLookupNanoseconds = (GetMicroseconds() - start) * 1000.0 / LOOKUP_COUNT;
+		TEST_CHECK(checksum == 0, "The table and the map found different connections");
+
+		int64_t IDSum = 0;
+		start = GetMicroseconds();
+		for (uint32_t i = 0; i < ITERATION_COUNT; ++i)
+		{
+			for (uint32_t entryIndex = 0; entryIndex < table.GetCount(); ++entryIndex)
+			{
+				IDSum += table.GetIDAt(entryIndex);
+			}
+		}
+		double tableIterationNanoseconds = (GetMicroseconds() - start) * 1000.0 / (static_cast<double>(ITERATION_COUNT) * table.GetCount());
+
+		start = GetMicroseconds();
+		for (uint32_t i = 0; i < ITERATION_COUNT; ++i)
+		{
+			for (const auto& idAndConnection : map)
+			{
+				IDSum -= idAndConnection.first;
+			}
+		}
+		double mapIterationNanoseconds = (GetMicroseconds() - start) * 1000.0 / (static_cast<double>(ITERATION_COUNT) * map.size());
+		TEST_CHECK(IDSum == 0, "The table and the map hold different IDs");
+
+		std::string suffix = " of " + std::to_string(CONNECTION_COUNT / SHARD_COUNT) + " connections";
+		Report("ConnectionTable, random lookup" + suffix, tableLookupNanoseconds, "ns");
+		Report("unordered_map, random lookup" + suffix, mapLookupNanoseconds, "ns");
+		Report("ConnectionTable, iteration" + suffix, tableIterationNanoseconds, "ns/connection");
+		Report("unordered_map, iteration" + suffix, mapIterationNanoseconds, "ns/connection");
+	}
+
+	void CheckStaleIDs()
+	{
+		ConnectionTable table;
+		ConnectionID firstID = table.Reserve();
+		table.Insert(firstID, ToConnection(0));
+		table.Remove(firstID);
+
+		// Connect and disconnect one connection at a time, which would hand out the same slot every time if freed slots were reused right away
+		uint32_t aliasCount = 0;
+		for (uint32_t i = 0; i < CHURN_COUNT; ++i)
+		{
+			ConnectionID ID = table.Reserve();
+			table.Insert(ID, ToConnection(i));
+			if (table.Find(firstID) != nullptr)
+				++aliasCount;
+			table.Remove(ID);
+		}
+		TEST_CHECK(aliasCount == 0, "The stale ID of the first connection found " << aliasCount << " of the " << CHURN_COUNT << " connections that followed it");
+	}
+}
+
+int main()
+{
+	MeasureLookupsAndIteration();
+	CheckStaleIDs();
+
+	return Finish("ConnectionTableBenchmark");
+}
\ No newline at end of file
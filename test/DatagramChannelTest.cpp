@@ -0,0 +1,147 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Sends unreliable, sequenced and reliable messages over a loopback connection whose datagrams are dropped and delayed by Settings::DatagramLossRate and Settings::DatagramLatencyMilliseconds
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	PORT						= 19140;
+	const float		LOSS_RATE					= 0.2f;
+	const uint32_t	LATENCY_MILLISECONDS		= 50;
+	const uint32_t	FRAME_COUNT					= 100;
+	const uint32_t	MESSAGES_PER_FRAME			= 20; // Of each delivery mode
+	const uint32_t	DRAIN_MILLISECONDS			= 1000; // Time given to the last delayed datagrams and reliable messages to arrive
+
+	enum Stream : uint32_t
+	{
+		PROBE,
+		UNRELIABLE,
+		SEQUENCED,
+		RELIABLE,
+	};
+}
+
+int main()
+{
+	Settings::UseDatagramChannel			= true;
+	Settings::DatagramLossRate				= LOSS_RATE;
+	Settings::DatagramLatencyMilliseconds	= LATENCY_MILLISECONDS;
+
+	ConnectionID outgoingID;
+	ConnectionID incomingID;
+	if (!StartLoopback(PORT, outgoingID, incomingID))
+		return 1;
+
+	// Unreliable messages are sent over the stream until the datagram channel has been confirmed. Probe until one arrives late enough to have been sent as a datagram
+	bool channelReady = false;
+	std::vector<Message*> messages;
+	UpdateUntil([&]()
+	{
+		StampedMessage probe;
+		probe.SentTime	= GetMicroseconds();
+		probe.Stream	= PROBE;
+		SendToConnection(&probe, outgoingID, DeliveryMode::UNRELIABLE);
+
+		Receive(messages);
+		for (Message* message : messages)
+		{
+			const StampedMessage* stamped = static_cast<const StampedMessage*>(message);
+			if (GetMicroseconds() - stamped->SentTime >= LATENCY_MILLISECONDS * 1000ull)
+				channelReady = true;
+		}
+		FreeMessages(messages);
+		return channelReady;
+	}, CONNECT_TIMEOUT_MILLISECONDS);
+	TEST_CHECK(channelReady, "No unreliable message was sent as a datagram within " << CONNECT_TIMEOUT_MILLISECONDS << " ms");
+
+	uint32_t	receivedCounts[RELIABLE + 1]	= {};
+	uint32_t	lastSequenced					= 0;
+	uint32_t	nextReliable					= 0;
+	uint64_t	minDatagramLatency				= UINT64_MAX;
+	bool		sequencedInOrder				= true;
+	bool		reliableInOrder					= true;
+	auto receiveMessages = [&]()
+	{
+		Receive(messages);
+		for (Message* message : messages)
+		{
+			const StampedMessage* stamped = static_cast<const StampedMessage*>(message);
+			uint64_t latency = GetMicroseconds() - stamped->SentTime;
+			switch (stamped->Stream)
+			{
+				case UNRELIABLE:
+				{
+					minDatagramLatency = std::min(minDatagramLatency, latency);
+				} break;
+
+				case SEQUENCED:
+				{
+					minDatagramLatency = std::min(minDatagramLatency, latency);
+					if (receivedCounts[SEQUENCED] > 0 && stamped->Sequence <= lastSequenced)
+						sequencedInOrder = false;
+					lastSequenced = stamped->Sequence;
+				} break;
+
+				case RELIABLE:
+				{
+					if (stamped->Sequence != nextReliable)
+						reliableInOrder = false;
+					nextReliable = stamped->Sequence + 1;
+				} break;
+
+				default:
+					continue; // Probes that were still underway
+			}
+			++receivedCounts[stamped->Stream];
+		}
+		FreeMessages(messages);
+	};
+
+	for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+	{
+		for (uint32_t i = 0; i < MESSAGES_PER_FRAME; ++i)
+		{
+			StampedMessage message;
+			message.Sequence = frame * MESSAGES_PER_FRAME + i;
+
+			message.SentTime	= GetMicroseconds();
+			message.Stream		= UNRELIABLE;
+			SendToConnection(&message, outgoingID, DeliveryMode::UNRELIABLE);
+
+			message.SentTime	= GetMicroseconds();
+			message.Stream		= SEQUENCED;
+			SendToConnection(&message, outgoingID, DeliveryMode::UNRELIABLE_SEQUENCED);
+
+			message.SentTime	= GetMicroseconds();
+			message.Stream		= RELIABLE;
+			SendToConnection(&message, outgoingID, DeliveryMode::RELIABLE_ORDERED);
+		}
+		Update();
+		receiveMessages();
+		Sleep(1);
+	}
+
+	uint64_t drainEnd = GetMicroseconds() + DRAIN_MILLISECONDS * 1000ull;
+	while (GetMicroseconds() < drainEnd)
+	{
+		Update();
+		receiveMessages();
+		Sleep(1);
+	}
+
+	const uint32_t sentCount = FRAME_COUNT * MESSAGES_PER_FRAME;
+	double deliveredFraction = static_cast<double>(receivedCounts[UNRELIABLE]) / sentCount;
+	std::cout << "Unreliable: " << receivedCounts[UNRELIABLE] << "/" << sentCount << " Sequenced: " << receivedCounts[SEQUENCED] << "/" << sentCount << " Reliable: " << receivedCounts[RELIABLE] << "/" << sentCount << " Minimum datagram latency: " << minDatagramLatency / 1000.0 << " ms" << std::endl;
+
+	TEST_CHECK(deliveredFraction > 1.0 - LOSS_RATE - 0.1 && deliveredFraction < 1.0 - LOSS_RATE + 0.1, "Delivered " << deliveredFraction << " of the unreliable messages with a loss rate of " << LOSS_RATE);
+	TEST_CHECK(receivedCounts[SEQUENCED] > 0 && receivedCounts[SEQUENCED] <= sentCount, "Received " << receivedCounts[SEQUENCED] << " sequenced messages");
+	TEST_CHECK(sequencedInOrder, "A sequenced message arrived after a newer one");
+	TEST_CHECK(receivedCounts[RELIABLE] == sentCount, "Received " << receivedCounts[RELIABLE] << " of " << sentCount << " reliable messages");
+	TEST_CHECK(reliableInOrder, "Reliable messages arrived out of order");
+	TEST_CHECK(minDatagramLatency >= LATENCY_MILLISECONDS * 1000ull, "A datagram arrived after " << minDatagramLatency << " us which is sooner than the injected latency");
+
+	return Finish("DatagramChannelTest");
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "TestUtility.h"
+#include "DeltaCompression.h"
+#include "SerializedMessage.h"
+#include "Interface/messaging/SerializationCursor.h"
+#include <cstdint>
+
+// Measures delta compression of a snapshot where every entity sends a state message each tick and only a few of its bytes change.
+// Reports the bytes and time the encoder and decoder spend per message, and the time per tick of a connection to self with and without delta compression
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT					= 19460;
+	const uint32_t	ENTITY_COUNT				= 64;
+	const uint32_t	TICK_COUNT					= 1000;
+	const uint32_t	STATE_SIZE					= 200;
+	const uint32_t	CHANGED_BYTES_PER_TICK		= 4;
+	const uint32_t	RUN_TIMEOUT_MILLISECONDS	= 60 * 1000;
+
+	void UpdateState(StampedMessage& message, uint32_t entity, uint32_t tick) // Changes a few bytes of the state, as moving an entity would
+	{
+		message.Stream		= entity;
+		message.Sequence	= tick;
+		for (uint32_t i = 0; i < CHANGED_BYTES_PER_TICK; ++i)
+		{
+			message.Payload[(entity + i * 16) % STATE_SIZE] = static_cast<char>('a' + (tick + i) % 26);
+		}
+	}
+
+	void MeasureCodec()
+	{
+		TestReplicator	replicator(TEST_REPLICATOR_ID);
+		DeltaEncoder	encoder;
+		DeltaDecoder	decoder;
+		std::vector<StampedMessage> states(ENTITY_COUNT);
+		for (StampedMessage& state : states)
+		{
+			state.Payload = std::string(STATE_SIZE, 'x');
+		}
+
+		uint64_t	messageByteCount	= 0;
+		uint64_t	frameByteCount		= 0;
+		uint64_t	encodeMicroseconds	= 0;
+		uint64_t	decodeMicroseconds	= 0;
+		uint32_t	mismatchCount		= 0;
+		for (uint32_t tick = 0; tick < TICK_COUNT; ++tick)
+		{
+			for (uint32_t entity = 0; entity < ENTITY_COUNT; ++entity)
+			{
+				UpdateState(states[entity], entity, tick);
+				MessageSize size;
+				MUtility::Byte* data = replicator.SerializeMessage(&states[entity], &size);
+				SerializedMessage* message = SerializedMessage::Create(data, size);
+
+				uint64_t start = GetMicroseconds();
+				SerializedMessage* frame = encoder.Encode(message, entity);
+				encodeMicroseconds += GetMicroseconds() - start;
+
+				messageByteCount	+= message->GetWireSize(true);
+				frameByteCount		+= frame != nullptr ? frame->GetWireSize(true) : message->GetWireSize(true);
+				if (frame != nullptr)
+				{
+					const MUtility::Byte* image = nullptr;
+					DeltaKey key;
+					uint64_t sequence;
+					ReadCursor reader;
+					reader.Begin(frame->GetPayload(), frame->GetPayload() + frame->GetPayloadSize());
+
+					start = GetMicroseconds();
+					DeltaDecoder::Result result = decoder.Decode(reader, image, key, sequence);
+					decodeMicroseconds += GetMicroseconds() - start;
+
+					if (result != DeltaDecoder::Result::Decoded || memcmp(image, message->GetData(), message->GetSize()) != 0)
+						++mismatchCount;
+					frame->Release();
+				}
+				message->Release();
+			}
+		}
+		TEST_CHECK(mismatchCount == 0, mismatchCount << " of " << ENTITY_COUNT * TICK_COUNT << " decoded images differed from the message");
+
+		double messageCount = static_cast<double>(ENTITY_COUNT) * TICK_COUNT;
+		Report("Full message with a compact frame header", messageByteCount / messageCount, "bytes");
+		Report("Delta frame with a compact frame header", frameByteCount / messageCount, "bytes");
+		Report("Encode", encodeMicroseconds * 1000.0 / messageCount, "ns/message");
+		Report("Decode", decodeMicroseconds * 1000.0 / messageCount, "ns/message");
+	}
+
+	void MeasureSnapshots(bool useDeltaCompression, uint16_t port)
+	{
+		Settings::UseCompactWireFormat	= true;
+		Settings::UseDeltaCompression	= useDeltaCompression;
+		ConnectionID outgoingID;
+		ConnectionID incomingID;
+		if (!StartLoopback(port, outgoingID, incomingID))
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		std::vector<StampedMessage> states(ENTITY_COUNT);
+		for (StampedMessage& state : states)
+		{
+			state.Payload = std::string(STATE_SIZE, 'x');
+		}
+
+		uint32_t mismatchCount = 0;
+		std::vector<Message*> messages;
+		uint64_t start = GetMicroseconds();
+		for (uint32_t tick = 0; tick < TICK_COUNT; ++tick)
+		{
+			for (uint32_t entity = 0; entity < ENTITY_COUNT; ++entity)
+			{
+				UpdateState(states[entity], entity, tick);
+				SendDeltaToConnection(&states[entity], outgoingID, entity);
+			}
+
+			// Wait for the whole snapshot so that every tick is delta compressed against the previous one
+			uint32_t receivedCount = 0;
+			uint64_t deadline = GetMicroseconds() + RUN_TIMEOUT_MILLISECONDS * 1000ull;
+			while (receivedCount < ENTITY_COUNT && GetMicroseconds() < deadline)
+			{
+				Update();
+				Receive(messages);
+				for (Message* message : messages)
+				{
+					const StampedMessage* state = static_cast<const StampedMessage*>(message);
+					if (state->Stream >= ENTITY_COUNT || state->Sequence != tick || state->Payload != states[state->Stream].Payload)
+						++mismatchCount;
+				}
+				receivedCount += static_cast<uint32_t>(messages.size());
+				FreeMessages(messages);
+			}
+			TEST_CHECK(receivedCount == ENTITY_COUNT, receivedCount << " of " << ENTITY_COUNT << " state messages of tick " << tick << " were received");
+			if (receivedCount != ENTITY_COUNT)
+				break;
+		}
+		double microsecondsPerTick = static_cast<double>(GetMicroseconds() - start) / TICK_COUNT;
+		TEST_CHECK(mismatchCount == 0, mismatchCount << " state messages arrived altered");
+
+		Report(std::string(useDeltaCompression ? "Delta compressed" : "Full") + " snapshots of " + std::to_string(ENTITY_COUNT) + " entities", microsecondsPerTick, "us/tick");
+		StopTubes();
+	}
+}
+
+int main()
+{
+	MeasureCodec();
+	MeasureSnapshots(false, FIRST_PORT);
+	MeasureSnapshots(true, FIRST_PORT + 1);
+
+	return Finish("DeltaCompressionBenchmark");
+}
\ No newline at end of file
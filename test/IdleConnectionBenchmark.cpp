@@ -0,0 +1,61 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures what Tubes::Receive costs per frame when one connection carries traffic and the rest are idle, with and without readiness polling
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT				= 19400;
+	const uint32_t	IDLE_CONNECTION_COUNT	= 500; // Both ends are in this process, so this is twice as many idle sockets
+	const uint32_t	FRAME_COUNT				= 2000;
+
+	double MeasureReceive(bool useReadinessPolling, uint16_t port) // Returns the average number of microseconds spent in Tubes::Receive per frame
+	{
+		Settings::UseReadinessPolling = useReadinessPolling;
+		if (!StartTubes())
+			return 0.0;
+
+		std::vector<ConnectionID> outgoingIDs = ConnectToSelfRepeatedly(port, IDLE_CONNECTION_COUNT + 1);
+		TEST_CHECK(outgoingIDs.size() == IDLE_CONNECTION_COUNT + 1, "Only " << outgoingIDs.size() << " of " << IDLE_CONNECTION_COUNT + 1 << " connections were made");
+		if (outgoingIDs.empty())
+		{
+			StopTubes();
+			return 0.0;
+		}
+
+		StampedMessage message;
+		uint32_t receivedCount = 0;
+		uint64_t receiveMicroseconds = 0;
+		std::vector<Message*> messages;
+		for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			message.Sequence = frame;
+			SendToConnection(&message, outgoingIDs[0]);
+			Update();
+
+			uint64_t start = GetMicroseconds();
+			Receive(messages);
+			receiveMicroseconds += GetMicroseconds() - start;
+			receivedCount += static_cast<uint32_t>(messages.size());
+			FreeMessages(messages);
+		}
+		TEST_CHECK(receivedCount > FRAME_COUNT / 2, "Only " << receivedCount << " of " << FRAME_COUNT << " messages were received");
+
+		StopTubes();
+		return static_cast<double>(receiveMicroseconds) / FRAME_COUNT;
+	}
+}
+
+int main()
+{
+	double pollingOffMicroseconds	= MeasureReceive(false, FIRST_PORT);
+	double pollingOnMicroseconds	= MeasureReceive(true, FIRST_PORT + 1);
+
+	Report("Receive with " + std::to_string(2 * (IDLE_CONNECTION_COUNT + 1)) + " connections, recv on every connection", pollingOffMicroseconds, "us/frame");
+	Report("Receive with " + std::to_string(2 * (IDLE_CONNECTION_COUNT + 1)) + " connections, readiness polling", pollingOnMicroseconds, "us/frame");
+
+	return Finish("IdleConnectionBenchmark");
+}
\ No newline at end of file
@@ -0,0 +1,63 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures how long it takes to accept and verify a storm of joining connections to self while other connections are already established.
+// Each joining connection is checked against the established ones for duplicates, so the time per join shows whether that check grows with the connection count
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT					= 19500;
+	const uint32_t	ESTABLISHED_COUNTS[]		= { 0, 1000, 2000 }; // Both ends are in this process, so this is twice as many sockets
+	const uint32_t	JOIN_COUNT					= 500;
+	const uint32_t	LISTEN_BACKLOG				= 1024;
+	const uint32_t	RUN_TIMEOUT_MILLISECONDS	= 20 * 1000;
+
+	void MeasureJoin(uint32_t establishedCount, uint16_t port)
+	{
+		Settings::ListenBacklog = LISTEN_BACKLOG;
+		if (!StartTubes())
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		std::vector<ConnectionID> establishedIDs = ConnectToSelfRepeatedly(port, establishedCount);
+		TEST_CHECK(establishedIDs.size() == establishedCount, "Only " << establishedIDs.size() << " of " << establishedCount << " established connections were made");
+
+		uint32_t joinedCount = 0;
+		uint32_t failedCount = 0;
+		ConnectionCallbackHandle handle = RegisterConnectionCallback([&](const ConnectionAttemptResultData& result)
+		{
+			if (result.Result == ConnectionAttemptResult::SUCCESS_INCOMING)
+				++joinedCount;
+			else if (result.Result != ConnectionAttemptResult::SUCCESS_OUTGOING)
+				++failedCount;
+		});
+
+		uint64_t start = GetMicroseconds();
+		for (uint32_t i = 0; i < JOIN_COUNT; ++i)
+		{
+			RequestConnection(LOCALHOST_IP, port); // The listener was started by ConnectToSelfRepeatedly
+		}
+		UpdateUntil([&]() { return joinedCount + failedCount >= JOIN_COUNT; }, RUN_TIMEOUT_MILLISECONDS);
+		double milliseconds = (GetMicroseconds() - start) / 1000.0;
+		TEST_CHECK(joinedCount == JOIN_COUNT, joinedCount << " of " << JOIN_COUNT << " joining connections were accepted next to " << establishedCount << " established ones");
+
+		Report(std::to_string(JOIN_COUNT) + " joins next to " + std::to_string(establishedCount) + " established connections", milliseconds * 1000.0 / JOIN_COUNT, "us/join");
+		UnregisterConnectionCallback(handle);
+		StopTubes();
+	}
+}
+
+int main()
+{
+	for (uint32_t i = 0; i < sizeof(ESTABLISHED_COUNTS) / sizeof(ESTABLISHED_COUNTS[0]); ++i)
+	{
+		MeasureJoin(ESTABLISHED_COUNTS[i], static_cast<uint16_t>(FIRST_PORT + i));
+	}
+
+	return Finish("JoinBenchmark");
+}
\ No newline at end of file
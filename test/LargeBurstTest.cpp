@@ -0,0 +1,60 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Queues a burst far larger than the socket buffers before updating, so that most sends are only partly accepted, and checks that every message still arrives once, in order and unaltered
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	PORT			= 19101;
+	const uint32_t	MESSAGE_COUNT	= 2000;
+	const uint32_t	PAYLOAD_SIZE	= 8 * 1024;
+
+	std::string GetPayload(uint32_t sequence)
+	{
+		std::string payload(PAYLOAD_SIZE, static_cast<char>('a' + sequence % 26));
+		payload[sequence % PAYLOAD_SIZE] = '#'; // Makes a message resent from the wrong offset tell from its neighbours
+		return payload;
+	}
+}
+
+int main()
+{
+	ConnectionID outgoingID;
+	ConnectionID incomingID;
+	if (!StartLoopback(PORT, outgoingID, incomingID))
+		return 1;
+
+	for (uint32_t i = 0; i < MESSAGE_COUNT; ++i)
+	{
+		StampedMessage message;
+		message.Sequence	= i;
+		message.Payload		= GetPayload(i);
+		SendToConnection(&message, outgoingID);
+	}
+
+	uint32_t nextSequence	= 0;
+	uint32_t misplacedCount	= 0;
+	std::vector<Message*> messages;
+	UpdateUntil([&]()
+	{
+		Receive(messages);
+		for (Message* message : messages)
+		{
+			const StampedMessage* stampedMessage = static_cast<const StampedMessage*>(message);
+			if (stampedMessage->Sequence != nextSequence || stampedMessage->Payload != GetPayload(stampedMessage->Sequence))
+				++misplacedCount;
+			else
+				++nextSequence;
+		}
+		FreeMessages(messages);
+		return nextSequence + misplacedCount >= MESSAGE_COUNT;
+	}, CONNECT_TIMEOUT_MILLISECONDS * 4);
+
+	TEST_CHECK(nextSequence == MESSAGE_COUNT, nextSequence << " of " << MESSAGE_COUNT << " messages arrived in order");
+	TEST_CHECK(misplacedCount == 0, misplacedCount << " messages arrived out of order or altered");
+
+	return Finish("LargeBurstTest");
+}
\ No newline at end of file
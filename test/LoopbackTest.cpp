@@ -0,0 +1,66 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Sends messages both ways over a connection to self and checks that every message arrives once, in order and unaltered
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	PORT			= 19100;
+	const uint32_t	MESSAGE_COUNT	= 1000;
+	const uint32_t	PAYLOAD_SIZE	= 200;
+
+	std::string GetPayload(uint32_t sequence)
+	{
+		return std::string(PAYLOAD_SIZE, static_cast<char>('a' + sequence % 26));
+	}
+}
+
+int main()
+{
+	ConnectionID outgoingID;
+	ConnectionID incomingID;
+	if (!StartLoopback(PORT, outgoingID, incomingID))
+		return 1;
+
+	for (uint32_t i = 0; i < MESSAGE_COUNT; ++i)
+	{
+		StampedMessage message;
+		message.Sequence	= i;
+		message.Payload		= GetPayload(i);
+
+		message.Stream = 0;
+		SendToConnection(&message, outgoingID);
+		message.Stream = 1;
+		SendToConnection(&message, incomingID);
+	}
+
+	uint32_t nextSequences[2]	= { 0, 0 };
+	uint32_t misplacedCount		= 0;
+	std::vector<Message*> messages;
+	std::vector<ConnectionID> senderIDs;
+	UpdateUntil([&]()
+	{
+		Receive(messages, &senderIDs);
+		for (size_t i = 0; i < messages.size(); ++i)
+		{
+			const StampedMessage* message = static_cast<const StampedMessage*>(messages[i]);
+			ConnectionID expectedSenderID = message->Stream == 0 ? incomingID : outgoingID; // The message arrives at the other end of the connection
+			if (message->Stream > 1 || senderIDs[i] != expectedSenderID || message->Sequence != nextSequences[message->Stream] || message->Payload != GetPayload(message->Sequence))
+				++misplacedCount;
+			else
+				++nextSequences[message->Stream];
+		}
+		FreeMessages(messages);
+		senderIDs.clear();
+		return nextSequences[0] + nextSequences[1] + misplacedCount >= 2 * MESSAGE_COUNT;
+	}, CONNECT_TIMEOUT_MILLISECONDS);
+
+	TEST_CHECK(nextSequences[0] == MESSAGE_COUNT, nextSequences[0] << " of " << MESSAGE_COUNT << " messages arrived in order at the incoming end");
+	TEST_CHECK(nextSequences[1] == MESSAGE_COUNT, nextSequences[1] << " of " << MESSAGE_COUNT << " messages arrived in order at the outgoing end");
+	TEST_CHECK(misplacedCount == 0, misplacedCount << " messages arrived out of order, altered or from the wrong sender");
+
+	return Finish("LoopbackTest");
+}
\ No newline at end of file
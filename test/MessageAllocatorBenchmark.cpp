@@ -0,0 +1,73 @@
+#include "TestUtility.h"
+#include <cstdint>
+#include <stdlib.h>
+
+// Compares MessageAllocator with malloc for the allocate/free pattern of message traffic, on one thread and on several threads at once
+
+using namespace TubesTest;
+
+namespace
+{
+	const size_t	BLOCK_SIZES[]		= { 64, 512, 4096 };
+	const uint32_t	BLOCKS_PER_ROUND	= 256; // Blocks held at once, like messages waiting in a receive batch
+	const uint32_t	ROUND_COUNT			= 2000;
+	const uint32_t	THREAD_COUNT		= 4;
+
+	template<typename Allocate, typename Free>
+	double MeasureNanosecondsPerPair(size_t blockSize, Allocate allocate, Free free)
+	{
+		std::vector<void*> blocks(BLOCKS_PER_ROUND);
+		uint64_t start = GetMicroseconds();
+		for (uint32_t round = 0; round < ROUND_COUNT; ++round)
+		{
+			for (uint32_t i = 0; i < BLOCKS_PER_ROUND; ++i)
+			{
+				blocks[i] = allocate(blockSize);
+				static_cast<volatile char*>(blocks[i])[0] = 1;
+			}
+			for (uint32_t i = 0; i < BLOCKS_PER_ROUND; ++i)
+			{
+				free(blocks[i]);
+			}
+		}
+		return (GetMicroseconds() - start) * 1000.0 / (static_cast<double>(ROUND_COUNT) * BLOCKS_PER_ROUND);
+	}
+
+	template<typename Allocate, typename Free>
+	double MeasureNanosecondsPerPairOnThreads(size_t blockSize, Allocate allocate, Free free)
+	{
+		std::vector<double> nanoseconds(THREAD_COUNT);
+		std::vector<std::thread> threads;
+		for (uint32_t i = 0; i < THREAD_COUNT; ++i)
+		{
+			threads.emplace_back([&, i]() { nanoseconds[i] = MeasureNanosecondsPerPair(blockSize, allocate, free); });
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		return *std::max_element(nanoseconds.begin(), nanoseconds.end());
+	}
+}
+
+int main()
+{
+	auto allocatorAllocate	= [](size_t byteSize) { return MessageAllocator::Allocate(byteSize); };
+	auto allocatorFree		= [](void* memory) { MessageAllocator::Free(memory); };
+	auto heapAllocate		= [](size_t byteSize) { return malloc(byteSize); };
+	auto heapFree			= [](void* memory) { free(memory); };
+
+	for (size_t blockSize : BLOCK_SIZES)
+	{
+		std::string size = std::to_string(blockSize) + " byte blocks";
+		Report(size + ", MessageAllocator", MeasureNanosecondsPerPair(blockSize, allocatorAllocate, allocatorFree), "ns/pair");
+		Report(size + ", malloc", MeasureNanosecondsPerPair(blockSize, heapAllocate, heapFree), "ns/pair");
+		Report(size + ", MessageAllocator on " + std::to_string(THREAD_COUNT) + " threads", MeasureNanosecondsPerPairOnThreads(blockSize, allocatorAllocate, allocatorFree), "ns/pair");
+		Report(size + ", malloc on " + std::to_string(THREAD_COUNT) + " threads", MeasureNanosecondsPerPairOnThreads(blockSize, heapAllocate, heapFree), "ns/pair");
+	}
+
+	MessageAllocator::Statistics statistics = MessageAllocator::GetStatistics();
+	TEST_CHECK(statistics.Hits > statistics.Misses, "Only " << statistics.Hits << " of " << statistics.Hits + statistics.Misses << " allocations were served from the pool");
+
+	return Finish("MessageAllocatorBenchmark");
+}
\ No newline at end of file
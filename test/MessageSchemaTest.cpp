@@ -0,0 +1,62 @@
+#include "TestUtility.h"
+#include <cstdint>
+#include <cstring>
+
+// Round trips a schema message through its generated replicator and checks that messages whose header or payload was cut short fail to deserialize
+
+using namespace TubesTest;
+
+namespace
+{
+	MUtility::Byte* CopyWithSize(const MUtility::Byte* serializedMessage, MessageSize messageSize) // Copies a serialized message and rewrites the size in its header as if the message ended there
+	{
+		MUtility::Byte* copy = static_cast<MUtility::Byte*>(MessageAllocator::Allocate(messageSize > static_cast<MessageSize>(sizeof(MessageSize)) ? messageSize : sizeof(MessageSize)));
+		memcpy(copy, serializedMessage, messageSize > static_cast<MessageSize>(sizeof(MessageSize)) ? messageSize : sizeof(MessageSize));
+		memcpy(copy, &messageSize, sizeof(MessageSize));
+		return copy;
+	}
+}
+
+int main()
+{
+	TestReplicator replicator(TEST_REPLICATOR_ID);
+	StampedMessage message;
+	message.SentTime	= 1234567;
+	message.Stream		= 3;
+	message.Sequence	= 42;
+	message.Payload		= "Schema generated serialization";
+
+	MessageSize messageSize = 0;
+	MUtility::Byte* serializedMessage = replicator.SerializeMessage(&message, &messageSize);
+	TEST_CHECK(serializedMessage != nullptr, "The message failed to serialize");
+	if (serializedMessage == nullptr)
+		return Finish("MessageSchemaTest");
+
+	TEST_CHECK(messageSize == replicator.CalculateMessageSize(message), "The serialized size " << messageSize << " doesn't match the calculated size " << replicator.CalculateMessageSize(message));
+
+	StampedMessage* deserializedMessage = static_cast<StampedMessage*>(replicator.DeserializeMessage(serializedMessage));
+	TEST_CHECK(deserializedMessage != nullptr, "The serialized message failed to deserialize");
+	if (deserializedMessage != nullptr)
+	{
+		TEST_CHECK(deserializedMessage->SentTime == message.SentTime && deserializedMessage->Stream == message.Stream && deserializedMessage->Sequence == message.Sequence && deserializedMessage->Payload == message.Payload, "The deserialized message differs from the serialized one");
+		deserializedMessage->Destroy();
+		MessageAllocator::Free(deserializedMessage);
+	}
+
+	// Every size short of the full message must fail, whether the cut is in the header or in the payload
+	for (MessageSize truncatedSize = 0; truncatedSize < messageSize; ++truncatedSize)
+	{
+		MUtility::Byte* truncatedMessage = CopyWithSize(serializedMessage, truncatedSize);
+		Message* truncatedResult = replicator.DeserializeMessage(truncatedMessage);
+		TEST_CHECK(truncatedResult == nullptr, "A message cut short to " << truncatedSize << " of " << messageSize << " bytes was deserialized" << (truncatedSize < MESSAGE_HEADER_SIZE ? " even though its header was incomplete" : ""));
+		if (truncatedResult != nullptr)
+		{
+			truncatedResult->Destroy();
+			MessageAllocator::Free(truncatedResult);
+		}
+		MessageAllocator::Free(truncatedMessage);
+	}
+
+	MessageAllocator::Free(serializedMessage);
+	return Finish("MessageSchemaTest");
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Receives messages as views and checks that they describe the sent messages, and that they stay readable until the next receive even if their connection is disconnected in between
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	PORT						= 19102;
+	const uint32_t	MESSAGE_COUNT				= 200;
+	const uint32_t	DISCONNECTED_MESSAGE_COUNT	= 50;
+
+	std::string GetPayload(uint32_t sequence)
+	{
+		return std::string(16 + sequence % 300, static_cast<char>('a' + sequence % 26));
+	}
+
+	uint32_t CheckViews(const std::vector<MessageView>& views, TestReplicator& replicator, uint32_t& inOutNextSequence) // Returns the number of views that don't describe the next expected message
+	{
+		uint32_t mismatchCount = 0;
+		for (const MessageView& view : views)
+		{
+			StampedMessage* message = static_cast<StampedMessage*>(replicator.DeserializeMessage(view.Data));
+			bool matches =	view.Replicator_ID == TEST_REPLICATOR_ID && view.Type == STAMPED && view.Size == replicator.CalculateMessageSize(*message) &&
+							view.Payload + view.PayloadSize == view.Data + view.Size && message->Sequence == inOutNextSequence && message->Payload == GetPayload(message->Sequence);
+			if (matches)
+				++inOutNextSequence;
+			else
+				++mismatchCount;
+
+			message->Destroy();
+			MessageAllocator::Free(message);
+		}
+		return mismatchCount;
+	}
+}
+
+int main()
+{
+	ConnectionID outgoingID;
+	ConnectionID incomingID;
+	if (!StartLoopback(PORT, outgoingID, incomingID))
+		return 1;
+
+	TestReplicator replicator(TEST_REPLICATOR_ID);
+	StampedMessage message;
+	for (uint32_t i = 0; i < MESSAGE_COUNT; ++i)
+	{
+		message.Sequence	= i;
+		message.Payload		= GetPayload(i);
+		SendToConnection(&message, outgoingID);
+	}
+
+	// The views of one call must survive the update that follows it
+	uint32_t nextSequence	= 0;
+	uint32_t mismatchCount	= 0;
+	std::vector<MessageView> views;
+	std::vector<ConnectionID> senderIDs;
+	UpdateUntil([&]()
+	{
+		views.clear();
+		senderIDs.clear();
+		ReceiveViews(views, &senderIDs);
+		Update();
+
+		mismatchCount += CheckViews(views, replicator, nextSequence);
+		mismatchCount += static_cast<uint32_t>(std::count_if(senderIDs.begin(), senderIDs.end(), [&](ConnectionID senderID) { return senderID != incomingID; }));
+		return nextSequence + mismatchCount >= MESSAGE_COUNT;
+	}, CONNECT_TIMEOUT_MILLISECONDS);
+
+	TEST_CHECK(nextSequence == MESSAGE_COUNT, nextSequence << " of " << MESSAGE_COUNT << " views described the sent messages in order");
+	TEST_CHECK(mismatchCount == 0, mismatchCount << " views described the wrong message or sender");
+
+	// Disconnecting the receiving end must not free the bytes that its views point into
+	for (uint32_t i = 0; i < DISCONNECTED_MESSAGE_COUNT; ++i)
+	{
+		message.Sequence	= i;
+		message.Payload		= GetPayload(i);
+		SendToConnection(&message, outgoingID);
+	}
+	Sleep(50);
+
+	views.clear();
+	UpdateUntil([&]()
+	{
+		ReceiveViews(views);
+		return !views.empty();
+	}, CONNECT_TIMEOUT_MILLISECONDS);
+	Disconnect(incomingID);
+
+	nextSequence	= 0;
+	mismatchCount	= CheckViews(views, replicator, nextSequence);
+	TEST_CHECK(!views.empty(), "No views were received before the disconnection");
+	TEST_CHECK(mismatchCount == 0, mismatchCount << " views were altered by the disconnection of their connection");
+
+	views.clear();
+	ReceiveViews(views); // Releases the views of the disconnected connection
+
+	return Finish("MessageViewTest");
+}
\ No newline at end of file
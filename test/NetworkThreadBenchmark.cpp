@@ -0,0 +1,86 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures how much time the application thread spends in Tubes per frame and how long messages take to arrive, with the socket I/O on the application thread and on the network thread
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT			= 19430;
+	const uint32_t	FRAME_COUNT			= 2000;
+	const uint32_t	MESSAGES_PER_FRAME	= 32;
+	const uint32_t	PAYLOAD_SIZE		= 256;
+	const uint32_t	FRAME_MICROSECONDS	= 1000; // The rest of the frame is left to the network thread, as a game loop would
+
+	void MeasureFrames(bool useNetworkThread, uint16_t port)
+	{
+		Settings::UseNetworkThread = useNetworkThread;
+		ConnectionID outgoingID;
+		ConnectionID incomingID;
+		if (!StartLoopback(port, outgoingID, incomingID))
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		StampedMessage message;
+		message.Payload = std::string(PAYLOAD_SIZE, 'x');
+
+		uint64_t tubesMicroseconds = 0;
+		std::vector<uint64_t> latencies;
+		std::vector<Message*> messages;
+		auto receive = [&]()
+		{
+			Receive(messages);
+			uint64_t now = GetMicroseconds();
+			for (Message* receivedMessage : messages)
+			{
+				latencies.push_back(now - static_cast<const StampedMessage*>(receivedMessage)->SentTime);
+			}
+			FreeMessages(messages);
+		};
+
+		uint64_t frameStart = GetMicroseconds();
+		for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			while (GetMicroseconds() < frameStart)
+			{
+				std::this_thread::yield();
+			}
+			frameStart += FRAME_MICROSECONDS;
+
+			uint64_t start = GetMicroseconds();
+			for (uint32_t i = 0; i < MESSAGES_PER_FRAME; ++i)
+			{
+				message.SentTime = GetMicroseconds();
+				message.Sequence = frame * MESSAGES_PER_FRAME + i;
+				SendToConnection(&message, outgoingID);
+			}
+			Update();
+			receive();
+			tubesMicroseconds += GetMicroseconds() - start;
+		}
+		UpdateUntil([&]()
+		{
+			receive();
+			return latencies.size() >= FRAME_COUNT * MESSAGES_PER_FRAME;
+		}, CONNECT_TIMEOUT_MILLISECONDS);
+		TEST_CHECK(latencies.size() == FRAME_COUNT * MESSAGES_PER_FRAME, latencies.size() << " of " << FRAME_COUNT * MESSAGES_PER_FRAME << " messages were received");
+
+		std::string mode = useNetworkThread ? "Network thread" : "Application thread I/O";
+		Report(mode + ", application thread time in Tubes", static_cast<double>(tubesMicroseconds) / FRAME_COUNT, "us/frame");
+		Report(mode + ", p50 latency", static_cast<double>(GetPercentile(latencies, 0.5)), "us");
+		Report(mode + ", p99 latency", static_cast<double>(GetPercentile(latencies, 0.99)), "us");
+		StopTubes();
+	}
+}
+
+int main()
+{
+	MeasureFrames(false, FIRST_PORT);
+	MeasureFrames(true, FIRST_PORT + 1);
+
+	return Finish("NetworkThreadBenchmark");
+}
\ No newline at end of file
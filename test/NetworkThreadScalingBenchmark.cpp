@@ -0,0 +1,75 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures how the message rate over many connections to self scales with the number of network threads the connections are sharded across
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT				= 19440;
+	const uint32_t	THREAD_COUNTS[]			= { 1, 2, 4 };
+	const uint32_t	CONNECTION_COUNT		= 64;
+	const uint32_t	PAYLOAD_SIZE			= 256;
+	const uint32_t	MESSAGES_PER_CONNECTION	= 4000;
+	const uint32_t	MAX_MESSAGES_IN_FLIGHT	= 16 * 1024;
+	const uint32_t	RUN_TIMEOUT_MILLISECONDS = 60 * 1000;
+
+	void MeasureThroughput(uint32_t threadCount, uint16_t port)
+	{
+		Settings::UseNetworkThread		= true;
+		Settings::NetworkThreadCount	= threadCount;
+		if (!StartTubes())
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		std::vector<ConnectionID> outgoingIDs = ConnectToSelfRepeatedly(port, CONNECTION_COUNT);
+		TEST_CHECK(outgoingIDs.size() == CONNECTION_COUNT, "Only " << outgoingIDs.size() << " of " << CONNECTION_COUNT << " connections were made");
+		if (outgoingIDs.size() != CONNECTION_COUNT)
+		{
+			StopTubes();
+			return;
+		}
+
+		const uint32_t messageCount = CONNECTION_COUNT * MESSAGES_PER_CONNECTION;
+		StampedMessage message;
+		message.Payload = std::string(PAYLOAD_SIZE, 'x');
+
+		uint32_t sentCount		= 0;
+		uint32_t receivedCount	= 0;
+		std::vector<Message*> messages;
+		uint64_t start		= GetMicroseconds();
+		uint64_t deadline	= start + RUN_TIMEOUT_MILLISECONDS * 1000ull;
+		while (receivedCount < messageCount && GetMicroseconds() < deadline)
+		{
+			while (sentCount < messageCount && sentCount - receivedCount < MAX_MESSAGES_IN_FLIGHT)
+			{
+				message.Sequence = sentCount;
+				SendToConnection(&message, outgoingIDs[sentCount++ % CONNECTION_COUNT]);
+			}
+			Update();
+
+			Receive(messages);
+			receivedCount += static_cast<uint32_t>(messages.size());
+			FreeMessages(messages);
+		}
+		double seconds = (GetMicroseconds() - start) / 1000000.0;
+		TEST_CHECK(receivedCount == messageCount, receivedCount << " of " << messageCount << " messages were received with " << threadCount << " network threads");
+
+		Report(std::to_string(threadCount) + " network threads, " + std::to_string(CONNECTION_COUNT) + " connections", receivedCount / seconds, "messages/s");
+		StopTubes();
+	}
+}
+
+int main()
+{
+	for (uint32_t i = 0; i < sizeof(THREAD_COUNTS) / sizeof(THREAD_COUNTS[0]); ++i)
+	{
+		MeasureThroughput(THREAD_COUNTS[i], static_cast<uint16_t>(FIRST_PORT + i));
+	}
+
+	return Finish("NetworkThreadScalingBenchmark");
+}
\ No newline at end of file
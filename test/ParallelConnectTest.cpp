@@ -0,0 +1,63 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Requests connections to many local listeners, and to a few ports that nobody listens on, all at once and times how long it takes until every attempt has been answered
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_LISTENER_PORT		= 19200;
+	const uint32_t	LISTENER_COUNT			= 100;
+	const uint16_t	FIRST_CLOSED_PORT		= FIRST_LISTENER_PORT + LISTENER_COUNT;
+	const uint32_t	CLOSED_PORT_COUNT		= 10;
+	const uint64_t	MAX_CONNECT_MICROSECONDS = 5 * 1000 * 1000; // Loopback connections are answered right away, so this only fails if the attempts wait on each other
+}
+
+int main()
+{
+	if (!StartTubes())
+		return 1;
+
+	for (uint32_t i = 0; i < LISTENER_COUNT; ++i)
+	{
+		TEST_CHECK(StartListener(static_cast<uint16_t>(FIRST_LISTENER_PORT + i)), "Failed to listen on port " << FIRST_LISTENER_PORT + i);
+	}
+
+	uint32_t outgoingCount	= 0;
+	uint32_t incomingCount	= 0;
+	uint32_t failedCount	= 0;
+	ConnectionCallbackHandle handle = RegisterConnectionCallback([&](const ConnectionAttemptResultData& result)
+	{
+		if (result.Result == ConnectionAttemptResult::SUCCESS_OUTGOING)
+			++outgoingCount;
+		else if (result.Result == ConnectionAttemptResult::SUCCESS_INCOMING)
+			++incomingCount;
+		else
+			++failedCount;
+	});
+
+	uint64_t start = GetMicroseconds();
+	for (uint32_t i = 0; i < LISTENER_COUNT; ++i)
+	{
+		RequestConnection(LOCALHOST_IP, static_cast<uint16_t>(FIRST_LISTENER_PORT + i));
+	}
+	for (uint32_t i = 0; i < CLOSED_PORT_COUNT; ++i)
+	{
+		RequestConnection(LOCALHOST_IP, static_cast<uint16_t>(FIRST_CLOSED_PORT + i));
+	}
+
+	UpdateUntil([&]() { return outgoingCount + failedCount == LISTENER_COUNT + CLOSED_PORT_COUNT && incomingCount == LISTENER_COUNT; }, CONNECT_TIMEOUT_MILLISECONDS * 2);
+	uint64_t elapsed = GetMicroseconds() - start;
+	std::cout << "Connected " << outgoingCount << " outgoing and " << incomingCount << " incoming connections, " << failedCount << " attempts failed, in " << elapsed / 1000.0 << " ms" << std::endl;
+
+	TEST_CHECK(outgoingCount == LISTENER_COUNT, outgoingCount << " of " << LISTENER_COUNT << " outgoing connections succeeded");
+	TEST_CHECK(incomingCount == LISTENER_COUNT, incomingCount << " of " << LISTENER_COUNT << " incoming connections were accepted");
+	TEST_CHECK(failedCount == CLOSED_PORT_COUNT, failedCount << " of the " << CLOSED_PORT_COUNT << " connection attempts to closed ports failed");
+	TEST_CHECK(GetConnectionCount() == 2 * LISTENER_COUNT, "Tubes reports " << GetConnectionCount() << " connections");
+	TEST_CHECK(elapsed <= MAX_CONNECT_MICROSECONDS, "Connecting took " << elapsed << " us");
+
+	UnregisterConnectionCallback(handle);
+	return Finish("ParallelConnectTest");
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Saturates a bandwidth limited loopback connection with LOW priority bulk messages and measures how long HIGH priority messages sent alongside them take to arrive
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	PORT							= 19150;
+	const uint32_t	BANDWIDTH_LIMIT					= 512 * 1024;
+	const uint32_t	BULK_MESSAGE_SIZE				= 8 * 1024;
+	const uint32_t	BULK_BACKLOG_MESSAGE_COUNT		= 128; // Bulk messages kept in flight so that the connection stays saturated
+	const uint32_t	RUN_MILLISECONDS				= 3000;
+	const uint64_t	MAX_P99_LATENCY_MICROSECONDS	= 100 * 1000; // Emptying the bulk backlog alone takes about two seconds
+
+	enum Stream : uint32_t
+	{
+		BULK,
+		URGENT,
+	};
+}
+
+int main()
+{
+	Settings::ConnectionBandwidthLimit = BANDWIDTH_LIMIT;
+
+	ConnectionID outgoingID;
+	ConnectionID incomingID;
+	if (!StartLoopback(PORT, outgoingID, incomingID))
+		return 1;
+
+	StampedMessage bulk;
+	bulk.Stream = BULK;
+	bulk.Payload.assign(BULK_MESSAGE_SIZE, 'b');
+
+	std::vector<uint64_t>	urgentLatencies;
+	std::vector<uint64_t>	bulkLatencies;
+	std::vector<Message*>	messages;
+	uint32_t				urgentSentCount	= 0;
+	uint32_t				bulkSentCount	= 0;
+	uint64_t				runEnd			= GetMicroseconds() + RUN_MILLISECONDS * 1000ull;
+	while (GetMicroseconds() < runEnd)
+	{
+		while (bulkSentCount - bulkLatencies.size() < BULK_BACKLOG_MESSAGE_COUNT)
+		{
+			bulk.SentTime = GetMicroseconds();
+			bulk.Sequence = bulkSentCount++;
+			SendToConnection(&bulk, outgoingID, MessagePriority::LOW);
+		}
+
+		StampedMessage urgent;
+		urgent.SentTime	= GetMicroseconds();
+		urgent.Stream	= URGENT;
+		urgent.Sequence	= urgentSentCount++;
+		SendToConnection(&urgent, outgoingID, MessagePriority::HIGH);
+
+		Update();
+		Receive(messages);
+		for (Message* message : messages)
+		{
+			const StampedMessage* stamped = static_cast<const StampedMessage*>(message);
+			(stamped->Stream == URGENT ? urgentLatencies : bulkLatencies).push_back(GetMicroseconds() - stamped->SentTime);
+		}
+		FreeMessages(messages);
+		Sleep(1);
+	}
+
+	uint64_t urgentP99	= GetPercentile(urgentLatencies, 0.99);
+	uint64_t bulkMedian	= GetPercentile(bulkLatencies, 0.5);
+	std::cout << "HIGH: " << urgentLatencies.size() << "/" << urgentSentCount << " received, p50 " << GetPercentile(urgentLatencies, 0.5) / 1000.0 << " ms, p99 " << urgentP99 / 1000.0 << " ms, max " << GetPercentile(urgentLatencies, 1.0) / 1000.0 << " ms. LOW: " << bulkLatencies.size() << " received, p50 " << bulkMedian / 1000.0 << " ms" << std::endl;
+
+	TEST_CHECK(urgentLatencies.size() >= urgentSentCount * 9 / 10, "Only " << urgentLatencies.size() << " of " << urgentSentCount << " HIGH priority messages arrived");
+	TEST_CHECK(!bulkLatencies.empty(), "No LOW priority message arrived while HIGH priority messages were sent");
+	TEST_CHECK(bulkMedian > MAX_P99_LATENCY_MICROSECONDS, "The LOW priority median latency of " << bulkMedian << " us shows that the connection wasn't saturated");
+	TEST_CHECK(urgentP99 <= MAX_P99_LATENCY_MICROSECONDS, "The HIGH priority p99 latency of " << urgentP99 << " us exceeds " << MAX_P99_LATENCY_MICROSECONDS << " us");
+
+	return Finish("PriorityLatencyTest");
+}
\ No newline at end of file
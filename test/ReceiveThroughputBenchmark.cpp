@@ -0,0 +1,67 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures how many messages per second a connection to self delivers for a few message sizes. Sending and receiving share the thread, so this is the cost of both ends
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT			= 19410;
+	const uint32_t	PAYLOAD_SIZES[]		= { 16, 256, 4096 };
+	const uint64_t	BYTES_PER_RUN		= 64 * 1024 * 1024;
+	const uint32_t	MAX_MESSAGE_COUNT	= 500000;
+	const uint64_t	MAX_BYTES_IN_FLIGHT	= 256 * 1024; // Well below the socket buffers, so that the run measures the receiving rather than waiting on a full socket
+	const uint32_t	RUN_TIMEOUT_MILLISECONDS = 60 * 1000;
+
+	void MeasureThroughput(uint32_t payloadSize, uint16_t port)
+	{
+		ConnectionID outgoingID;
+		ConnectionID incomingID;
+		if (!StartLoopback(port, outgoingID, incomingID))
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		uint32_t messageCount = static_cast<uint32_t>(std::min<uint64_t>(MAX_MESSAGE_COUNT, BYTES_PER_RUN / payloadSize));
+		StampedMessage message;
+		message.Payload = std::string(payloadSize, 'x');
+
+		uint32_t sentCount		= 0;
+		uint32_t receivedCount	= 0;
+		std::vector<Message*> messages;
+		uint64_t start		= GetMicroseconds();
+		uint64_t deadline	= start + RUN_TIMEOUT_MILLISECONDS * 1000ull;
+		while (receivedCount < messageCount && GetMicroseconds() < deadline)
+		{
+			while (sentCount < messageCount && static_cast<uint64_t>(sentCount - receivedCount) * payloadSize < MAX_BYTES_IN_FLIGHT)
+			{
+				message.Sequence = sentCount++;
+				SendToConnection(&message, outgoingID);
+			}
+			Update();
+
+			Receive(messages);
+			receivedCount += static_cast<uint32_t>(messages.size());
+			FreeMessages(messages);
+		}
+		double seconds = (GetMicroseconds() - start) / 1000000.0;
+		TEST_CHECK(receivedCount == messageCount, receivedCount << " of " << messageCount << " messages of " << payloadSize << " bytes were received");
+
+		Report(std::to_string(payloadSize) + " byte messages", receivedCount / seconds, "messages/s");
+		Report(std::to_string(payloadSize) + " byte messages", receivedCount * static_cast<double>(payloadSize) / seconds / (1024.0 * 1024.0), "MiB/s");
+		StopTubes();
+	}
+}
+
+int main()
+{
+	for (uint32_t i = 0; i < sizeof(PAYLOAD_SIZES) / sizeof(PAYLOAD_SIZES[0]); ++i)
+	{
+		MeasureThroughput(PAYLOAD_SIZES[i], static_cast<uint16_t>(FIRST_PORT + i));
+	}
+
+	return Finish("ReceiveThroughputBenchmark");
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures what Tubes::Update costs per frame when one connection carries traffic and the rest are idle.
+// Update sweeps every connection for queued data to send, so the time per frame shows whether idle connections still cost anything to skip
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	FIRST_PORT			= 19510;
+	const uint32_t	IDLE_COUNTS[]		= { 0, 1000, 2000 }; // Both ends are in this process, so this is twice as many idle connections
+	const uint32_t	LISTEN_BACKLOG		= 1024;
+	const uint32_t	FRAME_COUNT			= 2000;
+
+	void MeasureUpdate(uint32_t idleCount, uint16_t port)
+	{
+		Settings::UseReadinessPolling	= true; // Keeps the receive side from touching the idle connections
+		Settings::ListenBacklog			= LISTEN_BACKLOG;
+		if (!StartTubes())
+		{
+			++FailedCheckCount;
+			return;
+		}
+
+		std::vector<ConnectionID> outgoingIDs = ConnectToSelfRepeatedly(port, idleCount + 1);
+		TEST_CHECK(outgoingIDs.size() == idleCount + 1, "Only " << outgoingIDs.size() << " of " << idleCount + 1 << " connections were made");
+		if (outgoingIDs.empty())
+		{
+			StopTubes();
+			return;
+		}
+		ConnectionID activeID = outgoingIDs.back();
+
+		StampedMessage message;
+		uint32_t receivedCount = 0;
+		uint64_t updateMicroseconds = 0;
+		std::vector<Message*> messages;
+		for (uint32_t frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			message.Sequence = frame;
+			SendToConnection(&message, activeID);
+
+			uint64_t start = GetMicroseconds();
+			Update();
+			updateMicroseconds += GetMicroseconds() - start;
+
+			Receive(messages);
+			receivedCount += static_cast<uint32_t>(messages.size());
+			FreeMessages(messages);
+		}
+		UpdateUntil([&]()
+		{
+			Receive(messages);
+			receivedCount += static_cast<uint32_t>(messages.size());
+			FreeMessages(messages);
+			return receivedCount >= FRAME_COUNT;
+		}, CONNECT_TIMEOUT_MILLISECONDS);
+		TEST_CHECK(receivedCount == FRAME_COUNT, receivedCount << " of " << FRAME_COUNT << " messages were received");
+		TEST_CHECK(GetQueuedByteCount(activeID) == 0, GetQueuedByteCount(activeID) << " bytes are still queued on the active connection");
+
+		Report("Update with 1 active and " + std::to_string(2 * idleCount + 1) + " idle connections", static_cast<double>(updateMicroseconds) / FRAME_COUNT, "us/frame");
+		StopTubes();
+	}
+}
+
+int main()
+{
+	for (uint32_t i = 0; i < sizeof(IDLE_COUNTS) / sizeof(IDLE_COUNTS[0]); ++i)
+	{
+		MeasureUpdate(IDLE_COUNTS[i], static_cast<uint16_t>(FIRST_PORT + i));
+	}
+
+	return Finish("SendSweepBenchmark");
+}
\ No newline at end of file
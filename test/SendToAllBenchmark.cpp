@@ -0,0 +1,58 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures the time Tubes::SendToAll takes to queue one message on every connection of a process with many connections to itself
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	PORT				= 19420;
+	const uint32_t	CONNECTION_COUNT	= 64; // Each connection to self has two ends, so every broadcast has twice as many recipients
+	const uint32_t	PAYLOAD_SIZE		= 1024;
+	const uint32_t	BROADCAST_COUNT		= 2000;
+}
+
+int main()
+{
+	if (!StartTubes())
+		return 1;
+
+	std::vector<ConnectionID> outgoingIDs = ConnectToSelfRepeatedly(PORT, CONNECTION_COUNT);
+	TEST_CHECK(outgoingIDs.size() == CONNECTION_COUNT, "Only " << outgoingIDs.size() << " of " << CONNECTION_COUNT << " connections were made");
+	if (outgoingIDs.size() != CONNECTION_COUNT)
+		return Finish("SendToAllBenchmark");
+
+	const uint32_t recipientCount = 2 * CONNECTION_COUNT;
+	StampedMessage message;
+	message.Payload = std::string(PAYLOAD_SIZE, 'x');
+
+	uint64_t sendMicroseconds	= 0;
+	uint32_t receivedCount		= 0;
+	std::vector<Message*> messages;
+	for (uint32_t i = 0; i < BROADCAST_COUNT; ++i)
+	{
+		message.Sequence = i;
+		uint64_t start = GetMicroseconds();
+		SendToAll(&message);
+		sendMicroseconds += GetMicroseconds() - start;
+
+		uint32_t expectedCount = (i + 1) * recipientCount;
+		bool received = UpdateUntil([&]()
+		{
+			Receive(messages);
+			receivedCount += static_cast<uint32_t>(messages.size());
+			FreeMessages(messages);
+			return receivedCount >= expectedCount;
+		}, CONNECT_TIMEOUT_MILLISECONDS);
+
+		if (!received)
+			break;
+	}
+	TEST_CHECK(receivedCount == BROADCAST_COUNT * recipientCount, receivedCount << " of " << BROADCAST_COUNT * recipientCount << " broadcast messages were received");
+
+	Report("SendToAll of a " + std::to_string(PAYLOAD_SIZE) + " byte message to " + std::to_string(recipientCount) + " connections", static_cast<double>(sendMicroseconds) / BROADCAST_COUNT, "us");
+	Report("SendToAll per recipient", static_cast<double>(sendMicroseconds) / BROADCAST_COUNT / recipientCount, "us");
+	return Finish("SendToAllBenchmark");
+}
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "TestUtility.h"
+#include <cstdint>
+
+// Measures how long the test replicator takes to serialize and deserialize a message through the bounds checked cursors
+
+using namespace TubesTest;
+
+namespace
+{
+	const uint32_t	PAYLOAD_SIZES[]	= { 16, 256, 4096 };
+	const uint32_t	MESSAGE_COUNT	= 200000;
+}
+
+int main()
+{
+	TestReplicator replicator(TEST_REPLICATOR_ID);
+	for (uint32_t payloadSize : PAYLOAD_SIZES)
+	{
+		StampedMessage message;
+		message.SentTime	= GetMicroseconds();
+		message.Sequence	= payloadSize;
+		message.Payload		= std::string(payloadSize, 'x');
+
+		std::vector<MUtility::Byte*> serializedMessages(MESSAGE_COUNT);
+		uint64_t start = GetMicroseconds();
+		for (uint32_t i = 0; i < MESSAGE_COUNT; ++i)
+		{
+			serializedMessages[i] = replicator.SerializeMessage(&message);
+		}
+		double serializeNanoseconds = (GetMicroseconds() - start) * 1000.0 / MESSAGE_COUNT;
+
+		uint32_t mismatchCount = 0;
+		start = GetMicroseconds();
+		for (uint32_t i = 0; i < MESSAGE_COUNT; ++i)
+		{
+			StampedMessage* deserializedMessage = static_cast<StampedMessage*>(replicator.DeserializeMessage(serializedMessages[i]));
+			if (deserializedMessage == nullptr || deserializedMessage->Sequence != message.Sequence || deserializedMessage->Payload.size() != payloadSize)
+				++mismatchCount;
+
+			if (deserializedMessage != nullptr)
+			{
+				deserializedMessage->Destroy();
+				MessageAllocator::Free(deserializedMessage);
+			}
+			MessageAllocator::Free(serializedMessages[i]);
+		}
+		double deserializeNanoseconds = (GetMicroseconds() - start) * 1000.0 / MESSAGE_COUNT;
+		TEST_CHECK(mismatchCount == 0, mismatchCount << " of " << MESSAGE_COUNT << " messages with " << payloadSize << " byte payloads didn't survive the round trip");
+
+		Report("Serialize, " + std::to_string(payloadSize) + " byte payload", serializeNanoseconds, "ns/message");
+		Report("Deserialize and free, " + std::to_string(payloadSize) + " byte payload", deserializeNanoseconds, "ns/message");
+	}
+
+	return Finish("SerializationBenchmark");
+}
\ No newline at end of file
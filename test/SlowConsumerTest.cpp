@@ -0,0 +1,129 @@
+#include "TestUtility.h"
+#include <cstdint>
+#include <set>
+
+// Floods peers that never read with each slow consumer policy while a healthy loopback connection keeps exchanging messages. The send queue of a peer that doesn't read must stay below the high watermark
+
+using namespace Tubes;
+using namespace TubesTest;
+
+namespace
+{
+	const uint16_t	PORT						= 19160;
+	const uint32_t	HIGH_WATERMARK				= 256 * 1024;
+	const uint32_t	LOW_WATERMARK				= 64 * 1024;
+	const uint32_t	QUEUE_SLACK					= 1024; // Critical control frames, such as the capabilities offer, are queued regardless of the watermark
+	const uint32_t	FLOOD_MESSAGE_SIZE			= 4 * 1024;
+	const uint32_t	FLOOD_MESSAGES_PER_FRAME	= 16;
+	const int		PEER_RECEIVE_BUFFER_SIZE	= 4 * 1024;
+	const uint32_t	SOAK_MILLISECONDS			= 2000;
+
+	const char* GetPolicyName(SlowConsumerPolicy policy)
+	{
+		switch (policy)
+		{
+			case SlowConsumerPolicy::DROP_OLDEST:	return "DROP_OLDEST";
+			case SlowConsumerPolicy::DROP_NEWEST:	return "DROP_NEWEST";
+			case SlowConsumerPolicy::DISCONNECT:	return "DISCONNECT";
+			default:								return "INVALID";
+		}
+	}
+}
+
+int main()
+{
+	Settings::SendQueueHighWatermark	= HIGH_WATERMARK;
+	Settings::SendQueueLowWatermark		= LOW_WATERMARK;
+
+	ConnectionID healthyOutgoingID;
+	ConnectionID healthyIncomingID;
+	if (!StartLoopback(PORT, healthyOutgoingID, healthyIncomingID))
+		return 1;
+
+	ConnectionID			slowConsumerID = TUBES_INVALID_CONNECTION_ID;
+	std::set<ConnectionID>	disconnectedIDs;
+	ConnectionCallbackHandle connectionHandle = RegisterConnectionCallback([&](const ConnectionAttemptResultData& result)
+	{
+		if (result.Result == ConnectionAttemptResult::SUCCESS_INCOMING)
+			slowConsumerID = result.ID;
+	});
+	DisconnectionCallbackHandle disconnectionHandle = RegisterDisconnectionCallback([&](const DisconnectionData& data)
+	{
+		disconnectedIDs.insert(data.ID);
+	});
+
+	StampedMessage flood;
+	flood.Payload.assign(FLOOD_MESSAGE_SIZE, 'f');
+
+	std::vector<Message*>	messages;
+	uint32_t				healthySentCount		= 0;
+	uint32_t				healthyReceivedCount	= 0;
+	const SlowConsumerPolicy policies[] = { SlowConsumerPolicy::DROP_NEWEST, SlowConsumerPolicy::DROP_OLDEST, SlowConsumerPolicy::DISCONNECT };
+	for (SlowConsumerPolicy policy : policies)
+	{
+		Settings::SendQueuePolicy = policy;
+
+		slowConsumerID = TUBES_INVALID_CONNECTION_ID;
+		Socket peerSocket = ConnectRawSocket(PORT, PEER_RECEIVE_BUFFER_SIZE);
+		if (peerSocket == INVALID_SOCKET || !UpdateUntil([&]() { return slowConsumerID != TUBES_INVALID_CONNECTION_ID; }, CONNECT_TIMEOUT_MILLISECONDS))
+		{
+			TEST_CHECK(false, "Failed to connect the peer that doesn't read for " << GetPolicyName(policy));
+			continue;
+		}
+
+		uint64_t	maxQueuedByteCount	= 0;
+		bool		sawBackpressure		= false;
+		uint64_t	soakEnd				= GetMicroseconds() + SOAK_MILLISECONDS * 1000ull;
+		while (GetMicroseconds() < soakEnd)
+		{
+			if (disconnectedIDs.count(slowConsumerID) == 0)
+			{
+				for (uint32_t i = 0; i < FLOOD_MESSAGES_PER_FRAME; ++i)
+				{
+					SendToConnection(&flood, slowConsumerID);
+				}
+				maxQueuedByteCount	= std::max(maxQueuedByteCount, GetQueuedByteCount(slowConsumerID));
+				sawBackpressure		|= IsBackpressured(slowConsumerID);
+			}
+
+			StampedMessage heartbeat;
+			heartbeat.Sequence = healthySentCount++;
+			SendToConnection(&heartbeat, healthyOutgoingID);
+
+			Update();
+			Receive(messages);
+			healthyReceivedCount += static_cast<uint32_t>(messages.size());
+			FreeMessages(messages);
+			Sleep(1);
+		}
+
+		bool disconnected = disconnectedIDs.count(slowConsumerID) != 0;
+		std::cout << GetPolicyName(policy) << ": most bytes queued " << maxQueuedByteCount << ", backpressured " << sawBackpressure << ", disconnected " << disconnected << std::endl;
+
+		TEST_CHECK(maxQueuedByteCount <= HIGH_WATERMARK + QUEUE_SLACK, GetPolicyName(policy) << " let " << maxQueuedByteCount << " bytes queue up with a high watermark of " << HIGH_WATERMARK);
+		if (policy == SlowConsumerPolicy::DISCONNECT)
+		{
+			TEST_CHECK(disconnected, "The slow consumer wasn't disconnected");
+		}
+		else
+		{
+			TEST_CHECK(sawBackpressure, GetPolicyName(policy) << " never reported backpressure");
+			TEST_CHECK(!disconnected, GetPolicyName(policy) << " disconnected the slow consumer");
+			Disconnect(slowConsumerID);
+		}
+		TubesUtility::ShutdownAndCloseSocket(peerSocket);
+	}
+
+	UpdateUntil([&]()
+	{
+		Receive(messages);
+		healthyReceivedCount += static_cast<uint32_t>(messages.size());
+		FreeMessages(messages);
+		return healthyReceivedCount == healthySentCount;
+	}, CONNECT_TIMEOUT_MILLISECONDS);
+	TEST_CHECK(healthyReceivedCount == healthySentCount, "The healthy connection received " << healthyReceivedCount << " of " << healthySentCount << " messages");
+
+	UnregisterConnectionCallback(connectionHandle);
+	UnregisterDisconnectionCallback(disconnectionHandle);
+	return Finish("SlowConsumerTest");
+}
\ No newline at end of file
@@ -0,0 +1,249 @@
+#pragma once
+#include "Interface/Tubes.h"
+#include "Interface/TubesSettings.h"
+#include "Interface/messaging/MessageAllocator.h"
+#include "Interface/messaging/MessageSchema.h"
+#include "InternalTubesTypes.h"
+#include "TubesUtility.h"
+#include <MUtilityPlatformDefinitions.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if PLATFORM == PLATFORM_WINDOWS
+	#include <MUtilityWindowsInclude.h>
+	#include <Ws2tcpip.h>
+#else
+	#include <arpa/inet.h>
+	#include <sys/socket.h>
+	#include <netinet/in.h>
+	#include <unistd.h>
+#endif
+
+// Helpers shared by the loopback tests and benchmarks. Each one is its own executable that talks to itself through 127.0.0.1 and returns 0 when every check passed
+
+#define TEST_REPLICATOR_ID 9
+
+#define TEST_CHECK(condition, message) { if (!(condition)) { std::cout << __FILE__ << "(" << __LINE__ << "): Check failed: " #condition " - " << message << std::endl; ++TubesTest::FailedCheckCount; } }
+
+namespace TubesTest
+{
+	static int	FailedCheckCount	= 0;
+	static bool	TubesStarted		= false;
+
+	const uint32_t CONNECT_TIMEOUT_MILLISECONDS	= 5000;
+	const uint32_t CONNECT_BATCH_SIZE			= 8;
+
+	enum TestMessageType : MESSAGE_TYPE_ENUM_UNDELYING_TYPE
+	{
+		STAMPED,
+	};
+
+	struct StampedMessage : Message // Carries the time it was sent so that the receiver can measure its latency
+	{
+		StampedMessage() : Message(STAMPED, TEST_REPLICATOR_ID) {}
+
+		void Destroy() override { std::string().swap(Payload); }
+
+		uint64_t	SentTime	= 0; // Microseconds. See GetMicroseconds
+		uint32_t	Stream		= 0; // Lets a test tell its kinds of traffic apart
+		uint32_t	Sequence	= 0;
+		std::string	Payload;
+
+		using Schema = MessageSchema<STAMPED, SCHEMA_FIELD(StampedMessage, SentTime), SCHEMA_FIELD(StampedMessage, Stream), SCHEMA_FIELD(StampedMessage, Sequence), SCHEMA_FIELD(StampedMessage, Payload)>;
+	};
+
+	class TestReplicator : public SchemaReplicator<StampedMessage>
+	{
+	public:
+		TestReplicator(ReplicatorID id) : SchemaReplicator(id) {}
+	};
+
+	inline uint64_t GetMicroseconds()
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	inline void Sleep(uint32_t milliseconds)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+	}
+
+	template<typename Predicate>
+	bool UpdateUntil(Predicate done, uint32_t timeoutMilliseconds) // Returns false if the time ran out before done() returned true
+	{
+		uint64_t deadline = GetMicroseconds() + timeoutMilliseconds * 1000ull;
+		while (!done())
+		{
+			if (GetMicroseconds() >= deadline)
+				return false;
+
+			Tubes::Update();
+			Sleep(1);
+		}
+		return true;
+	}
+
+	inline void FreeMessages(std::vector<Message*>& messages)
+	{
+		for (Message* message : messages)
+		{
+			message->Destroy();
+			MessageAllocator::Free(message);
+		}
+		messages.clear();
+	}
+
+	inline void DiscardReceivedMessages()
+	{
+		std::vector<Message*> messages;
+		Tubes::Receive(messages);
+		FreeMessages(messages);
+	}
+
+	inline void UpdateFor(uint32_t milliseconds) // Throws away what is received
+	{
+		UpdateUntil([]()
+		{
+			DiscardReceivedMessages();
+			return false;
+		}, milliseconds);
+	}
+
+	inline bool ConnectToSelf(uint16_t port, Tubes::ConnectionID& outOutgoingID, Tubes::ConnectionID& outIncomingID) // Listens on the port and connects to it so that both ends of the connection are driven by this process
+	{
+		outOutgoingID = TUBES_INVALID_CONNECTION_ID;
+		outIncomingID = TUBES_INVALID_CONNECTION_ID;
+		Tubes::ConnectionCallbackHandle handle = Tubes::RegisterConnectionCallback([&](const Tubes::ConnectionAttemptResultData& result)
+		{
+			if (result.Result == Tubes::ConnectionAttemptResult::SUCCESS_OUTGOING)
+				outOutgoingID = result.ID;
+			else if (result.Result == Tubes::ConnectionAttemptResult::SUCCESS_INCOMING)
+				outIncomingID = result.ID;
+		});
+
+		if (Tubes::StartListener(port))
+		{
+			Tubes::RequestConnection(LOCALHOST_IP, port);
+			UpdateUntil([&]() { return outOutgoingID != TUBES_INVALID_CONNECTION_ID && outIncomingID != TUBES_INVALID_CONNECTION_ID; }, CONNECT_TIMEOUT_MILLISECONDS);
+		}
+
+		Tubes::UnregisterConnectionCallback(handle);
+		return outOutgoingID != TUBES_INVALID_CONNECTION_ID && outIncomingID != TUBES_INVALID_CONNECTION_ID;
+	}
+
+	inline std::vector<Tubes::ConnectionID> ConnectToSelfRepeatedly(uint16_t port, uint32_t count) // Makes count connections to self through one listener and returns the IDs of their outgoing ends
+	{
+		std::vector<Tubes::ConnectionID> outgoingIDs;
+		uint32_t incomingCount = 0;
+		Tubes::ConnectionCallbackHandle handle = Tubes::RegisterConnectionCallback([&](const Tubes::ConnectionAttemptResultData& result)
+		{
+			if (result.Result == Tubes::ConnectionAttemptResult::SUCCESS_OUTGOING)
+				outgoingIDs.push_back(result.ID);
+			else if (result.Result == Tubes::ConnectionAttemptResult::SUCCESS_INCOMING)
+				++incomingCount;
+		});
+
+		if (Tubes::StartListener(port))
+		{
+			// Connect in small batches. All attempts are in flight at once, and more than the listen backlog would have their SYNs dropped and retried
+			uint32_t requestedCount = 0;
+			while (requestedCount < count)
+			{
+				uint32_t batchEnd = std::min(count, requestedCount + CONNECT_BATCH_SIZE);
+				for (; requestedCount < batchEnd; ++requestedCount)
+				{
+					Tubes::RequestConnection(LOCALHOST_IP, port);
+				}
+				if (!UpdateUntil([&]() { return outgoingIDs.size() == requestedCount && incomingCount == requestedCount; }, CONNECT_TIMEOUT_MILLISECONDS))
+					break;
+			}
+		}
+
+		Tubes::UnregisterConnectionCallback(handle);
+		return outgoingIDs;
+	}
+
+	inline Socket ConnectRawSocket(uint16_t port, int receiveBufferSize = 0) // A plain blocking TCP socket for playing a peer that doesn't follow the protocol. 0 keeps the default receive buffer size
+	{
+		Socket rawSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (rawSocket == INVALID_SOCKET)
+			return INVALID_SOCKET;
+
+		if (receiveBufferSize > 0) // Set before connecting so that the advertised window starts out small
+			setsockopt(rawSocket, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&receiveBufferSize), sizeof(receiveBufferSize));
+
+		sockaddr_in address = {};
+		address.sin_family		= AF_INET;
+		address.sin_port		= htons(port);
+		address.sin_addr.s_addr	= htonl(TubesUtility::IPv4StringToAddress(LOCALHOST_IP));
+		if (connect(rawSocket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+		{
+			TubesUtility::CloseSocket(rawSocket);
+			return INVALID_SOCKET;
+		}
+		return rawSocket;
+	}
+
+	inline bool StartTubes() // Initializes Tubes with the test replicator registered. Set the Tubes::Settings of the test before calling this
+	{
+		if (!Tubes::Initialize())
+		{
+			std::cout << "Failed to initialize Tubes" << std::endl;
+			return false;
+		}
+
+		Tubes::RegisterReplicator(new TestReplicator(TEST_REPLICATOR_ID));
+		TubesStarted = true;
+		return true;
+	}
+
+	inline void StopTubes() // Lets a benchmark start Tubes again with other settings
+	{
+		if (TubesStarted)
+			Tubes::Shutdown();
+		TubesStarted = false;
+	}
+
+	inline bool StartLoopback(uint16_t port, Tubes::ConnectionID& outOutgoingID, Tubes::ConnectionID& outIncomingID) // Starts Tubes and connects it to itself through the port. Tubes is shut down again if that fails
+	{
+		if (!StartTubes())
+			return false;
+
+		if (!ConnectToSelf(port, outOutgoingID, outIncomingID))
+		{
+			std::cout << "Failed to connect to self through port " << port << std::endl;
+			StopTubes();
+			return false;
+		}
+		return true;
+	}
+
+	inline uint64_t GetPercentile(std::vector<uint64_t> values, double fraction)
+	{
+		if (values.empty())
+			return 0;
+
+		std::sort(values.begin(), values.end());
+		return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+	}
+
+	inline void Report(const std::string& measurement, double value, const char* unit) // Prints one measurement of a benchmark
+	{
+		std::cout << measurement << ": " << value << " " << unit << std::endl;
+	}
+
+	inline int Finish(const char* testName) // Shuts Tubes down and returns the exit code of the test
+	{
+		StopTubes();
+		if (FailedCheckCount == 0)
+			std::cout << testName << " passed" << std::endl;
+		else
+			std::cout << testName << " failed " << FailedCheckCount << " check(s)" << std::endl;
+		return FailedCheckCount == 0 ? 0 : 1;
+	}
+}
\ No newline at end of file